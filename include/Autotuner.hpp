@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+* Chooses settings of the simulation that change its speed but not its physics, by trying candidates for a few steps while the simulation runs and keeping the fastest.
+* @details The settings are tuned one after the other : each candidate of a setting is tried for WINDOW steps, ROUNDS times, then the fastest is kept before tuning the next setting.
+* The rounds are interleaved so a scene getting slower or faster over time doesn't favour a candidate, and the best window of each candidate is kept.
+* Step durations are compared per Particle as the number of Particles can change between windows.
+* A candidate is rejected if a step of its trial didn't compute the same physics as the initial candidate (@see Setting::equivalent).
+*/
+class Autotuner {
+public :
+	struct Setting {
+		std::string name;
+		std::vector<float> candidates;
+		std::vector<std::string> labels; //< How each candidate is printed.
+		uint8_t initial; //< Candidate used before tuning. It is kept unless another one is at least MARGIN faster.
+		std::function<void(float)> apply; //< Makes the simulation use a candidate. Called between 2 steps.
+		std::function<bool()> equivalent; //< Whether the last step computed the same physics as it would have with initial. Always true if empty.
+
+		std::vector<float> cost; //< Lowest step duration per Particle measured with each candidate (ns). INFINITY if not measured.
+		std::vector<bool> rejected; //< Whether a step of the candidate's trial wasn't equivalent.
+		uint8_t best; //< Candidate kept once the setting is tuned.
+	};
+	static constexpr uint16_t WARMUP = 3; //< Steps ignored after changing a candidate, while the caches and the work sharing adapt.
+	static constexpr uint16_t WINDOW = 30; //< Steps measured in a trial.
+	static constexpr uint8_t ROUNDS = 2; //< Trials of each candidate.
+	static constexpr float MARGIN = 0.03f;
+
+private :
+	std::vector<Setting> settings;
+	bool running = false;
+	bool finished = false;
+	uint8_t setting = 0; //< Setting being tuned.
+	uint8_t candidate = 0; //< Candidate being tried.
+	int16_t trial = 0; //< Position of the trial in the current round. The trials of a round start with the initial candidate.
+	uint8_t round = 0;
+	uint16_t steps = 0; //< Steps done in the current trial, warm up included.
+	uint64_t window_ns = 0;
+	uint64_t window_part_steps = 0; //< Sum of the number of Particles of the steps measured in window_ns.
+
+	void start_setting();
+	/**
+	* @brief Makes the simulation use the candidate to try, skipping the rejected ones, or ends the setting after its last round.
+	*/
+	void next_trial();
+	/**
+	* @brief Keeps the best candidate of the current setting, then starts tuning the next one.
+	*/
+	void end_setting();
+
+public :
+	/**
+	* @brief Adds a setting to tune. It is skipped if it has a single candidate.
+	* @param labels How each candidate is printed. If empty, the candidates' values are printed.
+	*/
+	void add_setting(const std::string& name, const std::vector<float>& candidates, const std::vector<std::string>& labels, uint8_t initial,
+	                 std::function<void(float)> apply, std::function<bool()> equivalent = nullptr);
+	/**
+	* @brief Removes every setting. Only call this while not running.
+	*/
+	void clear();
+
+	/**
+	* @brief Starts tuning the settings in the order they were added. The first candidate is applied right away.
+	* @return false if there is nothing to tune.
+	*/
+	bool start();
+	/**
+	* @brief Stops tuning. The setting being tuned goes back to its initial candidate, the settings already tuned keep their best one.
+	*/
+	void stop();
+	inline bool is_running() const {return running;};
+	/**
+	* @return Whether every setting was tuned since the last start.
+	*/
+	inline bool is_finished() const {return finished;};
+
+	/**
+	* @brief Measures a step done with the current candidate, then changes the candidate if its trial is over. Call this between 2 steps.
+	* @param step_ns Duration of the step.
+	* @param n_parts Number of Particles simulated during the step.
+	*/
+	void measure(uint64_t step_ns, uint32_t n_parts);
+
+	inline const std::vector<Setting>& get_settings() const {return settings;};
+	/**
+	* @brief Prints the cost of each candidate of each tuned setting, and the one kept.
+	*/
+	void print_results() const;
+};
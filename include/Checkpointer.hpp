@@ -0,0 +1,60 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct SimState;
+
+/**
+* Writes checkpoints of the simulation in the background every period simulated seconds, so the simulation doesn't wait for the disk.
+* @details When a checkpoint is due, the simulation copies its state in the Checkpointer's SimState (@see acquire, submit).
+* A writer thread then writes it with SaveLoader::saveCheckpoint, named after the step it was taken at.
+* There is a single SimState : if the previous checkpoint is still being written when the next one is due, the next one waits for a later step.
+*/
+class Checkpointer {
+private :
+	std::string name; //< Name of the checkpoints, before their step. @see SaveLoader::checkpointName
+	double period; //< Simulated seconds between 2 checkpoints.
+	double next_time; //< Simulation time from which the next checkpoint is due. Only used by the simulation.
+	SimState* state;
+
+	std::mutex mutex;
+	std::condition_variable full; //< Wakes the writer up.
+	bool writing = false; //< Whether state is given to the writer. Protected by mutex.
+	bool running = true; //< Protected by mutex.
+	std::thread writer;
+
+	/**
+	* @brief Loop of the writer thread. It writes state each time it is submitted, until the Checkpointer is deleted.
+	*/
+	void write_checkpoints();
+
+public :
+	/**
+	* @brief Constructor. Starts the writer thread.
+	* @param name_ Name of the checkpoints, before their step.
+	* @param period_ Simulated seconds between 2 checkpoints.
+	* @param start_time Simulation time now. The first checkpoint is due period_ seconds later.
+	*/
+	Checkpointer(std::string name_, double period_, double start_time);
+	/**
+	* @brief Writes the checkpoint submitted if there is one, then stops the writer thread.
+	*/
+	~Checkpointer();
+
+	Checkpointer(const Checkpointer&) = delete;
+	Checkpointer& operator=(const Checkpointer&) = delete;
+
+	inline bool is_due(double time) const {return time >= next_time;};
+	/**
+	* @return The SimState to fill with the state of the simulation, or nullptr if the previous checkpoint is still being written.
+	*/
+	SimState* acquire();
+	/**
+	* @brief Gives the SimState filled after acquire to the writer thread. The next checkpoint is due period seconds after time.
+	*/
+	void submit(double time);
+};
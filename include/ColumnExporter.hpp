@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Particle.hpp"
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Which columns are exported besides time, start, id, x and y.
+*/
+struct ColumnLayout {
+	bool speeds = true; //< vx and vy. Files saved without speeds don't have them.
+	bool speed_norm = false; //< speed : the norm of the speed.
+	float cell_size[2] = {0, 0}; //< If not 0, cell : the index of the grid Cell each Particle is in, in a grid of grid_size Cells of cell_size.
+	uint16_t grid_size[2] = {0, 0};
+
+	inline bool hasCells() const {return cell_size[0] > 0 && cell_size[1] > 0 && grid_size[0] && grid_size[1];};
+};
+
+/**
+* A few consecutive frames, stored column by column so each column can be written as a single array. @see SaveLoader::saveColumns
+* @details The Particles of every frame follow each other in the Particle columns : frame f has the rows start[f] to start[f+1].
+*/
+struct ColumnChunk {
+	uint64_t first_frame = 0; //< Index of its first frame among every exported frame.
+	std::vector<double> time; //< Per frame.
+	std::vector<uint64_t> start; //< Per frame, then the number of rows after the last one.
+	std::vector<uint32_t> id; //< Per Particle, as all the columns below.
+	std::vector<float> x, y, vx, vy;
+	std::vector<float> speed;
+	std::vector<uint32_t> cell;
+
+	inline uint32_t frames() const {return time.size();};
+	inline uint64_t rows() const {return id.size();};
+	/**
+	* @brief Empties the columns, keeping their memory, for a chunk starting at first_frame_.
+	*/
+	void clear(uint64_t first_frame_);
+	/**
+	* @brief Appends a frame.
+	* @param ids ID of each Particle. If nullptr, the IDs are the indices.
+	*/
+	void append(const Particle* particles, uint32_t n_parts, double frame_time, const uint32_t* ids, const ColumnLayout& layout);
+};
+
+/**
+* Exports the Particles in the background as chunks of columns, while the simulation runs, for analyses outside of the simulator.
+* @details Each chunk is a file of SaveLoader::saveColumns, named after its first frame. @see SaveLoader::columnsName
+* The simulation appends the frames to a chunk (@see record). Once it has chunk_frames frames, a writer thread writes it while the simulation fills another one.
+* If the previous chunk is still being written when the next one is full, the simulation waits for it.
+*/
+class ColumnExporter {
+private :
+	std::string name; //< Name of the chunks, before their first frame.
+	ColumnLayout layout;
+	uint32_t chunk_frames; //< Frames per chunk.
+	double min_delta_time; //< Minimum simulation time between 2 exported frames.
+	double time_of_last_record = -INFINITY;
+	ColumnChunk chunks[2]; //< The chunk being filled and the chunk being written.
+	uint8_t filling = 0;
+	uint64_t n_frames = 0; //< Frames exported so far.
+
+	std::mutex mutex;
+	std::condition_variable full; //< Wakes the writer up.
+	std::condition_variable written; //< Wakes the simulation up when it waits for the writer.
+	bool writing = false; //< Whether chunks[1-filling] is given to the writer. Protected by mutex.
+	bool running = true; //< Protected by mutex.
+	std::thread writer;
+	double stall_s = 0; //< Time the simulation waited for the writer.
+
+	/**
+	* @brief Loop of the writer thread. It writes each chunk submitted, until the ColumnExporter is deleted.
+	*/
+	void write_chunks();
+	/**
+	* @brief Gives the chunk being filled to the writer, once it wrote the previous one, and starts filling the other.
+	*/
+	void submit();
+
+public :
+	/**
+	* @brief Constructor. Allocates the chunks and starts the writer thread.
+	* @param name_ Name of the chunks, before their first frame.
+	* @param layout_ Columns to export.
+	* @param max_particles Maximum number of Particles in a frame.
+	* @param chunk_frames_ Frames per chunk.
+	* @param min_delta_time_ Minimum simulation time between 2 exported frames.
+	*/
+	ColumnExporter(std::string name_, ColumnLayout layout_, uint32_t max_particles, uint32_t chunk_frames_, double min_delta_time_);
+	/**
+	* @brief Writes the last chunk, even if it isn't full, then stops the writer thread.
+	*/
+	~ColumnExporter();
+
+	ColumnExporter(const ColumnExporter&) = delete;
+	ColumnExporter& operator=(const ColumnExporter&) = delete;
+
+	/**
+	* @brief Appends the Particles to the chunk being filled. Must always be called by the same thread, between 2 steps.
+	* @details Nothing is recorded if less than min_delta_time passed since the last recorded frame.
+	* @param ids ID of each Particle. If nullptr, the IDs are the indices.
+	* @return true if the frame was appended.
+	*/
+	bool record(const Particle* particle_array, uint32_t part_arr_size, double time, const uint32_t* ids = nullptr);
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Particle.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Image of where the Particles are, for displaying huge numbers of Particles at once : each pixel shows how many Particles it holds and how fast they go on average.
+* @details Its size only depends on the number of pixels, so it costs the same to upload whatever the number of Particles.
+* The Particles are binned in parallel : each thread counts a share of them in its own image, then the images are summed and coloured in parallel by rows.
+* The brightness of a pixel is the logarithm of its count, relative to the fullest pixel of the previous image, so it adapts to the density without waiting for a whole pass.
+*/
+class DensityImage {
+public :
+	static constexpr uint32_t MIN_PARALLEL = 32768; //< Below this number of Particles, the calling thread does everything alone, as waking the workers would take longer.
+
+private :
+	uint32_t width = 0, height = 0;
+	float rect[2][2] = {{0, 0}, {1, 1}}; //< World coordinates of the top-left and bottom-right corners of the image.
+	std::vector<std::vector<uint32_t>> counts; //< Number of Particles in each pixel, counted by each thread.
+	std::vector<std::vector<float>> speeds; //< Sum of the norm of the speed of the Particles in each pixel, for each thread.
+	std::vector<uint8_t> pixels; //< RGBA colours of the image.
+	std::vector<uint32_t> thread_max; //< Fullest pixel of the rows coloured by each thread.
+	uint32_t max_count = 1; //< Fullest pixel of the previous image.
+
+	const Particle* particles = nullptr;
+	uint32_t n_parts = 0;
+	float max_speed = 1; //< Speed at which a pixel is the brightest, when colouring speeds.
+	bool speed_colour = false;
+
+	std::mutex mutex;
+	std::condition_variable work; //< Wakes the workers up.
+	std::condition_variable done; //< Wakes run up when the workers are done.
+	std::vector<std::thread> threads;
+	bool running = true;
+	uint64_t generation = 0; //< Number of jobs given to the workers.
+	uint32_t n_working = 0; //< Workers still on the current job.
+	void (DensityImage::*job)(uint8_t, uint8_t) = nullptr;
+	uint8_t job_threads = 1; //< Number of threads on the current job, the calling thread included.
+
+	/**
+	* @brief Loop of the worker thread th_id.
+	*/
+	void help(uint8_t th_id);
+	/**
+	* @brief Calls job on the calling thread (0) and n_threads-1 workers. Returns once it is done.
+	*/
+	void run(void (DensityImage::*job_)(uint8_t, uint8_t), uint8_t n_threads);
+	/**
+	* @brief Counts the share th_id out of n_threads of the Particles in the image of the thread.
+	*/
+	void bin(uint8_t th_id, uint8_t n_threads);
+	/**
+	* @brief Sums the images of the threads and colours the share th_id out of n_threads of the rows.
+	*/
+	void colour(uint8_t th_id, uint8_t n_threads);
+
+public :
+	/**
+	* @brief Constructor. Starts the worker threads.
+	*/
+	DensityImage();
+	~DensityImage();
+
+	DensityImage(const DensityImage&) = delete;
+	DensityImage& operator=(const DensityImage&) = delete;
+
+	/**
+	* @brief Makes the image of the Particles in a rectangle of the world.
+	* @param particles_ Particles to draw. They mustn't change until it returns.
+	* @param width_ Width of the image in pixels. The height follows from the rectangle, so the pixels are square.
+	* @param rect_ World coordinates of the top-left and bottom-right corners of the rectangle.
+	* @param max_speed_ Speed at which a pixel is the brightest, when speed_colour_ is set.
+	* @param speed_colour_ Whether the pixels are coloured by the mean speed of their Particles, like the Particles are. Otherwise they are white.
+	*/
+	void update(const Particle* particles_, uint32_t n_parts_, uint32_t width_, const float rect_[2][2], float max_speed_, bool speed_colour_);
+
+	inline uint32_t getWidth() const {return width;};
+	inline uint32_t getHeight() const {return height;};
+	/**
+	* @return The RGBA colours of the image, row by row from the top. The pixels without Particles are transparent.
+	*/
+	inline const uint8_t* getPixels() const {return pixels.data();};
+	/**
+	* @return The world coordinate d of corner c, 0 being the top-left one.
+	*/
+	inline float getCorner(uint8_t c, uint8_t d) const {return rect[c][d];};
+};
@@ -26,12 +26,13 @@ private :
 
 	Particle_simulator& simulator; //< The simulator with which the handler will interact
 
-	std::vector<uint32_t> selectedPart; //< List of Particles selected by the user
+	std::vector<uint32_t> selectedPart; //< List of the IDs of the Particles selected by the user. @see Particle_simulator::get_id
 	std::vector<float> selectedPartInitPos; //< List of selected Particles' position before moving them
 
 	bool rightMousePressed = false;
 	bool leftMousePressed = false;
 	bool ctrlPressed = false;
+	bool streaming_counters = false; //< Whether the simulator was ordered to write its counters in a file.
 	sf::Vector2u initialRightMousePos; //< relative position to screen
 	sf::Vector2f initialLeftMousePos; //< world position
 	sf::Vector2f initialCenterPos; //< relative to world position. Used for worldview moving.
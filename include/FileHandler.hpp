@@ -5,6 +5,9 @@
 #include <map>
 #include <array>
 #include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
 
 class FullFileName {
 public :
@@ -40,6 +43,7 @@ public :
 	
 protected :
 	std::fstream file;
+	std::string file_path; //< Path of the opened file, with its folder and extension.
 	uint64_t written = 0;
 	uint64_t max_writable_size; //< Exist so the object automatically stops writing and filling the computer.
 
@@ -67,6 +71,11 @@ public :
 	*/
 	bool prepareForLoading(FullFileName fileName);
 	bool isFileBinary() {return file_in_binary;};
+	/**
+	* @return The folder every file name is relative to, e.g. "saves/".
+	*/
+	static std::string getSaveFolder();
+	inline const std::string& getFilePath() {return file_path;};
 
 	/**
 	* @brief Writes obj in file.
@@ -237,6 +246,21 @@ public :
 	*/
 	template<typename T> inline bool load_from_map(parse_map& map, std::string name, T& obj) { return load_from_map(map, name, &obj, 1); };
 
+	/**
+	* @brief Changes the values of some variables of a file written in full text, keeping the rest of the file (like comments) as it is.
+	* @details Only section 0 is changed. The line of each variable is rewritten as name=value, followed by its comment if it had one.
+	* Variables not found in section 0 are added at its end.
+	* @param fileName Path+Name+extension of the file to change.
+	* @param values Pairs of variable name and value, the value already written as text (e.g. "4, 4" for an array).
+	* @return true if the file could be read and written, false otherwise.
+	*/
+	bool replace_in_string(FullFileName fileName, const std::vector<std::pair<std::string, std::string>>& values);
+	/**
+	* @brief Overwrites byte_size_obj bytes of a file written in binary with obj, from offset bytes after the byte telling the file is binary. The rest of the file is kept.
+	* @return true if writing was successful, false otherwise.
+	*/
+	bool overwrite(FullFileName fileName, size_t offset, void* obj, size_t byte_size_obj);
+
 	/**
 	* @brief Closes the file (if opened).
 	*/
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Writes images in the background, in saves/Frames, so making a video doesn't slow down what draws them.
+* @details As an image sequence, each image is a binary PPM file name-<frame>.ppm, the frame number on 6 digits (e.g. for ffmpeg -i name-%06d.ppm).
+* As a raw stream, the RGBA images follow each other in name.rgba, without header (e.g. for ffmpeg -f rawvideo -pix_fmt rgba -s <width>x<height> -i name.rgba).
+* The images are copied into one of 2 buffers : a writer thread writes one while the other is filled.
+* If the previous image is still being written when the next one is submitted, submit waits for it.
+*/
+class FrameWriter {
+public :
+	enum class format_t : uint8_t {PPM = 0, RAW};
+
+private :
+	std::string name;
+	uint32_t width, height;
+	format_t format;
+	std::ofstream stream; //< The raw stream.
+	std::vector<uint8_t> images[2]; //< The image being filled and the image being written.
+	uint8_t filling = 0;
+	uint32_t n_frames = 0; //< Images submitted so far.
+	bool failed = false; //< Whether an image couldn't be written. Protected by mutex.
+
+	std::mutex mutex;
+	std::condition_variable full; //< Wakes the writer up.
+	std::condition_variable written; //< Wakes submit up when it waits for the writer.
+	bool writing = false; //< Whether images[1-filling] is given to the writer. Protected by mutex.
+	bool running = true; //< Protected by mutex.
+	std::thread writer;
+	double stall_s = 0; //< Time submit waited for the writer.
+
+	/**
+	* @brief Loop of the writer thread. It writes each image submitted, until the FrameWriter is deleted.
+	*/
+	void write_frames();
+	/**
+	* @brief Writes the RGBA image as frame number frame.
+	*/
+	bool write(const std::vector<uint8_t>& image, uint32_t frame);
+
+public :
+	/**
+	* @brief Constructor. Opens the raw stream if needed and starts the writer thread.
+	* @param name_ Name of the images, or of the raw stream.
+	*/
+	FrameWriter(std::string name_, uint32_t width_, uint32_t height_, format_t format_);
+	/**
+	* @brief Writes the last image submitted, then stops the writer thread.
+	*/
+	~FrameWriter();
+
+	FrameWriter(const FrameWriter&) = delete;
+	FrameWriter& operator=(const FrameWriter&) = delete;
+
+	/**
+	* @brief Copies the RGBA image, of width*height pixels, and gives it to the writer once it wrote the previous one.
+	* @return false if an image couldn't be written so far.
+	*/
+	bool submit(const uint8_t* rgba);
+	inline uint32_t getFrameCount() const {return n_frames;};
+	/**
+	* @brief Prints how many images were written, where, and how long submit waited for the disk.
+	*/
+	void print_stats();
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+* A whole file mapped in memory, so it is read straight from the page cache without copying it through a stream.
+* @details The mapping is private : its bytes can be changed, but the changes only exist in this process and are never written to the file.
+* On systems without mmap (e.g. Windows) open fails, so the file has to be read another way.
+*/
+class MappedFile {
+private :
+	uint8_t* bytes = nullptr;
+	size_t n_bytes = 0;
+	bool sequential = false; //< Whether the kernel was told the file is read in order.
+
+public :
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	* @brief Maps the whole file path. A file already mapped is unmapped first.
+	* @return Whether the file could be mapped. Empty files can't.
+	*/
+	bool open(const std::string& path);
+	void close();
+	inline bool is_open() const {return bytes;};
+
+	inline uint8_t* data() {return bytes;};
+	inline const uint8_t* data() const {return bytes;};
+	inline size_t size() const {return n_bytes;};
+
+	/**
+	* @brief Tells the kernel whether the file is read in order, so it reads ahead more and drops the pages already read sooner, or is read anywhere.
+	*/
+	void advise_sequential(bool sequential_);
+	/**
+	* @brief Asks the kernel to start reading the given bytes from the disk, so they are in memory when they are needed.
+	*/
+	void will_need(size_t offset, size_t length);
+};
@@ -1,13 +1,32 @@
 #pragma once
 
+#include "Autotuner.hpp"
+#include "Checkpointer.hpp"
+#include "ColumnExporter.hpp"
 #include "Consometer.hpp"
 #include "SaveLoader.hpp"
 #include "Particle.hpp"
+#include "PerfCounters.hpp"
+#include "PosReader.hpp"
+#include "PosRecorder.hpp"
+#include "Profiler.hpp"
+#include "ReplayInterpolator.hpp"
+#include "RingQueue.hpp"
+#include "StepCounters.hpp"
 #include "World.hpp"
 #include "ThreadHandler.hpp"
+#include "Topology.hpp"
+#include "TripleBuffer.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #define NULLPART (uint32_t)-1
@@ -15,7 +34,7 @@
 
 class PSparam {
 public :
-	uint32_t n_threads = 6; //< Number of threads running the simulation.
+	uint32_t n_threads = 6; //< Number of threads running the simulation. 0 means one per physical core.
 	uint32_t max_part = 24000; //< Maximum number of Particles that can exist at a time.
 	uint32_t n_part_start; //< Number of Particles that will be spawned at the start of the simulation.
 	uint32_t pps; //< Number of Particles to create per second if the number of active particle is less than max_part.
@@ -61,12 +80,80 @@ public :
 	uint8_t ps_collision_fun; //< Particle to Segment  collision function. @see Particle_simulator::ps_collision_t .
 	uint8_t world_border_fun; //< Particle to world border collision function. @see Particle_simulator::world_border_t .
 
+	// Multi-threading
+	uint8_t decomposition; //< How the work is shared between the simulation threads. @see Particle_simulator::decomposition_t .
+	uint16_t rebalance_period; //< Number of simulation steps between 2 rebalancing of the bands heights when decomposition=STRIPES. 0 means the bands are only balanced once.
+	uint8_t pinning; //< How the simulation threads are pinned to CPUs. @see Topology::pinning_t .
+	bool elastic_threads; //< Whether the number of working simulation threads is chosen at runtime from the measured step durations. Otherwise all n_threads work.
+
+	float quickstep_sps; //< Number of simulation steps per second during a quickstep. 0 or less means as fast as possible.
+
+	// Strategies that change the speed but not the physics. They can be chosen by the autotuner, @see Particle_simulator::autotune
+	uint8_t chunks_per_thread; //< Number of parts the share of Particles of a thread is cut in, so threads that finish early take parts from the others. Not used when decomposition=STRIPES.
+	uint8_t seg_storage; //< Where the Cells of the Segments are stored. @see Particle_simulator::seg_storage_t .
+	uint8_t zone_comparison; //< Whether the Particles look for Zones or the Zones look for Particles in their Cells. @see Particle_simulator::zone_comparison_t .
+
 	static PSparam Default;
 
 	bool operator==(const PSparam& other) {return std::memcmp(this, &other, sizeof(PSparam)) == 0;};
 };
 
 
+/**
+* An order given to the simulator by another thread, like the UI's. The meaning of the members depends on type.
+* @see Particle_simulator::order
+*/
+struct SimCommand {
+	enum class type_t : uint8_t {
+		FORCE = 0, //< Starts applying the user force `force` around point, within a radius value.
+		POINT, //< Moves the point around which the user force or the deletion is applied.
+		RELEASE, //< Stops the user force and the deletion.
+		DELETION, //< Deletes the Particles within a radius value around point at each step, until RELEASE.
+		DELETE_PARTICLE, //< Deletes the Particle of ID part.
+		MOVE_PARTICLE, //< Moves the Particle of ID part to point and sets its speed, except for the components of speed that are NaN.
+		SCALE_DT, //< Multiplies params.dt by value.
+		RESET, //< Sets the Particles, or the position loading, back to their initial state.
+		THREADS, //< Forces the number of working simulation threads to value, or lets the simulator choose it if 0.
+		COUNTERS, //< Starts writing the StepCounters of each step in Particle_simulator::COUNTERS_FILE if value isn't 0, stops otherwise.
+		AUTOTUNE, //< Starts autotuning, with the world's grid if value isn't 0, or stops it if already tuning. @see Particle_simulator::autotune
+		SEEK, //< Moves the position loading value seconds of simulation forward, or backward if negative. Applied even while paused.
+		REPLAY_STRIDE, //< Multiplies by value the number of frames the position loading moves by at each load. A negative value reverses the playback.
+	};
+	type_t type;
+	uint8_t force = 0; //< @see Particle_simulator::userForce
+	uint32_t part = NULLPART; //< ID of a Particle, as its index may change before the command is applied. @see Particle_simulator::get_id
+	float point[2] = {0, 0};
+	float speed[2] = {0, 0};
+	float value = 0;
+
+	static inline SimCommand Force(uint8_t force_, float x, float y, float range) {SimCommand c{type_t::FORCE, force_}; c.point[0] = x; c.point[1] = y; c.value = range; return c;};
+	static inline SimCommand Point(float x, float y) {SimCommand c{type_t::POINT}; c.point[0] = x; c.point[1] = y; return c;};
+	static inline SimCommand Deletion(float x, float y, float range) {SimCommand c{type_t::DELETION}; c.point[0] = x; c.point[1] = y; c.value = range; return c;};
+	static inline SimCommand Move(uint32_t part_, float x, float y, float vx, float vy) {SimCommand c{type_t::MOVE_PARTICLE, 0, part_, {x, y}, {vx, vy}}; return c;};
+	static inline SimCommand Of(type_t type_, float value_ = 0, uint32_t part_ = NULLPART) {SimCommand c{type_, 0, part_}; c.value = value_; return c;};
+};
+
+
+/**
+* Everything needed to restart a simulation exactly where it was, written in the checkpoints.
+* @see Particle_simulator::get_state
+* @see SaveLoader::saveCheckpoint
+*/
+struct SimState {
+	WorldParam world_params;
+	std::vector<float> segments; //< 4 coordinates per Segment : point A, then point B.
+	std::vector<float> zones; //< 4 coordinates per Zone : top left, then size.
+	std::vector<int8_t> zone_funs; //< Function of each Zone.
+	PSparam params;
+	double time[2] = {0, 0};
+	uint64_t steps = 0; //< @see Particle_simulator::total_steps
+	uint64_t seed = 0; //< @see Particle_simulator::rng_seed
+	std::vector<Particle> particles; //< The active Particles.
+	std::vector<uint32_t> ids; //< ID of each active Particle. Empty in checkpoints written before Particles had IDs.
+	std::vector<uint32_t> free_ids; //< IDs not in use, in the order they will be given. @see Particle_simulator::free_ids
+};
+
+
 class Particle_simulator {
 private :
 	// particles and segments
@@ -75,23 +162,209 @@ private :
 	uint32_t nb_active_part; //< Number of Particles being simulated and displayed
 	std::vector<Particle> particle_array;
 	uint32_t used_n_threads = 1; //< Number of threads used for simulation. Copied-out of parameters to keep it private.
+	Topology topology;
+
+	// Particle IDs
+	std::vector<uint32_t> part_id; //< ID of each Particle of particle_array. It follows the Particle when it is moved in the array, until the Particle is deleted.
+	std::vector<uint32_t> id_index; //< Index in particle_array of the Particle of each ID, NULLPART if the ID isn't in use.
+	std::vector<uint32_t> free_ids; //< Ring of the nb_max_part - nb_active_part IDs not in use, from free_head. The ID freed the longest ago is given first, so the ID of a deleted Particle comes back as late as possible.
+	uint32_t free_head = 0;
+	/**
+	* @brief Gives the IDs 0, 1, 2... to the active Particles in order. The other IDs are free, in order.
+	*/
+	void initialize_ids();
+
+	// Random draws
+	uint64_t rng_seed; //< Seed of the random draws. Taken from rand() when the simulator is created. @see random
+	uint64_t total_steps = 0; //< Number of steps simulated since the Particles were initialized. The random draws depend on it.
+	/**
+	* @brief Gives a random number in [0, 1[ by hashing rng_seed, total_steps, key and draw.
+	* @details Unlike rand() there is no state changed by each draw. So a Particle gets the same numbers whatever thread draws them and in what order,
+	* and a simulation restarted from a checkpoint draws the same numbers as the one that wrote it.
+	* @param key What the number is drawn for, e.g. the index of a Particle.
+	* @param draw Which of the numbers drawn for key during this step.
+	*/
+	float random(uint64_t key, uint32_t draw) const;
+
+	// Elastic number of threads
+	std::atomic_uint32_t active_n_threads{1}; //< Number of simulation threads currently working, the others are parked. Only changed between 2 steps.
+	std::chrono::steady_clock::time_point last_step_start;
+	bool step_interrupted = true; //< Whether the current step was paused, so its duration isn't measured.
+	uint64_t window_time = 0; //< Sum of the durations of the steps measured with the current number of threads (ns).
+	uint16_t window_steps = 0; //< Number of steps summed in window_time.
+	std::vector<float> step_cost; //< Average step duration (ns) last measured for each number of threads.
+	std::vector<uint32_t> cost_part; //< nb_active_part when step_cost was measured.
+	std::vector<uint32_t> cost_age; //< Number of measures done since step_cost was measured. UINT32_MAX if never measured.
+
+	// Autotuning
+	/**
+	* A size of the Cells of the world's grid and the collision Check Size going with it.
+	*/
+	struct GridCandidate {
+		float cellSize[2];
+		uint8_t cs;
+	};
+	Autotuner autotuner;
+	std::vector<GridCandidate> grid_candidates; //< Grids tried by the autotuner. The first one is the grid used before tuning.
+	bool autotune_order = false; //< Whether an order to start or stop autotuning waits for the end of the step. @see SimCommand::type_t::AUTOTUNE
+	bool autotune_grid = false; //< Whether the ordered autotuning includes the world's grid.
+
+	// Spatial decomposition
+	/**
+	* A Particle leaving the band of a thread.
+	*/
+	struct Migrant {
+		uint32_t part; //< Index of the Particle in particle_array.
+		uint8_t band; //< Band the Particle is going to.
+	};
+	bool stripes = false; //< Whether each simulation thread owns a band of rows of the world's grid rather than a share of the Particle indices. Copied-out of parameters as it can't change while simulating.
+	bool rebalance_due = false; //< Whether the bands heights will be rebalanced at this simulation step. Only changed between 2 steps.
+	uint16_t steps_since_rebalance = 0;
+	std::vector<Particle> particle_buffer; //< Second Particle array in which the Particles are reordered by band before swapping with particle_array.
+	std::vector<uint32_t> id_buffer; //< part_id of particle_buffer.
+	std::vector<uint16_t> band_rows; //< Rows of the world's grid owned by each thread : [band_rows[th], band_rows[th+1][ .
+	std::vector<uint32_t> band_parts; //< Particles owned by each thread : [band_parts[th], band_parts[th+1][ .
+	std::vector<uint32_t> band_parts_next; //< band_parts after the Particles have migrated.
+	std::vector<uint8_t> row_band; //< Band owning each row of the world's grid.
+	std::vector<std::vector<Migrant>> migrants; //< For each thread, the Particles of its band that will be in another band at the next step. Sorted by index.
+	std::vector<uint32_t> migration_count; //< Number of Particles going from a band to another : [from*active_n_threads + to].
+	std::vector<std::vector<uint32_t>> row_count; //< For each thread, the number of its Particles in each row of the world's grid. Only filled when rebalancing.
 
 	// Perfomance check
 	Consometre conso; //< Used to measure and display performances of the simulation
 	Consometre conso2; //< Used to measure and display performances of the simulation
+public :
+	Profiler profiler; //< Records the work of each simulation thread, to export it as a trace. Disabled by default.
+	/**
+	* Parts of a simulation step, timed separately by the thread 0. SYNC is the time spent between steps, waiting for the other threads, pausing, creating and deleting Particles.
+	*/
+	enum class phase_t : uint8_t {SYNC = 0, MIGRATION, GRID, FORCES, PP_COLLISION, PS_COLLISION, BORDERS, ZONES, UPDATE, EMPTYING, NB_PHASES};
+	static const char* phase_names[(uint8_t)phase_t::NB_PHASES];
+private :
+	Consometre phase_conso[(uint8_t)phase_t::NB_PHASES]; //< Total time spent by the thread 0 in each phase.
+	phase_t current_phase = phase_t::SYNC;
+	uint64_t n_steps = 0; //< Number of steps started since the simulation threads were started.
+	uint64_t particle_steps = 0; //< Sum of the number of Particles simulated at each step.
+	uint64_t step_limit = UINT64_MAX; //< Number of steps after which the simulation threads stop by themselves.
+
+	std::vector<StepCounters> thread_counters; //< Counters of each thread for the last step, handed over before the barrier between 2 steps.
+	std::vector<std::chrono::steady_clock::time_point> step_arrival; //< When each thread reached the barrier between 2 steps.
+	StepCounters step_counters[2]; //< Sums of the counters of the threads over the last steps. The last one is step_counters[last_counters].
+	std::atomic<uint8_t> last_counters{0};
+	uint64_t paused_ns = 0; //< Time spent paused during the step. It isn't counted as idle.
+	std::ofstream counters_stream; //< Where the counters of each step are written, when open.
+
+	/**
+	* Hardware counters of a simulation thread, and what they counted in each phase.
+	*/
+	struct HwThread {
+		PerfCounters counters;
+		bool opened = false; //< Whether counters could be opened. They stay open after the thread ends, to be read.
+		PerfCounters::Sample last; //< Reading at the start of the current phase.
+		phase_t phase = phase_t::SYNC;
+		PerfCounters::Sample phases[(uint8_t)phase_t::NB_PHASES];
+	};
+	bool hw_counters = false; //< Whether each thread reads its hardware counters at each phase. @see use_hw_counters
+	std::vector<std::unique_ptr<HwThread>> hw_threads;
+	/**
+	* @brief Adds what the hardware counters of the thread th_id counted since its last phase change to that phase, then starts counting for phase.
+	*/
+	void count_hw_phase(uint8_t th_id, phase_t phase);
+
+	/**
+	* @brief Gives the counters of the thread th_id for the step that just ended to the simulator, then resets them.
+	*/
+	void hand_over_counters(uint8_t th_id, std::chrono::steady_clock::time_point step_start);
+	/**
+	* @brief Sums the counters handed over by each thread, then writes them in counters_stream if open. Called by the last thread reaching the barrier between 2 steps.
+	*/
+	void merge_counters();
+
+	/**
+	* @brief Ends the phase the thread 0 was in and starts timing phase. For the other threads, only the profiler is told.
+	*/
+	inline void mark_phase(uint8_t th_id, phase_t phase) {
+		profiler.switch_phase(phase_names[(uint8_t)phase]);
+		if (hw_counters) count_hw_phase(th_id, phase);
+		if (th_id) return;
+		phase_conso[(uint8_t)current_phase].End();
+		current_phase = phase;
+		phase_conso[(uint8_t)phase].Start();
+	};
 
 	// Simulation multi-threading
 	ThreadHandler threadHandler;
 	SaveLoader* partLoader = nullptr;
+	PosRecorder* recorder = nullptr; //< Writes the Particle positions in partLoader in the background when saving them.
+	PosReader* reader = nullptr; //< Reads the Particle positions from partLoader in the background when loading them, unless they are read in place.
+	Checkpointer* checkpointer = nullptr; //< Writes checkpoints in the background, if SLI asks for them.
+	ColumnExporter* exporter = nullptr; //< Exports the Particles as columns in the background, if SLI asks for it.
+	static constexpr uint16_t DEFAULT_EXPORT_CHUNK = 64; //< Frames per chunk of exported columns when SLI doesn't say.
+	ReplayInterpolator* interpolator = nullptr; //< Makes the frames displayed between the loaded ones, if SLI asks for some.
+
+	/**
+	* A copy of the Particles at the end of a step, for the display.
+	*/
+	struct Snapshot {
+		std::vector<Particle> particles;
+		std::vector<uint32_t> ids;
+		uint32_t n_parts = 0;
+		double time = 0;
+	};
+	TripleBuffer<Snapshot> snapshots; //< Hands the Particles from the simulation threads to the display, so it always shows the latest complete step and the threads never wait for it.
+	std::atomic<bool> snapshot_wanted{false}; //< Whether the display wants snapshots. Set by the display thread.
+	bool snapshot_filling = false; //< Whether update_pos copies the Particles in the back snapshot during this step. Only changed between 2 steps.
+	bool snapshot_read = false; //< Whether the display acquired a snapshot yet. Only used by the display thread.
+	/**
+	* @brief Makes the back snapshot big enough for every Particle. Called between 2 steps.
+	*/
+	void prepare_snapshot();
+	/**
+	* @brief Copies every active Particle in the back snapshot and publishes it. Called between 2 steps, e.g. while paused.
+	*/
+	void snapshot_all();
+	/**
+	* @brief Gives the state of the simulation to checkpointer, if it isn't still writing the previous one. Called between 2 steps.
+	*/
+	void take_checkpoint();
 
 	SLinfoPos SLI;
 	bool finished_loading = false;
+	int16_t replay_stride = 1; //< Number of frames load_next_positions moves by. Negative when playing backwards.
+	uint32_t replay_target = NULLPART; //< Frame load_next_positions loads next even if paused, after a SEEK. NULLPART if there is none.
+	Particle* replay_view = nullptr; //< The loaded frame, in the loading file mapped in memory or in reader. It is shown instead of particle_array. @see SaveLoader::mapPos
+	const uint32_t* replay_ids = nullptr; //< IDs of the Particles of replay_view, nullptr if the loading file has none.
+	uint32_t replay_frame = 0; //< Index of the loaded frame in the loading file.
+	static constexpr int16_t MAX_REPLAY_STRIDE = 1024;
+	ReplayInterpolator::Frame replay_from; //< When interpolating, the loaded frame the displayed one starts from.
+	ReplayInterpolator::Frame replay_to; //< When interpolating, the loaded frame the displayed one goes to. Its particles are nullptr if replay_from is the last one.
+	uint16_t replay_sub = 0; //< When interpolating, index of the displayed frame from replay_from, out of SLI.replay_substeps.
+
+	enum class fetch_t : uint8_t {READY, NOT_READY, END};
+	/**
+	* @brief Loads the next frame of the loading file, or the frame replay_target if seeking.
+	* @param wait Whether to wait for the frame to be read in the background. Otherwise NOT_READY is returned if it isn't yet.
+	* @param frame Set to the frame loaded, if READY is returned.
+	* @return END if there is no more frame to load.
+	*/
+	fetch_t fetch_frame(bool seeking, bool wait, ReplayInterpolator::Frame& frame);
+	/**
+	* @brief Displays frame instead of particle_array.
+	*/
+	void show_frame(const ReplayInterpolator::Frame& frame);
+	/**
+	* @brief Displays the next frame interpolated between replay_from and replay_to, loading the next frame of the file when the interval is done.
+	*/
+	void load_interpolated(bool seeking);
 
 	// Collision function enum & pointers
 public :
 	enum class pp_collision_t : uint8_t{BASE = 0, TLEV, PHYACC, COHERENT};
 	enum class ps_collision_t : uint8_t{BASE = 0, REBOUND};
 	enum class world_border_t : uint8_t{BASE = 0, REBOUND};
+	enum class decomposition_t : uint8_t{INDEX = 0, STRIPES};
+	enum class seg_storage_t : uint8_t{AUTO = 0, GRID, SEGMENTS};
+	enum class zone_comparison_t : uint8_t{AUTO = 0, PARTICLES, ZONES};
 private :
 	using pp_collision_sign = void (Particle_simulator::*)(uint32_t p1, uint32_t p2, float dist, float vec[2]);
 	void (Particle_simulator::*pp_collision_ptr)(uint32_t p_start, uint32_t p_end) = nullptr;
@@ -99,30 +372,146 @@ private :
 	void (Particle_simulator::*world_borders_ptr)(uint32_t p_start, uint32_t p_end) = nullptr;
 
 public :
-	inline const Particle* get_particle_data() {return particle_array.data();};
+	/**
+	* @return The Particles to display : particle_array, or when the loading file is mapped in memory, the frame loaded in it.
+	*/
+	inline const Particle* get_particle_data() {return replay_view ? replay_view : particle_array.data();};
 	inline uint32_t get_max_part() {return particle_array.capacity();};
 	inline uint32_t get_active_part() {return nb_active_part;};
-	inline Particle& operator[](uint32_t index) {return particle_array[index];};
+	inline Particle& operator[](uint32_t index) {return replay_view ? replay_view[index] : particle_array[index];};
+
+	/**
+	* The Particles to display, given by get_display_frame.
+	*/
+	struct DisplayFrame {
+		const Particle* particles;
+		const uint32_t* ids; //< ID of each Particle. nullptr if the loading file has none.
+		uint32_t n_parts;
+		double time; //< Simulated time of the Particles. NAN before the first snapshot, as the Particles are being simulated.
+	};
+	/**
+	* @brief Tells whether the display wants the Particles copied at the end of each step. Nothing is copied while it doesn't, e.g. when displaying is disabled.
+	*/
+	inline void want_snapshots(bool want) {snapshot_wanted.store(want, std::memory_order_relaxed);};
+	/**
+	* @return The Particles to display. When simulating, a copy of the latest step completely simulated, which stays unchanged until the next call.
+	* Before the first copy, or when loading positions, the same Particles as get_particle_data.
+	* Only call this from the display thread.
+	*/
+	DisplayFrame get_display_frame();
+	/**
+	* @return The ID of the Particle at index. Unlike its index, it doesn't change when other Particles are deleted or moved in the array.
+	* When loading positions, the ID saved in the loading file, or index if the file has none.
+	*/
+	inline uint32_t get_id(uint32_t index) {
+		if (SLI.isLoadPos()) return replay_ids ? replay_ids[index] : index;
+		return part_id[index];
+	};
+	/**
+	* @return The index of the active Particle of ID id, or NULLPART if there is none.
+	* When loading positions, it is searched among the Particles of the frame loaded, so it takes longer.
+	*/
+	uint32_t get_index(uint32_t id);
 	inline double get_time() {return time[0];};
+	inline uint32_t get_active_threads() {return active_n_threads;};
+	inline uint32_t get_max_threads() {return used_n_threads;};
+	inline uint64_t get_step_count() {return n_steps;};
+	inline uint64_t get_particle_steps() {return particle_steps;};
+	/**
+	* @return The number of steps simulated since the Particles were initialized, including the steps of the simulation a checkpoint was restored from.
+	*/
+	inline uint64_t get_total_steps() {return total_steps;};
+	/**
+	* @return A hash (FNV-1a) of the bits of the positions and speeds of the active Particles.
+	* Two simulations have the same checksum only if they computed exactly the same floats, so it tells whether a change of the code changed the physics.
+	* @warning Only call this while the simulation threads aren't running.
+	*/
+	uint64_t checksum();
+	/**
+	* @return The time spent by the thread 0 in phase since the simulation threads were started (ns).
+	*/
+	inline long get_phase_time(phase_t phase) {return phase_conso[(uint8_t)phase].count();};
+	/**
+	* @return The counters of the last step, summed over the threads.
+	* @details This can be called while the simulation is running. The copy might then mix 2 steps if the copy is slower than 2 simulation steps.
+	*/
+	inline StepCounters get_step_counters() {return step_counters[last_counters.load(std::memory_order_acquire)];};
+	static constexpr const char* COUNTERS_FILE = "saves/counters.csv";
+	/**
+	* @brief Makes each simulation thread read its hardware counters (@see PerfCounters) at each phase. It costs a system call per phase and thread.
+	* @warning Only call this while the simulation threads aren't running.
+	*/
+	inline void use_hw_counters(bool use) {hw_counters = use;};
+	/**
+	* @return Whether at least one simulation thread could open its hardware counters since they were last started.
+	*/
+	bool hw_counters_open();
+	/**
+	* @return What the hardware counters counted in phase, summed over the threads, since the simulation threads were started.
+	* @warning Only call this while the simulation threads aren't running.
+	*/
+	PerfCounters::Sample get_phase_hw(phase_t phase);
 
 	World& world;
 
 	// Orders to give to the simulator
 	bool simulate = false;
+private :
 	bool paused = false;
 	bool step = false;
 	bool quickstep = false;
+	std::mutex order_mutex; //< Locked while changing paused, step or quickstep.
+	std::condition_variable order_condition; //< Notified when paused, step, quickstep or simulate changes, so a paused simulation thread can wake up.
+	std::chrono::steady_clock::time_point last_quickstep; //< When the last step of a quickstep was done.
+	RingQueue<SimCommand> commands{1024}; //< Orders waiting to be applied by the simulator. @see order
+	bool dropping_orders = false; //< Whether the last order couldn't be given, so it is only told once.
+	bool grid_filled = false; //< Whether the world's grid is filled with the Particles. Only changed between 2 steps.
+public :
+	inline bool isPaused() {return paused;};
+	/**
+	* @brief Pauses or resumes the simulation. Resuming is immediate.
+	*/
+	void setPaused(bool pause);
+	inline void togglePause() {setPaused(!paused);};
+	/**
+	* @brief Makes a paused simulation do a single step.
+	*/
+	void orderStep();
+	/**
+	* @brief Starts or stops stepping the simulation at params.quickstep_sps steps per second, whether it is paused or not.
+	*/
+	void setQuickstep(bool quick);
+	/**
+	* @brief Gives an order to the simulator. Meant to be called by a single other thread, like the UI's. Never waits for the simulation.
+	* @details The orders are applied in the order they are given, between 2 simulation steps or right away if the simulation is paused.
+	* So the simulation threads never see a change in the middle of a step.
+	* @return false if too many orders are already waiting, in which case command is dropped.
+	*/
+	bool order(const SimCommand& command);
+	inline uint32_t get_forced_threads() {return forced_n_threads;};
+	/**
+	* @brief Orders the simulator to find its fastest strategies while it runs, or to stop if it is already doing so. @see Autotuner
+	* @details The strategies are params.chunks_per_thread, params.seg_storage and params.zone_comparison. With with_grid, the size of the world's Cells and cs are tuned too,
+	* only with values that still reach every Particle within collision distance and keep the Zones in place.
+	* A candidate is rejected if a Cell overflowed during its trial, as some contacts would then be lost. The number of working threads isn't changed while tuning.
+	* Once finished, the fastest values stay in params and in the world. @see SaveLoader::saveTuning to write them in their files.
+	* @param with_grid Whether to tune the grid. It is reallocated between steps, so nothing else may read it meanwhile (like a Renderer).
+	* @return false if the order couldn't be given.
+	*/
+	inline bool autotune(bool with_grid) {return order(SimCommand::Of(SimCommand::type_t::AUTOTUNE, with_grid));};
+	inline const Autotuner& get_autotuner() {return autotuner;};
 
 	// Simulator parameters
 	void setParameters(PSparam& parameters);
 	PSparam params; //< Parameters of the simulation. They can be changed on the fly without causing any problem.
 
-	// User forces
+	// User forces. Only changed by the simulator when applying orders.
 	enum class userForce {None = 0, Translation, Rotation, Vortex};
 	userForce appliedForce = userForce::None;
-	float user_point[2]; //< Used so the user can point a place in the world and interact with the simulation.
+	float user_point[2] = {0, 0}; //< Used so the user can point a place in the world and interact with the simulation.
 	bool deletion_order = false; //< If delete_range deletion should be called.
-	bool reinitialize_order = false; //< If initialize_particles should be called.
+private :
+	uint32_t forced_n_threads = 0; //< If not 0, the number of working simulation threads is forced to it rather than chosen at runtime.
 
 public :
 	/**
@@ -142,17 +531,56 @@ public :
 	*/
 	void initialize_particles();
 
+	/**
+	* @brief Copies the state of the simulation, its world and parameters in state, so it can be restarted from it.
+	* @details Must be called between 2 steps, e.g. while the simulation threads are stopped.
+	* @see restore_state
+	*/
+	void get_state(SimState& state);
+	/**
+	* @brief Sets the Particles, time and random draws back to what they were in state, so the simulation goes on as the one state was taken from.
+	* @details The world and parameters aren't changed : the simulator should have been created with the ones of state (@see SaveLoader::loadCheckpointParam).
+	* Must be called while the simulation threads are stopped.
+	*/
+	void restore_state(const SimState& state);
+
 	/**
 	* @brief Starts the 
 	* @see Particle_simulator::simulation_thread
 	*/
 	void start_simulation_threads();
+
+	private :
+		/**
+		* @brief Makes the memory of array (and of the world's grid if with_grid) be allocated on the NUMA nodes of the simulation threads.
+		* @details The pages are given back to the OS, then temporary threads pinned like the simulation threads write their share of it first.
+		* The array's share of each thread is an equal part of the Particles, and of the grid's rows for the grid.
+		* @warning The content of array and of the grid is set to 0. Only call this before the Particles are initialized and the grid filled.
+		*/
+		void first_touch(std::vector<Particle>& array, bool with_grid);
+	public :
 	
 	/**
 	* @brief Sends a signal for each simulation thread to stop and waits for each one to return.
 	* @details After the signal, each thread will still finish it simulation step. This function won't return before that. 
 	*/
 	void stop_simulation_threads();
+	/**
+	* @brief Makes the simulation threads stop by themselves once they have done steps simulation steps since they started. simulate is then false.
+	* @details Must be called before start_simulation_threads. stop_simulation_threads must still be called to join the threads.
+	*/
+	inline void stop_after(uint64_t steps) {step_limit = steps;};
+	/**
+	* @brief Prints how long each phase of the simulation steps took on average, as timed by the thread 0.
+	* With use_hw_counters, also prints what the hardware counters of all threads counted in each phase per step.
+	*/
+	void print_phase_timings();
+	/**
+	* @brief Writes the counters of each step in file_name as CSV, with the idle time of each thread. Stops writing them if file_name is empty.
+	* @warning Only call this while the simulation threads aren't running. Otherwise order a SimCommand::type_t::COUNTERS.
+	* @return Whether the file could be opened.
+	*/
+	bool stream_counters(const std::string& file_name);
 
 	/**
 	* @brief Contains the simulation loop. This function is meant to be given to a thread.
@@ -173,13 +601,121 @@ public :
 		/**
 		* @brief Sleeps as long as the simulation is paused or not stepping.
 		* @details One of the simulating thread calls this while other wait for his synchronization. This exists because really only one thread needs to call this.
+		* The thread waits on order_condition so it doesn't use the CPU while paused and wakes up as soon as an order is given.
 		*/
 		void pause_wait();
 		/**
-		* @brief Deletes some particles if deletion_order. Creates Particles if possible. Deletes Particle of which position is NaN. 
+		* @brief Applies every order waiting in commands.
+		* @details If grid_filled, the world's grid is kept up to date as Particles are moved, deleted or reset. Only call this from a single thread at a time, between 2 steps.
+		* @param paused_ Whether the simulation is paused, in which case the deletion is applied once right away.
+		*/
+		void apply_commands(bool paused_);
+
+		/**
+		* @brief Applies the waiting orders. Deletes some particles if deletion_order. Creates Particles if possible. Deletes Particle of which position is NaN. 
 		* @details One of the simulating thread calls this while other wait for his synchronization. This exists because only one thread should call this at a time.
 		*/
 		void create_destroy_wait();
+
+		/**
+		* @brief Measures the step durations and changes the number of working threads if needed.
+		* @details The steps are measured by windows of a few dozen steps. After each window, the neighbouring numbers of threads are measured if they weren't recently,
+		* otherwise the fastest is kept. A parked thread sleeps until it is needed again. The number of threads is kept while autotuning.
+		* @param step_time Duration of the step that just ended (ns).
+		*/
+		void choose_n_threads(uint64_t step_time);
+		/**
+		* @return The number of threads to measure or use next.
+		* @see choose_n_threads
+		*/
+		uint32_t best_n_threads();
+		/**
+		* @brief Lists the settings the autotuner can try in the current scene, with their candidates, then starts it. @see autotune
+		*/
+		void start_autotune(bool with_grid);
+		/**
+		* @brief Resizes the Cells of the world's grid and sets cs. Only call this between 2 steps, while the grid is empty.
+		*/
+		void set_grid(const GridCandidate& grid);
+		/**
+		* @brief Stores the Segments' Cells as params.seg_storage says. If AUTO, chooses the storage from the number of Particles, @see World::chg_seg_store_sys
+		*/
+		void choose_seg_storage();
+		/**
+		* @return Whether the Zones are checked by going through the Particles (comparison_pz) rather than through the Zones' Cells (comparison_zp).
+		*/
+		inline bool particles_find_zones() {
+			if (params.zone_comparison == (uint8_t)zone_comparison_t::PARTICLES) return true;
+			if (params.zone_comparison == (uint8_t)zone_comparison_t::ZONES) return false;
+			return nb_active_part < world.getNZoneCoveredCells();
+		};
+		/**
+		* @return Whether the thread th_id should work, i.e. whether it shouldn't be parked.
+		*/
+		inline bool may_work(uint8_t th_id) {return th_id < active_n_threads || !simulate;};
+		/**
+		* @brief Waits for the other active threads, then the last one to arrive calls unique_work. The wait is recorded by the profiler as name.
+		*/
+		inline void barrier(const char* name, void (Particle_simulator::*unique_work)()) {
+			Profiler::Scope scope(profiler, name);
+			auto start = std::chrono::steady_clock::now();
+			threadHandler.synchronize_last(active_n_threads, 1, this, unique_work);
+			StepCounters::local().idle_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		};
+
+		/**
+		* @brief Calls array_worker on the Particles of the thread th_id.
+		* @details With decomposition=STRIPES the thread works on the Particles of its own band.
+		* Otherwise the Particles are shared between threads by ThreadHandler::load_repartition .
+		* The call is recorded by the profiler as name.
+		*/
+		template<typename T>
+		inline void particle_repartition(uint8_t th_id, const char* name, T* obj, void (T::*array_worker)(uint32_t, uint32_t), uint16_t fun_id, uint32_t work_subset);
+		/**
+		* @brief Mainly used when array_worker needs more than 2 arguments. Then use a bound function to pass array_worker.
+		* @see particle_repartition
+		*/
+		void particle_repartition(uint8_t th_id, const char* name, std::function<void(uint32_t, uint32_t)> array_worker, uint16_t fun_id, uint32_t work_subset);
+
+		/**
+		* @brief Allocates what the bands need for at most used_n_threads threads, then calls reset_bands. Called before starting the threads when decomposition=STRIPES.
+		* @details The Particles are not yet in their bands, which will be fixed by the first migration.
+		*/
+		void prepare_bands();
+		/**
+		* @brief Sets bands of equal heights for the active threads and shares the Particles equally between them. The bands will be rebalanced at the next step.
+		*/
+		void reset_bands();
+		/**
+		* @brief Counts the Particles of the band th_id in each row of the grid, for rebalance_bands.
+		*/
+		void count_rows(uint8_t th_id);
+		/**
+		* @brief Moves the bands' limits so each band has about the same number of Particles.
+		* @details A band is kept at least 2*cs+1 rows high (if the grid is high enough) so the halos of 2 bands never overlap.
+		*/
+		void rebalance_bands();
+		/**
+		* @brief Lists the Particles of the band th_id which next position is in another band.
+		*/
+		void find_migrants(uint8_t th_id);
+		/**
+		* @brief Calculates where each band starts in particle_array after migration.
+		*/
+		void prepare_migration();
+		/**
+		* @brief Copies the Particles staying in the band th_id, then the ones arriving, in particle_buffer.
+		*/
+		void migrate_particles(uint8_t th_id);
+		/**
+		* @brief Swaps particle_array and particle_buffer once every thread finished migrate_particles.
+		*/
+		void end_migration();
+		/**
+		* @brief Keeps the bands inside [0, nb_active_part[ after Particles have been created or deleted.
+		* @details Created Particles are given to the last band and will migrate at the next step.
+		*/
+		void clamp_bands();
 	public :
 
 	/**
@@ -208,6 +744,10 @@ public :
 	*/
 	template<pp_collision_sign collision_handler>
 	void collision_pp_grid(uint32_t p_start, uint32_t p_end);
+	/**
+	* @brief Calls the collision_pp_grid chosen with params.pp_collision_fun on the Particles in [p_start, p_end[.
+	*/
+	inline void collision_pp_chosen(uint32_t p_start, uint32_t p_end) {(this->*pp_collision_ptr)(p_start, p_end);};
 
 	/**
 	* @brief Applies collision between p1 and p2.
@@ -378,7 +918,11 @@ public :
 
 	bool isLoading() {return SLI.isLoadPos();};
 	/**
-	* @brief Loads the next Particle positions/speeds from the loading file. If @see reinitialize_order, then positions are set back to their initial states.
+	* @return The recorder saving Particle positions, or nullptr if they aren't saved.
+	*/
+	inline PosRecorder* get_recorder() {return recorder;};
+	/**
+	* @brief Applies the waiting orders then loads the next Particle positions/speeds from the loading file.
 	* @return True if there is no more positions to read from the loading file (i.e. if finished loading). False otherwise.
 	* @see bool isDonePosLoading()
 	*/
@@ -386,6 +930,25 @@ public :
 
 	inline bool isDonePosLoading() {return finished_loading;};
 	/**
+	* @return The number of frames loading moves by. Negative when playing backwards.
+	*/
+	inline int16_t get_replay_stride() {return replay_stride;};
+	/**
+	* @return The index of the last frame loaded.
+	*/
+	inline uint32_t get_replay_frame() {return replay_frame;};
+	/**
+	* @return The number of frames in the loading file.
+	*/
+	inline uint32_t get_replay_frame_count() {return partLoader ? partLoader->getPosFrameCount() : 0;};
+	/**
+	* @return The simulation time between the first and last frames of the loading file.
+	*/
+	inline double get_replay_duration() {
+		uint32_t n_frames = get_replay_frame_count();
+		return n_frames ? partLoader->getPosFrame(n_frames-1).time - partLoader->getPosFrame(0).time : 0;
+	};
+	/**
 	* @brief Resets position loading to the start.
 	*/
 	void resetPosLoading();
@@ -394,4 +957,12 @@ public :
 	@return true if Particle are being loaded without speed (due to compression), false otherwise.
 	*/
 	bool HasNoSpeed() { return SLI.isCompOutSpeed() && SLI.load_pos; };
-};
\ No newline at end of file
+};
+
+
+template<typename T>
+void Particle_simulator::particle_repartition(uint8_t th_id, const char* name, T* obj, void (T::*array_worker)(uint32_t, uint32_t), uint16_t fun_id, uint32_t work_subset) {
+	Profiler::Scope scope(profiler, name);
+	if (stripes) (obj->*array_worker)(band_parts[th_id], band_parts[th_id+1]);
+	else threadHandler.load_repartition(obj, array_worker, fun_id, nb_active_part, work_subset);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+* Hardware performance counters of the calling thread : cycles, instructions, L1 data cache misses, last level cache misses and branch misses.
+* They tell whether a part of the simulation is limited by computation, by memory latency or by bandwidth, which wall time alone doesn't.
+* @details On Linux they are read with perf_event_open, as a group so they all count during the same time. Elsewhere, or when the kernel doesn't allow it
+* (see /proc/sys/kernel/perf_event_paranoid), open fails and nothing is counted. Events the CPU (or a virtual machine) doesn't have are left out of the group.
+*/
+class PerfCounters {
+public :
+	enum class event_t : uint8_t {CYCLES = 0, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, NB_EVENTS};
+	static constexpr uint8_t NB_EVENTS = (uint8_t)event_t::NB_EVENTS;
+	static const char* event_names[NB_EVENTS];
+
+	/**
+	* Values of the counters, or differences between 2 readings.
+	*/
+	struct Sample {
+		uint64_t values[NB_EVENTS] = {};
+
+		inline uint64_t operator[](event_t event) const {return values[(uint8_t)event];};
+		inline Sample& operator+=(const Sample& other) {
+			for (uint8_t e=0; e<NB_EVENTS; e++) values[e] += other.values[e];
+			return *this;
+		};
+		inline Sample operator-(const Sample& other) const {
+			Sample diff;
+			for (uint8_t e=0; e<NB_EVENTS; e++) diff.values[e] = values[e] - other.values[e];
+			return diff;
+		};
+		inline float ipc() const {return (*this)[event_t::CYCLES] ? (float)(*this)[event_t::INSTRUCTIONS] / (*this)[event_t::CYCLES] : 0;};
+	};
+
+private :
+	int fds[NB_EVENTS]; //< File descriptor of each event, -1 if it isn't counted. fds[CYCLES] leads the group.
+	int8_t slots[NB_EVENTS]; //< Position of each event in a reading of the group, -1 if it isn't counted.
+	uint8_t n_open = 0;
+
+public :
+	PerfCounters();
+	~PerfCounters();
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	/**
+	* @brief Starts counting the events of the calling thread, in user space only. Only that thread should then call read.
+	* @param verbose Whether to tell why the counters couldn't be opened, or which events are missing.
+	* @return Whether the counters could be opened. At least the cycles are counted if true.
+	*/
+	bool open(bool verbose);
+	void close();
+	inline bool is_open() const {return n_open;};
+	inline bool counts(event_t event) const {return slots[(uint8_t)event] >= 0;};
+
+	/**
+	* @brief Reads the counters since open. Events that aren't counted read 0.
+	* @details If the kernel had to share the counters with other programs, the values are extrapolated to the whole time.
+	* @return false if the counters aren't open or couldn't be read, in which case sample isn't changed.
+	*/
+	bool read(Sample& sample);
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* Compresses a stream of quantized Particle frames (positions and maybe speeds as 16 bits integers) using their temporal coherence.
+* @details Each value is predicted from the same Particle in the previous frames, and only the difference is stored :
+* - order 0 : no prediction, used by keyframes so a stream can be read from them.
+* - order 1 : the value of the previous frame.
+* - order 2 : the previous value plus its last change, i.e. constant speed.
+* The order is chosen for each channel (x, y, speed x, speed y) of each frame, whichever gives the smallest differences.
+* The differences are zig-zag encoded into varints (1 byte when smaller than 64), then compressed with an order 0 rANS entropy coder.
+* Differences are computed modulo 2^16 on the quantized values, so the stream is lossless with respect to the quantization.
+* Particles that didn't exist in the previous frames (the number of Particles grew) are stored without prediction.
+*
+* With IDs, each frame also stores the ID of each of its Particles, predicted from the ID at the same index in the previous frame.
+* The previous frames are then put in the order of the new one before predicting, so a Particle is predicted from itself
+* even if the Particles were deleted or reordered since.
+*/
+class PosCodec {
+public :
+	static constexpr uint16_t KEYFRAME_INTERVAL = 256; //< Maximum number of frames between 2 keyframes.
+	static constexpr uint8_t KEY_BYTE = 4; //< Position of the keyframe flag in an encoded frame.
+
+private :
+	uint8_t n_channels;
+	uint32_t max_particles;
+	uint32_t id_bound; //< IDs are below it. 0 if the frames have no IDs.
+	std::vector<uint16_t> buffers[5]; //< Frames, channel after channel. Rotated after each frame. The last 2 are only used with IDs.
+	uint16_t* current; //< Frame being encoded or decoded.
+	uint16_t* previous; //< Last frame.
+	uint16_t* before; //< Frame before the last one. With IDs, in the order of previous.
+	uint32_t n_previous = 0; //< Number of Particles in previous. 0 if there is no previous frame.
+	uint32_t n_before = 0; //< Number of Particles in both before and previous.
+	uint16_t frames_since_key = 0;
+	std::vector<uint8_t> varints; //< Differences before entropy coding.
+	std::vector<uint8_t> coded; //< Output of the entropy coder, written from its end.
+
+	// IDs
+	std::vector<uint32_t> id_buffers[2];
+	uint32_t* ids; //< IDs of the frame being encoded or decoded.
+	uint32_t* previous_ids; //< IDs of the last frame.
+	std::vector<uint32_t> id_slot; //< Index of each ID in the last frame, NO_SLOT if it isn't in it.
+	uint16_t* aligned_previous; //< previous in the order of current. @see align
+	uint16_t* aligned_before; //< before in the order of current.
+	std::vector<uint8_t> history; //< For each Particle of the frame being encoded or decoded, how many previous frames it is in : 0, 1 or 2.
+	std::vector<uint8_t> previous_history; //< history of the last frame, with itself counted.
+	static constexpr uint32_t NO_SLOT = -1;
+
+	/**
+	* @return The prediction of the value of Particle p in channel c at the given order.
+	*/
+	inline uint16_t predict(uint8_t order, uint8_t c, uint32_t p) const {
+		if (id_bound) {
+			uint8_t known = std::min(history[p], order);
+			if (known == 2) return 2*aligned_previous[c*max_particles + p] - aligned_before[c*max_particles + p];
+			return known ? aligned_previous[c*max_particles + p] : 0;
+		}
+		if (order == 2 && p < n_before) return 2*previous[c*max_particles + p] - before[c*max_particles + p];
+		if (order && p < n_previous) return previous[c*max_particles + p];
+		return 0;
+	};
+	void rotate(uint32_t n_parts);
+	/**
+	* @brief Fills aligned_previous, aligned_before and history for the Particles of ids, from where their IDs are in the previous frames.
+	*/
+	void align(uint32_t n_parts, bool key);
+	/**
+	* @brief Calls use(p, prediction) for each Particle p of channel c, in order. Same as @see predict, with a loop for each order rather than a branch per value when there are no IDs.
+	*/
+	template<typename F> void predict_channel(uint8_t order, uint8_t c, uint32_t n_parts, F&& use) const;
+
+public :
+	/**
+	* @param n_channels_ Number of values per Particle : 2 for positions only, 4 with speeds.
+	* @param max_particles_ Maximum number of Particles in a frame.
+	* @param id_bound_ If not 0, each frame has the IDs of its Particles, which are below id_bound_. @see frame_ids
+	*/
+	PosCodec(uint8_t n_channels_, uint32_t max_particles_, uint32_t id_bound_ = 0);
+
+	/**
+	* @brief Forgets the previous frames, so the next one is encoded, or expected to be decoded, as a keyframe.
+	*/
+	void reset();
+	/**
+	* @return Whether the last frame encoded or decoded is a keyframe.
+	*/
+	inline bool isLastKey() const {return frames_since_key == 1;};
+
+	/**
+	* @return Where to write channel c of the next frame to encode. Particle p is at [p].
+	*/
+	inline uint16_t* frame(uint8_t c) {return current + c*max_particles;};
+	/**
+	* @return Channel c of the last frame encoded or decoded.
+	*/
+	inline const uint16_t* last(uint8_t c) const {return previous + c*max_particles;};
+	inline bool hasIds() const {return id_bound;};
+	/**
+	* @return Where to write the IDs of the Particles of the next frame to encode, when there are IDs.
+	*/
+	inline uint32_t* frame_ids() {return ids;};
+	/**
+	* @return The IDs of the Particles of the last frame encoded or decoded, when there are IDs.
+	*/
+	inline const uint32_t* last_ids() const {return previous_ids;};
+
+	/**
+	* @return The maximum size of an encoded frame, for a buffer given to encode.
+	*/
+	size_t max_encoded_size() const;
+
+	/**
+	* @brief Encodes the frame written with @see frame.
+	* @param out Buffer of at least @see max_encoded_size bytes.
+	* @return The size of the encoded frame in bytes.
+	*/
+	size_t encode(uint32_t n_parts, uint8_t* out);
+	/**
+	* @brief Decodes a frame written by encode. Its values are then read with @see last.
+	* @details Frames must be decoded in the order they were encoded, starting from a keyframe.
+	* @return The number of Particles in the frame, or (uint32_t)-1 if the data is corrupted or doesn't follow the previous frame.
+	*/
+	uint32_t decode(const uint8_t* in, size_t size);
+};
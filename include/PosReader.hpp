@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Particle.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class SaveLoader;
+
+/**
+* Reads the frames of a positions file in the background, ahead of the one displayed, so decoding them doesn't slow the display down.
+* @details The frames to read are the frame given to restart, then every stride frames after it (before it if stride is negative).
+* They are decoded in a pool of frames, in which they wait to be taken in order with @see pop.
+* When the frames don't depend on each other and the file is mapped in memory (@see SaveLoader::decodePos), several threads decode them at the same time.
+* Otherwise a single thread reads them in order with SaveLoader::seekPos.
+*/
+class PosReader {
+public :
+	static constexpr uint64_t MAX_POOL_BYTES = 256000000; //< The pool has fewer frames when they are this big together.
+
+	struct Frame {
+		std::vector<Particle> particles;
+		std::vector<uint32_t> ids; //< ID of each Particle. Empty if the file has no IDs.
+		uint32_t n_parts = 0; //< NULLPART if the frame couldn't be read.
+		double time = 0;
+		uint32_t index = 0; //< Index of the frame in the file.
+	};
+
+private :
+	SaveLoader& loader;
+	uint32_t n_file_frames;
+	uint8_t n_held; //< Number of frames given by the last calls to pop that stay valid.
+	std::vector<Frame> frames; //< Frame of sequence number s is in frames[s % frames.size()].
+	std::vector<uint64_t> ready; //< Sequence number + 1 of the frame decoded in each slot, 0 if none.
+
+	std::mutex mutex;
+	std::condition_variable work; //< Wakes the decoding threads up.
+	std::condition_variable decoded; //< Wakes up pop or restart when a frame was decoded.
+	std::vector<std::thread> threads;
+	bool running = true;
+	uint32_t start = 0; //< Index in the file of the frame of sequence number 0.
+	int32_t stride = 1;
+	uint64_t n_seq = 0; //< Number of frames to read from start, before reaching an end of the file.
+	uint64_t next_seq = 0; //< Sequence number of the next frame to decode.
+	uint64_t head = 0; //< Sequence number of the next frame pop gives.
+	uint32_t in_flight = 0; //< Frames being decoded.
+
+	/**
+	* @brief Loop of the decoding threads.
+	* @param parallel Whether the thread uses SaveLoader::decodePos, which can be called by several threads. Otherwise it is the only one.
+	*/
+	void decode_frames(bool parallel);
+
+public :
+	/**
+	* @brief Constructor. Allocates the frames and starts the decoding threads, which read from frame 0 forward.
+	* @param loader_ Where to read from. SaveLoader::prepareLoadPos must have been called on it. It mustn't be used by anything else until the PosReader is deleted.
+	* @param max_particles Maximum number of Particles in a frame.
+	* @param n_held_ Number of frames given by the last calls to pop that stay valid, e.g. 2 to interpolate between them.
+	* @param n_frames Number of frames in the pool, i.e. at most n_frames-n_held_ are read ahead of the ones displayed. Lowered so the pool doesn't take more than MAX_POOL_BYTES.
+	*/
+	PosReader(SaveLoader& loader_, uint32_t max_particles, uint8_t n_held_ = 1, uint8_t n_frames = 8);
+	~PosReader();
+
+	PosReader(const PosReader&) = delete;
+	PosReader& operator=(const PosReader&) = delete;
+
+	/**
+	* @brief Forgets the frames read, then reads from the frame first, every stride frames.
+	* @details Waits for the frames being decoded to be done, so it can take a few milliseconds.
+	*/
+	void restart(uint32_t first, int32_t stride_);
+	inline int32_t get_stride() {return stride;};
+
+	/**
+	* @brief Gives the next frame, and the frame given n_held calls before can be used to read another one.
+	* @param wait Whether to wait for the frame to be decoded. Otherwise nullptr is returned if it isn't yet.
+	* @param end Set to true if there is no more frame to read, in which case nullptr is returned.
+	* @return The frame, valid until the n_held-th next call to pop, or restart.
+	*/
+	Frame* pop(bool wait, bool& end);
+};
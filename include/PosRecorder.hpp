@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Particle.hpp"
+#include "RingQueue.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class SaveLoader;
+
+/**
+* Saves Particle positions in the background, so the simulation threads don't wait for the disk.
+* @details The simulation copies the Particles in a free frame of a preallocated pool and queues it (@see record).
+* A writer thread takes the queued frames in order, quantizes and writes them with SaveLoader::savePos, then gives them back to the pool.
+* When the disk can't keep up the pool runs out of frames. Then either the simulation waits for a frame to be written (WAIT), or the frame is dropped (DROP).
+*/
+class PosRecorder {
+public :
+	enum class policy_t : uint8_t {
+		WAIT, //< Every frame is written, the simulation waits for the disk if needed.
+		DROP //< The simulation never waits, frames are skipped when no buffer is free.
+	};
+
+	struct Stats {
+		uint32_t queue_depth = 0; //< Frames waiting to be written.
+		uint32_t max_queue_depth = 0;
+		uint32_t capacity = 0; //< Number of frames in the pool.
+		uint64_t recorded = 0; //< Frames queued.
+		uint64_t dropped = 0; //< Frames skipped because no buffer was free.
+		uint64_t bytes = 0; //< Bytes written in the file.
+		double write_s = 0; //< Time the writer spent writing.
+		double stall_s = 0; //< Time the simulation waited for a free frame.
+
+		/**
+		* @return The speed of the writer while it writes, in MB/s.
+		*/
+		inline double MBps() const {return write_s > 0 ? bytes / write_s / 1000000 : 0;};
+	};
+
+private :
+	struct Frame {
+		std::vector<Particle> particles;
+		std::vector<uint32_t> ids; //< Empty if the file has no IDs.
+		bool has_ids = false; //< Whether ids were given with the Particles. Otherwise the IDs saved are the indices.
+		uint32_t n_parts = 0;
+		double time = 0;
+	};
+
+	SaveLoader& saver;
+	policy_t policy;
+	double min_delta_time; //< Minimum simulation time between 2 recorded frames.
+	double time_of_last_record = -INFINITY;
+
+	std::vector<Frame> frames;
+	RingQueue<uint8_t> free_frames; //< Frames the simulation can fill.
+	RingQueue<uint8_t> full_frames; //< Frames waiting to be written, in order.
+	std::mutex mutex;
+	std::condition_variable frame_full; //< Wakes the writer up.
+	std::condition_variable frame_free; //< Wakes the simulation up when it waits for a frame.
+	bool running = true; //< Protected by mutex.
+	std::thread writer;
+
+	std::atomic<uint64_t> recorded{0};
+	std::atomic<uint64_t> dropped{0};
+	std::atomic<uint64_t> bytes{0};
+	std::atomic<uint64_t> write_ns{0};
+	std::atomic<uint64_t> stall_ns{0};
+	std::atomic<uint32_t> max_queue_depth{0};
+
+	/**
+	* @brief Loop of the writer thread. It writes the queued frames until stop is called, then writes those left.
+	*/
+	void write_frames();
+
+public :
+	/**
+	* @brief Constructor. Allocates the frames and starts the writer thread.
+	* @param saver_ Where to write. SaveLoader::prepareSavePos must have been called on it. It is only used by the writer thread until stop.
+	* @param max_particles Maximum number of Particles in a frame.
+	* @param min_delta_time_ Minimum simulation time between 2 recorded frames.
+	* @param n_frames Number of frames in the pool, i.e. how many frames can wait for the disk.
+	*/
+	PosRecorder(SaveLoader& saver_, uint32_t max_particles, double min_delta_time_, policy_t policy_ = policy_t::WAIT, uint8_t n_frames = 4);
+	~PosRecorder();
+
+	PosRecorder(const PosRecorder&) = delete;
+	PosRecorder& operator=(const PosRecorder&) = delete;
+
+	/**
+	* @brief Copies the Particles in a free frame and queues it to be written. Must always be called by the same thread, between 2 steps.
+	* @details Nothing is recorded if less than min_delta_time passed since the last recorded frame.
+	* If no frame is free, waits for one or drops the frame depending on the policy.
+	* @param ids ID of each Particle, copied with them if the file has IDs. @see SaveLoader::savePos
+	* @return true if the frame was queued.
+	*/
+	bool record(const Particle* particle_array, uint32_t part_arr_size, double time, const uint32_t* ids = nullptr);
+
+	/**
+	* @brief Writes the frames still queued then stops the writer thread. Nothing can be recorded after.
+	*/
+	void stop();
+
+	Stats get_stats();
+	void print_stats();
+};
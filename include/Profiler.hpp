@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+* Records when each simulation thread starts and ends each part of its work, so it can be exported as a Chrome trace.
+* The trace can be opened with chrome://tracing or https://ui.perfetto.dev to see the work of each thread, its waits at the barriers and the load imbalance of each step.
+* Events are nested : each thread goes from a phase of the step to the next (@see switch_phase), and records smaller scopes inside them (@see Scope).
+* @details Each thread writes in its own ring buffer, without locking, so only the last events are kept. A thread is identified by the index given with set_thread.
+* Threads without an index (like the display thread) aren't recorded.
+*/
+class Profiler {
+public :
+	struct Event {
+		const char* name; //< Must outlive the Profiler, e.g. a string literal.
+		uint64_t start; //< ns since the Profiler was created.
+		uint64_t end; //< ns since the Profiler was created.
+	};
+
+	/**
+	* Records an event from its construction to its destruction, if the Profiler is enabled when constructed.
+	*/
+	class Scope {
+	private :
+		Profiler& profiler;
+		const char* name;
+		uint64_t start;
+		bool active;
+	public :
+		inline Scope(Profiler& profiler_, const char* name_) : profiler(profiler_), name(name_), start(0), active(profiler_.enabled.load(std::memory_order_relaxed)) {
+			if (active) start = profiler.now();
+		};
+		inline ~Scope() {if (active) profiler.record(name, start, profiler.now());};
+	};
+
+private :
+	struct Ring {
+		std::unique_ptr<Event[]> events;
+		std::atomic<uint64_t> written{0}; //< Number of events written since the start. The last one is at [(written-1) % capacity].
+		const char* phase = nullptr; //< Phase the thread is in. It is recorded when the thread switches to another one.
+		uint64_t phase_start = 0;
+	};
+	std::unique_ptr<Ring[]> rings;
+	uint16_t n_threads = 0;
+	uint32_t capacity; //< Number of events kept per thread.
+	std::chrono::steady_clock::time_point epoch;
+	uint64_t recording_start = 0; //< Events older than this aren't exported.
+
+	static thread_local int16_t thread_index; //< Index of the calling thread, -1 if it isn't recorded.
+
+public :
+	std::atomic_bool enabled{false}; //< Whether events are recorded.
+
+	/**
+	* @param capacity_ Number of events kept per thread. The oldest are overwritten.
+	*/
+	Profiler(uint32_t capacity_ = 1 << 16);
+
+	/**
+	* @brief Allocates the ring buffers of n threads. All events are lost if n changes.
+	* @warning Only call this while no thread is recording.
+	*/
+	void set_nb_threads(uint16_t n);
+	/**
+	* @brief Gives the calling thread its index in the Profiler. A negative index means the thread isn't recorded.
+	*/
+	static inline void set_thread(int16_t th_id) {thread_index = th_id;};
+
+	inline uint64_t now() const {return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();};
+
+	/**
+	* @brief Writes an event in the ring buffer of the calling thread.
+	*/
+	inline void record(const char* name, uint64_t start, uint64_t end) {
+		if (thread_index < 0 || thread_index >= n_threads) return;
+		Ring& ring = rings[thread_index];
+		uint64_t w = ring.written.load(std::memory_order_relaxed);
+		ring.events[w % capacity] = {name, start, end};
+		ring.written.store(w+1, std::memory_order_release);
+	};
+	/**
+	* @brief Records the phase the calling thread was in, which ends now, and starts phase.
+	*/
+	inline void switch_phase(const char* phase) {
+		if (thread_index < 0 || thread_index >= n_threads) return;
+		Ring& ring = rings[thread_index];
+		if (!enabled.load(std::memory_order_relaxed)) {
+			ring.phase = nullptr;
+			return;
+		}
+		uint64_t t = now();
+		if (ring.phase) record(ring.phase, ring.phase_start, t);
+		ring.phase = phase;
+		ring.phase_start = t;
+	};
+
+	/**
+	* @brief Starts recording. Only the events from now on will be exported.
+	*/
+	void start_recording();
+	inline void stop_recording() {enabled = false;};
+
+	/**
+	* @brief Writes the events recorded since start_recording (at most the capacity per thread) in the Chrome trace event format (JSON).
+	* @details This can be called while threads are recording. The events they write during the export may be missing.
+	* @return Whether the file could be written.
+	*/
+	bool export_chrome_trace(const std::string& file_name);
+};
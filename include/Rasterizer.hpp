@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Particle.hpp"
+#include "World.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Draws the whole world into an image on the CPU, without a window nor a GPU, e.g. to make videos of a run on a server.
+* @details The Particles are discs coloured by their speed like in shader/particle.vert.glsl, the Zones are drawn below them and the Segments and the world's borders above.
+* The image is cut in tiles of TILE_ROWS rows. The Particles are first sorted into the tiles they touch, each thread taking a share of them,
+* then the threads take the tiles one by one and draw each of them entirely, so no two threads write the same pixel.
+* The Particles of a tile are drawn in the order of the array, so the image doesn't depend on the number of threads.
+* The Zones and Segments don't move, so they are drawn once in the constructor.
+*/
+class Rasterizer {
+public :
+	static constexpr uint32_t TILE_ROWS = 16; //< Rows of pixels per tile.
+	static constexpr uint32_t MIN_PARALLEL = 16384; //< Below this number of Particles, the calling thread sorts them alone.
+	static constexpr float DEFAULT_MAX_SPEED = 100; //< The speed_colour_rate of the OpenGL Renderer.
+
+private :
+	uint32_t width, height;
+	float scale; //< Pixels per world unit.
+	float radius; //< Radius of the Particles in pixels.
+	float max_speed; //< Speed at which a Particle is the brightest.
+	uint32_t n_tiles;
+	std::vector<uint8_t> background; //< RGBA image of the Zones.
+	std::vector<uint8_t> overlay; //< Opacity of the Segments and world's borders in each pixel.
+	std::vector<uint8_t> pixels; //< RGBA image drawn.
+	std::vector<std::vector<uint32_t>> tile_parts; //< Particles touching each tile, found by each thread : tile_parts[t*n_tiles + tile].
+
+	const Particle* particles = nullptr;
+	uint32_t n_parts = 0;
+	uint8_t n_sorting = 1; //< Number of threads that sorted the Particles of the current image.
+	std::atomic<uint32_t> next_tile{0};
+
+	std::mutex mutex;
+	std::condition_variable work; //< Wakes the workers up.
+	std::condition_variable done; //< Wakes run up when the workers are done.
+	std::vector<std::thread> threads;
+	bool running = true;
+	uint64_t generation = 0; //< Number of jobs given to the workers.
+	uint32_t n_working = 0; //< Workers still on the current job.
+	void (Rasterizer::*job)(uint8_t, uint8_t) = nullptr;
+	uint8_t job_threads = 1; //< Number of threads on the current job, the calling thread included.
+
+	/**
+	* @brief Loop of the worker thread th_id.
+	*/
+	void help(uint8_t th_id);
+	/**
+	* @brief Calls job on the calling thread (0) and n_threads-1 workers. Returns once it is done.
+	*/
+	void run(void (Rasterizer::*job_)(uint8_t, uint8_t), uint8_t n_threads);
+	/**
+	* @brief Sorts the share th_id out of n_threads of the Particles into the tiles they touch.
+	*/
+	void sort(uint8_t th_id, uint8_t n_threads);
+	/**
+	* @brief Draws the tiles left, one at a time.
+	*/
+	void draw_tiles(uint8_t th_id, uint8_t n_threads);
+	/**
+	* @brief Draws the tile : the background, its Particles, then the overlay.
+	*/
+	void draw_tile(uint32_t tile);
+	/**
+	* @brief Draws a line of opacity 1 in overlay, from a to b in world coordinates.
+	*/
+	void draw_line(const float a[2], const float b[2]);
+	/**
+	* @brief Blends colour over the pixel with the opacity alpha.
+	*/
+	static inline void blend(uint8_t* pixel, const float colour[3], float alpha) {
+		for (uint8_t c=0; c<3; c++) pixel[c] += (int16_t)((colour[c] - pixel[c]) * alpha);
+	};
+
+public :
+	/**
+	* @brief Constructor. Draws the Zones and Segments of world and starts the worker threads.
+	* @param width_ Width of the image in pixels. The height follows from the world's size, rounded to an even number as most video codecs need.
+	* @param radius_ Radius of the Particles in world units.
+	* @param max_speed_ Speed at which a Particle is the brightest, as max_speed in shader/particle.vert.glsl.
+	* @param n_threads Number of threads drawing, the calling thread included. One per 2 hardware threads if 0.
+	*/
+	Rasterizer(World& world, uint32_t width_, float radius_, float max_speed_ = DEFAULT_MAX_SPEED, uint32_t n_threads = 0);
+	~Rasterizer();
+
+	Rasterizer(const Rasterizer&) = delete;
+	Rasterizer& operator=(const Rasterizer&) = delete;
+
+	/**
+	* @brief Draws the Particles over the Zones, and the Segments over them.
+	* @param particles_ Particles to draw. They mustn't change until it returns.
+	* @return The RGBA image, row by row from the top. Valid until the next call.
+	*/
+	const uint8_t* draw(const Particle* particles_, uint32_t n_parts_);
+
+	inline uint32_t getWidth() const {return width;};
+	inline uint32_t getHeight() const {return height;};
+	inline uint32_t getThreads() const {return threads.size()+1;};
+};
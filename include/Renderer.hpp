@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Consometer.hpp"
+#include "DensityImage.hpp"
 #include "Particle_simulator.hpp"
+#include "ScreenCapture.hpp"
 #include "VertexArray.hpp"
 
 // Force sfml by setting boolean to 1
@@ -31,11 +33,13 @@ private :
 		VertexArray worldGrid_vertices;
 		VertexArray zone_vertices;
 		VertexArray user_interact_zone;
+		VertexArray density_vertices; //< The rectangle density_texture is drawn on.
 		// Displaying text is not yet implemented.
 
 		// particle_shader; // also used outside this #if
 		sf::Shader default_shader;
 		sf::Shader worldGrid_shader;
+		sf::Shader density_shader;
 
 		float particles_ds; //< Display size of the Particles
 		float worldGrid_ds; //< Display size of the World's Cells
@@ -58,6 +62,11 @@ private :
 	bool liquid_shader = false;
 	sf::Glsl::Vec4 particle_color = sf::Glsl::Vec4(0.25f, 0.88f, 0.88f, 1.f); //< Colour to apply on all Particles should their individual colour be ignored (e.g. liquid shader is used)
 
+	DensityImage density; //< Drawn instead of the Particles when there are too many of them per pixel. @see use_density
+	sf::Texture density_texture;
+
+	ScreenCapture capture; //< Saves the frames displayed, for screenshots and sequences. @see takeScreenShot @see toggleCapture
+
 	Consometre display_time;
 
 	// ======== PARAMETERS ========
@@ -71,6 +80,8 @@ public :
 	float radius_multiplier; //< For Particles : multiplier on the display of Particles' radii compared to their actual radii.
 	float colour_momentum; //< For Particles : how much of the previous colour is kept.
 	float speed_colour_rate; //< For Particles: how much speed is necessary to reach the same colour/brightness
+	float lod_density; //< For Particles : number of Particles per pixel from which the density of the Particles is drawn instead of each of them. 0 to always draw each Particle.
+	float capture_interval; //< Seconds between 2 images of the sequences captured with @see toggleCapture
 
 	bool enable_displaying; //< To use when you want to make the simulation run while you are away.
 	bool dp_particles;
@@ -112,13 +123,23 @@ public :
 
 	#if !OPENGL_INCLUDE_SUCCESS
 	/**
-	* @brief Updates the Particles' vertices according to their positions.
-	* @warning Reads particle_sim's particles positions while they might be updating in another thread. But this is read-only and never caused any problem.
-	* I am keeping this without a mutex lock for performance reasons. 
+	* @brief Updates the Particles' vertices according to their positions in frame.
+	* @param frame Particles to display. When simulating, a snapshot the simulation threads don't touch. @see Particle_simulator::get_display_frame
 	*/
-	void update_particle_vertices();
+	void update_particle_vertices(const Particle_simulator::DisplayFrame& frame);
 	#endif
 
+	/**
+	* @return Whether there are more than lod_density Particles per pixel in frame, at the current zoom.
+	* @details The Particles are assumed to be spread evenly in the world, so the view doesn't have to be searched.
+	*/
+	bool use_density(const Particle_simulator::DisplayFrame& frame);
+	/**
+	* @brief Makes the density image of the Particles in the view, one pixel per pixel of the window, and sends it to density_texture.
+	* @param speed_colour Whether the pixels are coloured by the speed of their Particles.
+	*/
+	void update_density(const Particle_simulator::DisplayFrame& frame, bool speed_colour);
+
 	/**
 	* @brief Updates the Segments' vertices according to their positions.
 	* @warning Reads world's segments positions while they might be updating in another thread. But this is read-only and never caused any problem.
@@ -199,11 +220,15 @@ public :
 	void should_use_speed();
 
 	/**
-	* @brief Takes a screenshot and saves it as result_images/screenshot.png .
+	* @brief Takes a screenshot of the next frame and saves it as result_images/screenshot.png , in the background.
 	*/
 	void takeScreenShot();
+	/**
+	* @brief Starts or stops saving the frames displayed every capture_interval seconds, as result_images/capture-<date>-<number>.png , in the background.
+	*/
+	void toggleCapture();
 
-	Particle* followed = nullptr; //< Particle that is being followed (i.e. that the camera stays centered around).
+	uint32_t followed = NULLPART; //< ID of the Particle that is being followed (i.e. that the camera stays centered around). Its index changes when Particles are deleted or reordered. @see Particle_simulator::get_id
 	
 	/**
 	* @brief Toggles the displaying of the grid.
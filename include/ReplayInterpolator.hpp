@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Particle.hpp"
+#include "ThreadHandler.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Makes the frames displayed between 2 frames of a positions file, so a file saved every few steps still replays smoothly.
+* @details The Particles of the 2 frames are matched by ID when both frames have IDs, by index otherwise.
+* When the speeds were saved, a Particle follows the cubic Hermite curve given by its positions and speeds in both frames, so it moves as it did in the simulation.
+* Otherwise it goes in a straight line, at the speed it had on average between the frames.
+* A Particle that moved further than its speeds allow (e.g. respawned by a zone) jumps halfway through rather than crossing the world.
+* The work is shared between the calling thread and worker threads with ThreadHandler::load_repartition.
+*/
+class ReplayInterpolator {
+public :
+	static constexpr uint32_t NO_MATCH = (uint32_t)-1;
+	static constexpr uint32_t WORK_SUBSET = 4096; //< Number of Particles a thread takes at once.
+	static constexpr uint32_t MIN_PARALLEL = 32768; //< Below this number of Particles, the calling thread does everything alone, as waking the workers would take longer.
+
+	struct Frame {
+		Particle* particles = nullptr; //< nullptr if there is no frame.
+		const uint32_t* ids = nullptr; //< ID of each Particle. nullptr if the file has none.
+		uint32_t n_parts = 0;
+		double time = 0;
+		uint32_t index = 0; //< Index of the frame in the file.
+	};
+
+private :
+	bool hermite; //< Whether the frames have speeds.
+	uint32_t id_bound; //< The IDs of the frames are below it.
+	std::vector<Particle> out; //< The interpolated frame.
+	std::vector<uint32_t> to_slot; //< Index in to of each ID. Only valid if to has this ID at this index, so it is never cleared.
+	Frame from, to;
+	bool by_id = false; //< Whether Particles are matched by ID in this interval.
+	float h = 0; //< Time between from and to. Negative when playing backwards.
+	float coef[4] = {1, 0, 0, 0}; //< Weights of the position in from, the speed in from, the position in to and the speed in to, for the current interpolation.
+	float dcoef[4] = {0, 0, 0, 0}; //< Same for the speed.
+	float s = 0; //< Fraction of the interval done.
+
+	ThreadHandler threadHandler;
+	std::mutex mutex;
+	std::condition_variable work; //< Wakes the workers up.
+	std::condition_variable done; //< Wakes run up when the workers are done.
+	std::vector<std::thread> threads;
+	bool running = true;
+	uint64_t generation = 0; //< Number of jobs given to the workers.
+	uint32_t n_working = 0; //< Workers still on the current job.
+	void (ReplayInterpolator::*job)(uint32_t, uint32_t) = nullptr;
+	uint32_t job_size = 0;
+
+	/**
+	* @brief Loop of the worker threads.
+	*/
+	void help();
+	/**
+	* @brief Calls job on [0, size[, with the workers if size is big enough. Returns once it is done.
+	*/
+	void run(void (ReplayInterpolator::*job_)(uint32_t, uint32_t), uint32_t size);
+	/**
+	* @brief Writes the index in to of the IDs of the Particles of to, from start to end.
+	*/
+	void fill_slots(uint32_t start, uint32_t end);
+	/**
+	* @brief Interpolates the Particles of from, from start to end, in out.
+	*/
+	void interpolate_range(uint32_t start, uint32_t end);
+	inline uint32_t match(uint32_t p) const {
+		if (!by_id) return p < to.n_parts ? p : NO_MATCH;
+		uint32_t id = from.ids[p];
+		if (id >= id_bound) return NO_MATCH;
+		uint32_t q = to_slot[id];
+		return q < to.n_parts && to.ids[q] == id ? q : NO_MATCH;
+	};
+
+public :
+	/**
+	* @brief Constructor. Allocates the interpolated frame and starts the worker threads.
+	* @param max_particles Maximum number of Particles in a frame.
+	* @param id_bound_ The IDs of the frames are below it. 0 if they have no IDs.
+	* @param hermite_ Whether the frames have speeds, so Particles can follow curves.
+	*/
+	ReplayInterpolator(uint32_t max_particles, uint32_t id_bound_, bool hermite_);
+	~ReplayInterpolator();
+
+	ReplayInterpolator(const ReplayInterpolator&) = delete;
+	ReplayInterpolator& operator=(const ReplayInterpolator&) = delete;
+
+	/**
+	* @brief Sets the 2 frames to interpolate between. They mustn't change until the next call.
+	*/
+	void set_interval(const Frame& from_, const Frame& to_);
+	/**
+	* @brief Makes the frame at fraction s_ of the interval, from 0 (from) to 1 (to).
+	* @return The interpolated Particles, as many as in from. Valid until the next call.
+	*/
+	Particle* interpolate(float s_);
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+* Bounded lock-free queue of T in a ring buffer.
+* Any number of threads can push and pop at the same time without locking : each slot carries a sequence number telling whether it is free to write or ready to read.
+* Neither push nor pop ever waits. push fails when the ring is full and pop when it is empty.
+* @details This is the usual array-based queue of D. Vyukov. The read and write counters are on their own cache lines so producers and consumers don't slow each other down.
+*/
+template<typename T>
+class RingQueue {
+private :
+	struct Slot {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	size_t mask; //< Capacity - 1. The capacity is a power of 2 so indices wrap with a mask.
+	alignas(64) std::atomic<size_t> write_pos{0};
+	alignas(64) std::atomic<size_t> read_pos{0};
+
+public :
+	/**
+	* @brief Constructor.
+	* @param capacity Maximum number of elements in the queue. Rounded up to a power of 2 (at least 2).
+	*/
+	RingQueue(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity) size *= 2;
+		mask = size-1;
+		slots.reset(new Slot[size]);
+		for (size_t i=0; i<size; i++) slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	RingQueue(const RingQueue&) = delete;
+	RingQueue& operator=(const RingQueue&) = delete;
+
+	inline size_t capacity() const {return mask+1;};
+	/**
+	* @return An estimation of the number of elements in the queue. It may already be wrong when returned if other threads are pushing or popping.
+	*/
+	inline size_t size() const {
+		size_t w = write_pos.load(std::memory_order_relaxed);
+		size_t r = read_pos.load(std::memory_order_relaxed);
+		return w > r ? w - r : 0;
+	};
+
+	/**
+	* @brief Copies value at the end of the queue.
+	* @return false if the queue is full, in which case nothing is pushed.
+	*/
+	bool push(const T& value) {
+		size_t pos = write_pos.load(std::memory_order_relaxed);
+		Slot* slot;
+		while (true) {
+			slot = &slots[pos & mask];
+			size_t seq = slot->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) { // The slot is free, trying to claim it
+				if (write_pos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+			}
+			else if (diff < 0) return false; // The slot still holds the element pushed a lap ago
+			else pos = write_pos.load(std::memory_order_relaxed); // Another producer claimed it first
+		}
+		slot->value = value;
+		slot->sequence.store(pos+1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	* @brief Moves the first element of the queue into value.
+	* @return false if the queue is empty, in which case value isn't changed.
+	*/
+	bool pop(T& value) {
+		size_t pos = read_pos.load(std::memory_order_relaxed);
+		Slot* slot;
+		while (true) {
+			slot = &slots[pos & mask];
+			size_t seq = slot->sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos+1);
+			if (diff == 0) { // The slot has been written, trying to claim it
+				if (read_pos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) break;
+			}
+			else if (diff < 0) return false; // Nothing written there yet
+			else pos = read_pos.load(std::memory_order_relaxed); // Another consumer claimed it first
+		}
+		value = std::move(slot->value);
+		slot->sequence.store(pos+mask+1, std::memory_order_release);
+		return true;
+	}
+};
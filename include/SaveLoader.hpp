@@ -1,6 +1,8 @@
 #pragma once
 
 #include "FileHandler.hpp"
+#include "MappedFile.hpp"
+#include "PosCodec.hpp"
 #include "Particle.hpp"
 #include "World.hpp"
 
@@ -9,6 +11,8 @@
 
 class PSparam;
 class Particle_simulator;
+struct SimState;
+struct ColumnChunk;
 
 class SLinfoPos {
 public :
@@ -19,22 +23,45 @@ public :
 
 	bool comp_out_speed;
 	bool comp_discreet;
+	bool comp_delta;
+	bool drop_frames; //< Whether frames are dropped rather than slowing the simulation down when positions can't be written fast enough. @see PosRecorder
+	bool save_ids; //< Whether the ID of each Particle is saved with it, so it can be followed from a frame to the next. @see Particle_simulator::get_id
+	uint16_t save_every; //< Number of simulation steps between 2 saved frames. 1 or less saves every step.
+	bool export_columns; //< Whether the Particles are also exported as columns for analyses outside of the simulator, every save_every steps. @see ColumnExporter
+	uint16_t export_chunk; //< Frames per chunk of exported columns. 0 for the default.
+	bool export_diagnostics; //< Whether the exported columns include the norm of the speed and the grid Cell of each Particle.
+	uint16_t replay_substeps; //< When loading, number of frames displayed from a loaded frame to the next, interpolated between them. 1 or less shows only the loaded frames. @see ReplayInterpolator
 	char posFileName[fileNameSize];
 
-public :
-	inline bool isLoadPos() {return load_pos;};
-	inline bool isSavePos() {return save_pos;};
-
-	inline bool isCompOutSpeed() {return comp_out_speed;}; //< Whether the speed is NOT to be included
-	inline bool isCompDiscreet() {return comp_discreet;};
+	bool load_checkpoint;
+	float checkpoint_period; //< Simulated seconds between 2 checkpoints written. 0 or less to write none.
+	uint64_t checkpoint_step; //< Step of the checkpoint to load. 0 for the latest one.
+	char checkpointFileName[fileNameSize]; //< Name of the checkpoints, before their step.
 
-	enum compression_mode {Normal, Discreet, PosOnly, Both};
-	inline uint8_t compressionMode() {
+public :
+	inline bool isLoadPos() const {return load_pos;};
+	inline bool isSavePos() const {return save_pos;};
+
+	inline bool isCompOutSpeed() const {return comp_out_speed;}; //< Whether the speed is NOT to be included
+	inline bool isCompDiscreet() const {return comp_discreet;};
+	inline bool isCompDelta() const {return comp_delta;}; //< Whether the discreet values are stored as their differences with the previous frames, and entropy coded. @see PosCodec
+	inline bool isDropFrames() const {return drop_frames;};
+	inline bool isSaveIds() const {return save_ids;}; //< When loading, whether the file has the IDs of the Particles.
+	inline bool isExportColumns() const {return export_columns;};
+	inline bool isInterpolated() const {return load_pos && replay_substeps > 1;};
+
+	enum compression_mode {Normal, Discreet, PosOnly, Both, Delta, DeltaPosOnly};
+	inline uint8_t compressionMode() const {
+		if (comp_delta) return Delta + comp_out_speed;
 		return comp_discreet + 2*comp_out_speed;
 	};
 
 	std::string posName() {return posFileName;};
 
+	inline bool isLoadCheckpoint() const {return load_checkpoint;};
+	inline bool isSaveCheckpoint() const {return checkpoint_period > 0;};
+	std::string checkpointName() const {return checkpointFileName;};
+
 	/**
 	@return A SLinfoPos ordering to do nothing. File names are empty.
 	*/
@@ -42,6 +69,7 @@ public :
 		SLinfoPos lazy;
 		memset(&lazy, 0, sizeof(SLinfoPos));
 		lazy.posFileName[0] = '\0';
+		lazy.checkpointFileName[0] = '\0';
 		return lazy;
 	};
 };
@@ -72,7 +100,7 @@ public :
 	@return True if any order of loading or saving is set to true.
 	*/
 	bool does_anything() {
-		return load_world || load_simP || load_pos || save_world || save_simP || save_pos;
+		return load_world || load_simP || load_pos || save_world || save_simP || save_pos || load_checkpoint || isSaveCheckpoint();
 	}
 
 	/**
@@ -82,6 +110,7 @@ public :
 		SLinfo lazy;
 		memset(&lazy, 0, sizeof(SLinfo));
 		lazy.posFileName[0] = '\0';
+		lazy.checkpointFileName[0] = '\0';
 		lazy.worldFileName[0] = '\0';
 		lazy.simPFileName[0] = '\0';
 		return lazy;
@@ -93,6 +122,16 @@ public :
 * This is the class that chooses what should be written, where and how.
 */
 class SaveLoader : protected FileHandler {
+public :
+	/**
+	* Where a frame of a positions file is, so it can be read without reading the frames before it.
+	*/
+	struct PosFrame {
+		double time; //< Simulation time of the frame.
+		uint64_t offset; //< Position of the frame in the file.
+		bool key; //< Whether the frame can be decoded without the previous ones. Always true outside of the Delta modes.
+	};
+
 private :
 	double time_of_last_save = -INFINITY; //< When was the last time particle positions were saved. Used so dt can be decreased without changing the dt between saves.
 	double min_delta_save_time = 0; //< Minimum simulation time between 2 particle positions saves.
@@ -100,10 +139,31 @@ private :
 	SLinfoPos comp_mode; //< SaveLoader needs to remember what level of compression is applied on Particles because 1) a file should only use 1 level of compression and 2) some compression level use specific buffer.
 	float world_size[2] = {1, 1};
 	float max_speed[2] = {20000, 20000}; //< Maximum savable speed. The higher, the less saving is precise.
-	void* comp_data = nullptr; //< Particle buffer for reading/writing. Might be an array of Particles, floats or uint16_t.
+	void* comp_data = nullptr; //< Particle buffer for reading/writing. Might be an array of Particles, floats or uint16_t. For Delta modes, the encoded frame.
+	PosCodec* codec = nullptr; //< Compresses the frames of the Delta modes, remembering the previous ones.
 	void delete_comp_data();
 	size_t loadPos_start_file_offset = 0; //< Position of the file read pointer after prepareLoadPos.
 
+	std::vector<PosFrame> pos_index; //< Every frame of the positions file being loaded.
+	uint32_t next_pos_frame = 0; //< Index in pos_index of the frame loadPos reads next.
+	std::ofstream index_file; //< Sidecar of the positions file being saved, where a PosFrame is written for each frame.
+	MappedFile mapped_pos; //< The positions file being loaded, mapped in memory when its frames don't depend on each other (not in the Delta modes).
+	size_t pos_elem_size = sizeof(Particle); //< Size of an element of a frame's array in the current compression mode.
+	uint32_t pos_id_bound = 0; //< The IDs of the positions file are below it : the maximum number of Particles of the simulation that saved it.
+	std::vector<uint32_t> pos_ids; //< IDs written when savePos isn't given any (0, 1, 2...), or read when loadPos isn't given where to put them.
+
+	/**
+	* @brief Turns n_parts elements of a frame's array, in the current compression mode, into Particles. Nothing is done in the Delta modes.
+	*/
+	void unpack_pos(const void* data, uint32_t n_parts, Particle* particle_array) const;
+
+	/**
+	* @brief Fills pos_index for the positions file just opened by prepareLoadPos.
+	* @details The PosFrames are read from the sidecar file (same name with the extension .idx), then the frames written after its last one are found by reading their headers in the positions file.
+	* So files saved without a sidecar, or whose saving was interrupted, are indexed too.
+	*/
+	void index_positions();
+
 	/**
 	* @brief Sets the compression level and prepares the buffer comp_data.
 	* @param compression
@@ -115,6 +175,10 @@ public :
 	~SaveLoader();
 
 	inline SLinfoPos getCompression() {return comp_mode;};
+	/**
+	* @return The number of bytes written in the file opened for saving.
+	*/
+	inline uint64_t getWrittenBytes() {return written;};
 
 	/**
 	* @brief Loads start up orders for reading/saving and from which files.
@@ -139,6 +203,7 @@ public :
 	* Calls @see int8_t loadParam(WorldParam&, std::string) to load World parameters.
 	* Calls @see int8_t loadParam(PSparam&, std::string) to load Simulation parameters.
 	* If loading isn't required or possible parameters are set to default.
+	* If the orders say to load a checkpoint, both parameters come from it instead, and checkpoint_step is set to the step of the checkpoint found.
 	* @return loading orders, loaded from the start up file.
 	* @see int8_t loadParam(WorldParam&, std::string)
 	* @see int8_t loadParam(PSparam&, std::string)
@@ -152,6 +217,15 @@ public :
 	* @see void saveParam(PSparam&, uint32_t, ByteSize, std::string, bool)
 	*/
 	void saveParameters(World& world, Particle_simulator& sim, std::string fileName = "", bool binary = 1);
+	/**
+	* @brief Writes what the autotuner chose back in the files the parameters were loaded from : cs and the strategies in simPFileName, cellSize in worldFileName.
+	* @details In files written in full text, only the lines of these parameters are changed so the comments and the rest of the file stay.
+	* Files written in binary are loaded, then written back with only these parameters changed.
+	* @param worldFileName Name of the world file. Nothing is written in it if empty.
+	* @param simPFileName Name of the simulation parameters file. Nothing is written in it if empty.
+	* @see Particle_simulator::autotune
+	*/
+	void saveTuning(World& world, PSparam& param, std::string worldFileName, std::string simPFileName);
 
 	// World
 
@@ -215,6 +289,63 @@ public :
 	*/
 	int8_t loadParam(PSparam& param, std::string fileName = "");
 
+	// Columns
+
+	static constexpr uint64_t COL_HEADER_SIZE = 4096; //< Size of the header of a chunk of columns, binary byte included. The first column starts right after.
+	/**
+	* @return The name of the chunk of columns whose first frame is first_frame, among the chunks named name : name-first_frame.
+	*/
+	static inline std::string columnsName(std::string name, uint64_t first_frame) {return name + "-" + std::to_string(first_frame);};
+	/**
+	* @brief Writes chunk in the exports folder, so it can be read without this program (e.g. with numpy.memmap).
+	* @details After the binary byte, a text header fills the first COL_HEADER_SIZE bytes of the file, padded with spaces. Its lines are :
+	* "particle_sim2 columns 1", then "frames=<number of frames>", "rows=<number of Particles in all the frames>", "first_frame=<index of the first frame among every exported frame>",
+	* then for each column "column=<name> <numpy dtype> <offset in the file> <number of elements>", and "end".
+	* The columns are little-endian arrays aligned on 64 bytes : time and start have one element per frame (start has one more, the number of rows), the others one per row.
+	* @return true if the whole chunk was written.
+	*/
+	bool saveColumns(const ColumnChunk& chunk, std::string fileName);
+
+	// Checkpoints
+
+	/**
+	* @return The name of the checkpoint of the step step, among the checkpoints named name : name-step.
+	*/
+	static inline std::string checkpointName(std::string name, uint64_t step) {return name + "-" + std::to_string(step);};
+	/**
+	* @brief Looks for a checkpoint named name in the checkpoints folder.
+	* @param step Step of the checkpoint looked for. If 0, the checkpoint of the latest step is looked for.
+	* @return The step of the checkpoint found, or 0 if there is none.
+	* @see checkpointName
+	*/
+	uint64_t findCheckpoint(std::string name, uint64_t step = 0);
+	/**
+	* @brief Writes everything needed to restart the simulation from state in the file fileName, in binary.
+	* @details The file is written under a temporary name, then renamed. So a checkpoint interrupted while being written doesn't replace one with the same name.
+	* @param fileName Name of the checkpoint. Path and extension are automatically added.
+	* @return true if the checkpoint was written.
+	*/
+	bool saveCheckpoint(SimState& state, std::string fileName);
+	/**
+	* @brief Loads the checkpoint fileName into state.
+	* @param fileName Name of the checkpoint. Path and extension are automatically added.
+	* @param with_particles Whether the Particles are loaded. Otherwise state.particles is left empty, and the end of the file isn't read.
+	* @return -1 if the file couldn't be opened or isn't a complete checkpoint, 0 otherwise.
+	*/
+	int8_t loadCheckpoint(SimState& state, std::string fileName, bool with_particles = true);
+	/**
+	* @brief Loads the world and simulation parameters the checkpoint fileName was written with.
+	* @return -1 if the file couldn't be opened or isn't a checkpoint, 0 otherwise.
+	* @see int8_t loadCheckpoint(SimState&, std::string, bool)
+	*/
+	int8_t loadCheckpointParam(WorldParam& Wparam, PSparam& Sparam, std::string fileName);
+	/**
+	* @brief Adds the segments and zones of the checkpoint fileName to world.
+	* @return -1 if the file couldn't be opened or isn't a checkpoint, 0 otherwise.
+	* @see int8_t loadCheckpoint(SimState&, std::string, bool)
+	*/
+	int8_t loadCheckpointSegNZones(World& world, std::string fileName);
+
 	// Particle positions
 	
 	/**
@@ -245,23 +376,28 @@ public :
 	* The compression level used is described by @see comp_mode.
 	* If comp_mode.comp_out_speed is true, then the speed of Particles isn't saved.
 	* If comp_mode.comp_discreet is true, then the position (and maybe speed) of Particles will be saved as uint16_t (int16_t for speed) instead of floats.
+	* If comp_mode.comp_delta is true, these uint16_t are compressed by @see PosCodec. A frame can then only be read after the previous ones, back to a keyframe.
+	* If comp_mode.save_ids is true, the ID of each Particle is written after the array (inside the compressed frame in the Delta modes).
 	* @param particle_array Array of Particles to save.
 	* @param part_arr_size Number of Particles to save (no check is performed to ensure it won't seg fault).
 	* @param time Simulation time at the moment of call. Used so every consecutive saves can be associated to a moment in the simulation. 
+	* @param ids ID of each Particle, all below the max_particles given to prepareSavePos. If nullptr, the IDs are the indices.
 	*/
-	void savePos(Particle* particle_array, uint32_t part_arr_size, double time);
+	void savePos(Particle* particle_array, uint32_t part_arr_size, double time, const uint32_t* ids = nullptr);
 	/**
 	* @brief Reads the position and speed (so just Particles) from the opened file.
 	* @details @see void prepareLoadPos(uint32_t max_particles, SLinfoPos known) must have been called before hand (and the file shouldn't be closed obviously).
 	* The compression level used is described by @see comp_mode.
 	* If comp_mode.comp_out_speed is true, then the speed of Particles isn't found in the file.
 	* If comp_mode.comp_discreet is true, then the position (and maybe speed) of Particles found in the file are as uint16_t (int16_t for speed) instead of floats.
+	* If the file is mapped in memory (@see isPosMapped), the Particles are copied from the mapping rather than read through the stream.
 	* @param particle_array Array of Particles in which to load the data.
 	* @param part_arr_size Size of the passed array.
 	* @param time Simulation time at the moment the Particles were saved. Used so every consecutive saves can be associated to a moment in the simulation.
+	* @param ids If not nullptr, array of arr_size in which to load the ID of each Particle. The IDs are the indices if the file has none.
 	* @return The number of Particles loaded. If loading was unsuccessful (e.g. reached end of position file), returns NULLPART instead.
 	*/
-	uint32_t loadPos(Particle* particle_array, uint32_t arr_size, double* time);
+	uint32_t loadPos(Particle* particle_array, uint32_t arr_size, double* time, uint32_t* ids = nullptr);
 
 	/**
 	* @brief Resets the position reading to the initial state.
@@ -270,6 +406,58 @@ public :
 	*/
 	void resetPosLoading();
 
+	/**
+	* @return The number of frames in the positions file being loaded.
+	*/
+	inline uint32_t getPosFrameCount() {return pos_index.size();};
+	inline const PosFrame& getPosFrame(uint32_t frame) {return pos_index[frame];};
+	/**
+	* @return The index of the frame loadPos reads next.
+	*/
+	inline uint32_t getNextPosFrame() {return next_pos_frame;};
+	/**
+	* @return The index of the last frame saved at or before time, or 0 if there is none.
+	*/
+	uint32_t findPosFrame(double time);
+	/**
+	* @brief Reads the frame frame of the positions file, then loadPos goes on from the frame after it.
+	* @details The file read pointer is moved using pos_index, so it takes the same time wherever the frame is.
+	* In the Delta modes, the frames are decoded from the last keyframe before frame, unless the frames already read lead to it.
+	* So at most PosCodec::KEYFRAME_INTERVAL frames are decoded.
+	* @return The number of Particles loaded, or NULLPART if frame isn't in the file or couldn't be read.
+	* @see uint32_t loadPos(Particle*, uint32_t, double*)
+	*/
+	uint32_t seekPos(uint32_t frame, Particle* particle_array, uint32_t arr_size, double* time, uint32_t* ids = nullptr);
+
+	/**
+	* @return Whether the positions file being loaded is mapped in memory, so its frames can be read from any thread with @see decodePos.
+	*/
+	inline bool isPosMapped() {return mapped_pos.is_open();};
+	/**
+	* @return The IDs of the positions file are below it. 0 if it has no IDs.
+	*/
+	inline uint32_t getPosIdBound() {return comp_mode.isSaveIds() ? pos_id_bound : 0;};
+	/**
+	* @return Whether the frames of the positions file being loaded can be read in place with @see mapPos, i.e. it is mapped and in Normal mode.
+	*/
+	inline bool isPosInPlace() {return mapped_pos.is_open() && comp_mode.compressionMode() == SLinfoPos::compression_mode::Normal;};
+	/**
+	* @brief Reads the frame frame from the mapped positions file. Unlike loadPos, it doesn't change what loadPos reads next, so several threads can call it at the same time.
+	* @param ids @see loadPos
+	* @return The number of Particles loaded, or NULLPART if the file isn't mapped (@see isPosMapped) or frame isn't in it.
+	*/
+	uint32_t decodePos(uint32_t frame, Particle* particle_array, uint32_t arr_size, double* time, uint32_t* ids = nullptr) const;
+	/**
+	* @brief Gives the Particles of the frame frame where they are in the mapped positions file, without copying them. Then loadPos goes on from the frame after it.
+	* @details The Particles stay valid until the next call to prepareLoadPos. Changing them doesn't change the file.
+	* @param n_parts Set to the number of Particles in the frame.
+	* @param time Set to the simulation time of the frame.
+	* @param stride Which frame is likely to be read next, relative to this one, so the kernel reads it from the disk beforehand.
+	* @param ids If not nullptr, set to the IDs of the Particles where they are in the file, or to nullptr if the file has none.
+	* @return The Particles of the frame, or nullptr if the file isn't mapped or frame isn't in it.
+	*/
+	Particle* mapPos(uint32_t frame, uint32_t* n_parts, double* time, int32_t stride = 1, const uint32_t** ids = nullptr);
+
 	/**
 	* @brief Purely a debug function to check if saving and loading world and simulation works.
 	*/
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Attribute.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* Saves what the window displays as PNG images in result_images, without making the display wait for them.
+* @details The pixels of a frame are read at the end of its drawing, and encoded by a worker thread.
+* With OpenGL, glReadPixels writes them into a pixel buffer object, from which they are only copied when the next frame is drawn, once the GPU is done with them.
+* Otherwise, they are copied through an sf::Texture right away, and only the encoding is left to the worker.
+* A single screenshot is saved as result_images/screenshot.png. A sequence saves an image every interval seconds, as result_images/<name>-<number>.png with the number on 6 digits.
+* If the worker has MAX_QUEUED images waiting to be encoded, the new one is dropped rather than slowing the display down.
+*/
+class ScreenCapture {
+public :
+	static constexpr uint8_t MAX_QUEUED = 8; //< Images waiting for the worker, from which new ones are dropped.
+
+private :
+	/**
+	* An image waiting to be encoded.
+	*/
+	struct Image {
+		std::vector<uint8_t> pixels; //< RGBA pixels.
+		uint32_t width = 0, height = 0;
+		bool bottom_up = false; //< Whether the rows are from the bottom, as OpenGL reads them.
+		std::string path;
+	};
+
+	bool screenshot_wanted = false;
+	std::string sequence_name; //< Name of the sequence being captured. Empty if none.
+	double interval = 0; //< Seconds between 2 images of the sequence.
+	std::chrono::steady_clock::time_point next_capture; //< When the next image of the sequence is due.
+	uint32_t n_sequence = 0; //< Images of the sequence captured so far, the number of the next one.
+	uint32_t n_dropped = 0; //< Images of the sequence dropped as the worker couldn't keep up.
+
+	#if OPENGL_INCLUDE_SUCCESS
+		GLuint pbo[2] = {0, 0}; //< Pixel buffer objects read into on alternate frames.
+		uint64_t pbo_size[2] = {0, 0};
+		Image reading[2]; //< Image being read into each pixel buffer object. Its path is empty if none.
+		uint8_t next_pbo = 0;
+		/**
+		* @brief Copies the pixels read into pbo[p], if any, and gives them to the worker.
+		*/
+		void collect(uint8_t p);
+	#else
+		sf::Texture texture;
+	#endif
+
+	std::mutex mutex;
+	std::condition_variable queued; //< Wakes the worker up.
+	std::deque<Image> queue; //< Protected by mutex.
+	std::vector<std::vector<uint8_t>> spare; //< Pixel arrays already encoded, reused for the next images. Protected by mutex.
+	bool running = true; //< Protected by mutex.
+	std::thread worker;
+
+	/**
+	* @brief Loop of the worker thread. It encodes the images queued, until the ScreenCapture is deleted.
+	*/
+	void encode_images();
+	/**
+	* @brief Gives image to the worker.
+	*/
+	void push(Image& image);
+	/**
+	* @return An array of size bytes, reusing one of spare if possible.
+	*/
+	std::vector<uint8_t> take_spare(size_t size);
+
+public :
+	/**
+	* @brief Constructor. Starts the worker thread.
+	*/
+	ScreenCapture();
+	/**
+	* @brief Encodes the images still read or queued, then stops the worker thread. The window's context must still exist.
+	*/
+	~ScreenCapture();
+
+	ScreenCapture(const ScreenCapture&) = delete;
+	ScreenCapture& operator=(const ScreenCapture&) = delete;
+
+	/**
+	* @brief The next frame will be saved as result_images/screenshot.png .
+	*/
+	inline void screenshot() {screenshot_wanted = true;};
+	/**
+	* @brief Starts saving an image every interval_ seconds, as result_images/<name>-<number>.png .
+	*/
+	void start_sequence(std::string name, double interval_);
+	/**
+	* @brief Stops the sequence and prints how many images it saved.
+	*/
+	void stop_sequence();
+	inline bool isSequencing() const {return !sequence_name.empty();};
+
+	/**
+	* @brief To call once a frame is drawn, before it is displayed. Reads it if an image is due, and gives the previous frame read to the worker.
+	*/
+	void frame(sf::RenderWindow& window);
+};
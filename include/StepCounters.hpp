@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+/**
+* What happened during a simulation step : how much work the collisions, Segments and Zones took, what went wrong, and how long each thread waited for the others.
+* It is meant to choose cellSize, cs or dt from data rather than by eye.
+* @details Each thread counts in its own StepCounters (@see local), which the simulator sums at the barrier between 2 steps.
+*/
+struct alignas(64) StepCounters {
+	uint64_t pp_candidates = 0; //< Pairs of Particles whose distance was computed.
+	uint64_t pp_contacts[4] = {0, 0, 0, 0}; //< Pairs of Particles close enough to interact, for each Particle_simulator::pp_collision_t.
+	uint64_t cell_overflows = 0; //< Particles that couldn't be stored in their Cell because it was full.
+	uint64_t seg_candidates = 0; //< Particle-Segment pairs tested.
+	uint64_t zone_hits = 0; //< Particles found in a Zone.
+	uint64_t nan_deletions = 0; //< Particles deleted by delete_NaNs.
+	uint64_t created = 0; //< Particles created.
+	uint64_t deleted = 0; //< Particles deleted, including nan_deletions.
+	uint64_t busy_ns = 0; //< Time spent working during the step.
+	uint64_t idle_ns = 0; //< Time spent waiting for the other threads during the step, pauses excluded.
+
+	/**
+	* @return The counters of the calling thread.
+	*/
+	static inline StepCounters& local() {
+		static thread_local StepCounters counters;
+		return counters;
+	};
+
+	inline void reset() {*this = StepCounters();};
+	inline StepCounters& operator+=(const StepCounters& other) {
+		pp_candidates += other.pp_candidates;
+		for (uint8_t i=0; i<4; i++) pp_contacts[i] += other.pp_contacts[i];
+		cell_overflows += other.cell_overflows;
+		seg_candidates += other.seg_candidates;
+		zone_hits += other.zone_hits;
+		nan_deletions += other.nan_deletions;
+		created += other.created;
+		deleted += other.deleted;
+		busy_ns += other.busy_ns;
+		idle_ns += other.idle_ns;
+		return *this;
+	};
+	inline uint64_t contacts() const {return pp_contacts[0] + pp_contacts[1] + pp_contacts[2] + pp_contacts[3];};
+	/**
+	* @return The fraction of the threads' time spent waiting, or 0 if nothing was timed.
+	*/
+	inline float imbalance() const {return busy_ns + idle_ns ? (float)idle_ns / (busy_ns + idle_ns) : 0;};
+
+	/**
+	* @brief Writes the names of the columns written by write_csv.
+	*/
+	static inline void write_csv_header(std::ostream& os) {
+		os << "pp_candidates,contacts_base,contacts_tlev,contacts_phyacc,contacts_coherent,cell_overflows,seg_candidates,zone_hits,nan_deletions,created,deleted,busy_ns,idle_ns";
+	};
+	inline void write_csv(std::ostream& os) const {
+		os << pp_candidates << ',' << pp_contacts[0] << ',' << pp_contacts[1] << ',' << pp_contacts[2] << ',' << pp_contacts[3] << ','
+			<< cell_overflows << ',' << seg_candidates << ',' << zone_hits << ',' << nan_deletions << ',' << created << ',' << deleted << ','
+			<< busy_ns << ',' << idle_ns;
+	};
+};
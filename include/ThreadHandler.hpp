@@ -15,6 +15,8 @@ private :
 	std::atomic_uint32_t* reached_work = nullptr; //< Used by load_repartition so each thread know where to start its work.
 	pthread_mutex_t sync_mutex = PTHREAD_MUTEX_INITIALIZER;
 	pthread_cond_t sync_condition = PTHREAD_COND_INITIALIZER;
+	pthread_mutex_t park_mutex = PTHREAD_MUTEX_INITIALIZER;
+	pthread_cond_t park_condition = PTHREAD_COND_INITIALIZER;
 
 public :
 	~ThreadHandler();
@@ -101,6 +103,19 @@ public :
 	*/
 	template<typename T>
 	inline void synchronize_last(uint8_t n2synchronize, uint8_t max_wait_sec, T* obj, void (T::*unique_work)(void));
+
+	/**
+	* @brief Makes the calling thread sleep until (obj->*condition)(th_id) is true.
+	* @details The thread doesn't use the CPU while parked. The condition is checked again each time wake_parked is called.
+	*/
+	template<typename T>
+	void park_until(T* obj, bool (T::*condition)(uint8_t), uint8_t th_id);
+
+	/**
+	* @brief Wakes every parked thread so they check their condition.
+	* @details Call this after something that could make the condition of a parked thread true.
+	*/
+	void wake_parked();
 };
 
 
@@ -151,4 +166,14 @@ void ThreadHandler::synchronize_first(uint8_t n2synchronize, uint8_t max_wait_se
 template<typename T>
 void ThreadHandler::synchronize_last(uint8_t n2synchronize, uint8_t max_wait_sec, T* obj, void (T::*unique_work)(void)) {
 	synchronize_internal(n2synchronize, max_wait_sec, obj, unique_work, false, true);
-};
\ No newline at end of file
+};
+
+
+template<typename T>
+void ThreadHandler::park_until(T* obj, bool (T::*condition)(uint8_t), uint8_t th_id) {
+	pthread_mutex_lock(&park_mutex);
+	while (!(obj->*condition)(th_id)) {
+		pthread_cond_wait(&park_condition, &park_mutex);
+	}
+	pthread_mutex_unlock(&park_mutex);
+}
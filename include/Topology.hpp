@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+* Describes the logical CPUs of the machine and how they are grouped in cores, packages (sockets) and NUMA nodes.
+* On Linux the topology is read from /sys/devices/system/ . Elsewhere, or if /sys can't be read, every CPU is considered as its own core on a single node.
+* Only the CPUs the process is allowed to run on are kept.
+*/
+class Topology {
+public :
+	/**
+	* How threads are given a CPU.
+	* COMPACT fills the physical cores of a node before their hyper-threads and before the next node. Threads working on neighbouring data stay close.
+	* SCATTER spreads the threads across nodes first, then across physical cores. It maximizes the memory bandwidth and cache available.
+	*/
+	enum class pinning_t : uint8_t {NONE = 0, COMPACT, SCATTER};
+
+	struct CPU {
+		uint16_t id; //< Logical CPU number, as used by the OS.
+		uint16_t core; //< Physical core id inside its package.
+		uint16_t package; //< Physical package (socket) id.
+		uint16_t node; //< NUMA node.
+		uint8_t smt; //< Rank of this CPU among the hyper-threads of its core.
+	};
+
+private :
+	std::vector<CPU> cpus;
+	std::vector<uint16_t> compact_order; //< Indices in cpus, in the order threads are given to them with pinning_t::COMPACT.
+	std::vector<uint16_t> scatter_order; //< Indices in cpus, in the order threads are given to them with pinning_t::SCATTER.
+	uint16_t n_cores = 0;
+	uint16_t n_nodes = 1;
+
+	/**
+	* @brief Reads a /sys file containing a single integer.
+	* @return The integer read, or fallback if the file couldn't be read.
+	*/
+	static int32_t read_sys_int(const std::string& path, int32_t fallback);
+	/**
+	* @brief Parses a CPU list such as "0-3,8,10-11".
+	*/
+	static std::vector<uint16_t> parse_cpu_list(const std::string& list);
+
+public :
+	/**
+	* @brief Constructor. Detects the topology of the machine.
+	*/
+	Topology();
+
+	inline uint16_t getNbCPUs() const {return cpus.size();};
+	inline uint16_t getNbCores() const {return n_cores;};
+	inline uint16_t getNbNodes() const {return n_nodes;};
+	inline const CPU& getCPU(uint16_t i) const {return cpus[i];};
+
+	/**
+	* @brief Chooses the CPU the thread th_id should run on.
+	* @details When there are more threads than CPUs, the threads are given CPUs again from the start of the order.
+	* @return The CPU (in the OS numbering) or -1 if policy is NONE.
+	*/
+	int32_t cpu_for_thread(uint16_t th_id, pinning_t policy) const;
+
+	/**
+	* @brief Restricts the calling thread to the CPU cpu_id.
+	* @return Whether the thread could be pinned. Pinning is only supported on Linux.
+	*/
+	static bool pin_current_thread(int32_t cpu_id);
+
+	/**
+	* @brief Gives back to the OS the pages entirely inside [data, data+byte_size[ .
+	* @details The memory stays valid. Its next read or write gets a zero-filled page, allocated on the NUMA node of the thread touching it first.
+	* Does nothing if not on Linux.
+	* @warning The content of the memory is lost (i.e. set to 0).
+	*/
+	static void release_pages(void* data, size_t byte_size);
+
+	void print() const;
+};
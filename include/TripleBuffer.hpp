@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+* Hands values of T from one writing thread to one reading thread without locking, the reader always getting the latest complete value.
+* There are 3 slots : the writer fills the back one, the reader reads the front one, and the third one is shared between them.
+* Publishing swaps the back and shared slots, acquiring swaps the front and shared slots if a new value was published since.
+* @details Neither thread ever waits for the other : a value published while the reader is busy replaces the previous unread one, which the writer fills again.
+* The slots are never copied, so they can hold large buffers that keep their memory.
+*/
+template<typename T>
+class TripleBuffer {
+private :
+	static constexpr uint8_t INDEX = 3; //< Bits of shared giving the index of the shared slot.
+	static constexpr uint8_t FRESH = 4; //< Bit of shared set when the shared slot holds a value the reader hasn't acquired yet.
+
+	T slots[3];
+	uint8_t back = 0; //< Slot of the writer.
+	uint8_t front = 1; //< Slot of the reader.
+	alignas(64) std::atomic<uint8_t> shared{2};
+
+public :
+	TripleBuffer() = default;
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	/**
+	* @return The slot the writer fills. Only the writer may use it, until the next publish.
+	*/
+	inline T& write_slot() {return slots[back];};
+	/**
+	* @brief Gives the back slot to the reader and takes another one to fill next. Only called by the writer.
+	*/
+	inline void publish() {
+		back = shared.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+	};
+
+	/**
+	* @brief Takes the latest published value if the reader doesn't have it yet. Only called by the reader.
+	* @return Whether a new value was acquired. Otherwise read_slot still holds the previous one.
+	*/
+	inline bool acquire() {
+		if (!(shared.load(std::memory_order_relaxed) & FRESH)) return false;
+		front = shared.exchange(front, std::memory_order_acq_rel) & INDEX;
+		return true;
+	};
+	/**
+	* @return The slot of the reader. Only the reader may use it, until the next acquire.
+	*/
+	inline const T& read_slot() const {return slots[front];};
+};
@@ -2,6 +2,7 @@
 
 #include "Particle.hpp"
 #include "Segment.hpp"
+#include "StepCounters.hpp"
 #include "Zone.hpp"
 
 #include <atomic>
@@ -67,14 +68,18 @@ private :
 	Cell_seg* grid_seg = nullptr; //< A grid for Segments, i.e. each Cell of this grid knows wether a Segment is going though it.
 	std::mutex grid_seg_mutex; //< A mutex locked before adding / removing / changing segments.
 
-	inline void giveCellPart(Cell& cell, uint32_t part);
-	inline void giveCellPart(uint16_t x, uint16_t y, uint32_t part);
+	/**
+	* @return false if the Cell was full, in which case part replaces one of its Particles.
+	*/
+	inline bool giveCellPart(Cell& cell, uint32_t part);
+	inline bool giveCellPart(uint16_t x, uint16_t y, uint32_t part);
 	inline void giveCellSeg(uint16_t x, uint16_t y, uint16_t seg);
 	        void remCellSeg(uint16_t x, uint16_t y, uint16_t seg);
 	inline void giveCellSeg(Cell_seg* cell, uint16_t seg);
 
 	std::vector<Zone> zones;
 	uint64_t zone_covered_cells = 0; //< The number of Cells in the grid that are covered by a Zone.
+	uint32_t seg_overflows = 0; //< Number of times a Segment couldn't be stored in a Cell of grid_seg because it was full, since grid_seg was filled.
 
 public:
 	std::atomic_uint64_t n_cell_seg = 0; //< Number of Cells with a Segment.
@@ -90,6 +95,16 @@ public:
 	inline float getSize(bool xy) const {return params.size[xy];};
 	inline uint16_t getGridSize(bool xy) const {return gridSize[xy];};
 	inline float getCellSize(bool xy) const {return params.cellSize[xy];};
+	/**
+	* @brief Changes the size of the Cells, then reallocates the grid and puts the Segments and Zones back in it.
+	* @details The Zones keep their position in the world. Use fits_cell_size first to know if they will.
+	* @warning The grid must not be used by any other thread during the change (e.g. by the simulation or a Renderer). The grid is left empty.
+	*/
+	void set_cell_size(const float cellSize[2]);
+	/**
+	* @return Whether every Zone border is on a Cell border of a grid with Cells of size cellSize, so set_cell_size wouldn't move the Zones.
+	*/
+	bool fits_cell_size(const float cellSize[2]);
 	
 	inline Cell& getCell(uint16_t x, uint16_t y) {return grid[y*gridSize[0] +x];};
 	inline Cell* getCell_ptr(uint16_t x, uint16_t y) {return &grid[y*gridSize[0] +x];};
@@ -123,6 +138,10 @@ public:
 	void add_zone(int8_t function, float posX, float posY, float sizeX, float sizeY);
 	inline uint16_t getNbOfZones() {return zones.size();};
 	inline uint64_t getNZoneCoveredCells() {return zone_covered_cells;};
+	/**
+	* @return Whether some Segments are missing from grid_seg because their Cells already had MAX_SEG_CELL Segments. Always false if the Segments store their Cells.
+	*/
+	inline bool seg_grid_overflows() {return segments_in_grid && seg_overflows;};
 	inline Zone& getZone(uint16_t z) {return zones[z];};
 
 	/**
@@ -131,7 +150,16 @@ public:
 	*/
 	void update_grid_particle_contenance(Particle* particle_array, uint32_t p_start, uint32_t p_end, float dt);
 
+	/**
+	* @brief Chooses how the grid will be emptied for at most max_n Particles. @see set_emptying_mode
+	* @return Whether the grid will be emptied blindly.
+	*/
 	bool will_use_nParticles(uint32_t max_n);
+	/**
+	* @brief Sets whether the grid is emptied blindly or by using the Particles' position. In the latter case, filled_coords is allocated for max_n Particles.
+	* @warning Only call this while the grid is empty.
+	*/
+	void set_emptying_mode(bool blind, uint32_t max_n);
 
 	/**
 	* @brief Call this function before call empty_grid_particle_blind/pbased to know whether the world needs to be emptied blindly or using the particles position.
@@ -186,6 +214,10 @@ public:
 	* @param nb_parts The number of Particles currently used in the simulation (for collisions with Segments). 
 	*/
 	void chg_seg_store_sys(uint32_t nb_parts=0);
+	/**
+	* @brief Stores the Segment-Cell relations in grid_seg if in_grid, otherwise in the Segments. Does nothing if already stored this way.
+	*/
+	void set_seg_store_sys(bool in_grid);
 
 
 	inline bool gsm_trylock() {return grid_seg_mutex.try_lock();};
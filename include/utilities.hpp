@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 
@@ -14,6 +15,16 @@ template<> inline void print_vect<int8_t>(std::string name, int8_t vect[2]) {
 	std::cout << name << " [" << (short)vect[0] << ", " << (short)vect[1] << "]" << std::endl;
 }
 
+/**
+* @brief Hashes x into 64 bits that look random (the output function of splitmix64). Close values of x give unrelated results.
+*/
+inline uint64_t mix64(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
 inline std::string b2s(bool b) {return b ? "true" : "false";}
 
 inline std::string i2s(unsigned long number) {
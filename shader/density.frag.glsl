@@ -0,0 +1,11 @@
+#version 460 core
+in vec2 vertexTexCoord;
+
+out vec4 FragColor;
+
+uniform sampler2D density; // Colour and opacity of each pixel, made on the CPU.
+
+void main()
+{
+	FragColor = texture(density, vertexTexCoord);
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 460 core
+layout (location = 0) in vec2 pos; // World position of a corner of the density image.
+layout (location = 1) in vec2 texCoord; // Position of this corner in the image.
+
+out vec2 vertexTexCoord;
+
+uniform mat4 modelViewMat; // All the projection matrices.
+
+void main()
+{
+	gl_Position = modelViewMat * vec4(pos, 0.0, 1.0);
+	vertexTexCoord = texCoord;
+}
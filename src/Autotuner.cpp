@@ -0,0 +1,132 @@
+#include "Autotuner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+void Autotuner::add_setting(const std::string& name, const std::vector<float>& candidates, const std::vector<std::string>& labels, uint8_t initial,
+                            std::function<void(float)> apply, std::function<bool()> equivalent) {
+	if (candidates.size() < 2 || initial >= candidates.size()) return;
+	Setting s;
+	s.name = name;
+	s.candidates = candidates;
+	s.labels = labels;
+	for (size_t c=s.labels.size(); c<candidates.size(); c++) {
+		std::ostringstream label;
+		label << candidates[c];
+		s.labels.push_back(label.str());
+	}
+	s.initial = initial;
+	s.best = initial;
+	s.apply = apply;
+	s.equivalent = equivalent;
+	settings.push_back(s);
+}
+
+void Autotuner::clear() {
+	settings.clear();
+	running = false;
+	finished = false;
+}
+
+bool Autotuner::start() {
+	finished = false;
+	if (settings.empty()) return false;
+	for (Setting& s : settings) {
+		s.cost.assign(s.candidates.size(), INFINITY);
+		s.rejected.assign(s.candidates.size(), false);
+		s.best = s.initial;
+	}
+	running = true;
+	setting = 0;
+	start_setting();
+	return true;
+}
+
+void Autotuner::stop() {
+	if (!running) return;
+	Setting& s = settings[setting];
+	s.best = s.initial;
+	s.apply(s.candidates[s.initial]);
+	running = false;
+	std::cout << "Autotuning stopped, " << s.name << " is back to " << s.labels[s.initial] << std::endl;
+}
+
+void Autotuner::start_setting() {
+	trial = -1;
+	round = 0;
+	next_trial();
+}
+
+void Autotuner::next_trial() {
+	Setting& s = settings[setting];
+	int16_t n = s.candidates.size();
+	do {
+		if (++trial >= n) {
+			trial = 0;
+			round++;
+		}
+		if (round >= ROUNDS) {
+			end_setting();
+			return;
+		}
+		candidate = (s.initial + trial) % n; // Starting with the initial candidate, which is already applied
+	} while (s.rejected[candidate]);
+
+	s.apply(s.candidates[candidate]);
+	steps = 0;
+	window_ns = 0;
+	window_part_steps = 0;
+}
+
+void Autotuner::end_setting() {
+	Setting& s = settings[setting];
+	uint8_t fastest = s.initial;
+	for (uint8_t c=0; c<s.candidates.size(); c++) {
+		if (!s.rejected[c] && s.cost[c] < s.cost[fastest]) fastest = c;
+	}
+	s.best = s.cost[fastest] < (1-MARGIN)*s.cost[s.initial] ? fastest : s.initial;
+	s.apply(s.candidates[s.best]);
+	std::cout << "Autotuning " << s.name << " : " << s.labels[s.best];
+	if (s.best != s.initial) std::cout << " instead of " << s.labels[s.initial] << " (" << 100*(1 - s.cost[s.best]/s.cost[s.initial]) << "% faster)";
+	else std::cout << " kept";
+	std::cout << std::endl;
+
+	if (++setting >= settings.size()) {
+		running = false;
+		finished = true;
+	}
+	else start_setting();
+}
+
+void Autotuner::measure(uint64_t step_ns, uint32_t n_parts) {
+	if (!running) return;
+	Setting& s = settings[setting];
+	if (candidate != s.initial && s.equivalent && !s.equivalent()) {
+		s.rejected[candidate] = true;
+		next_trial();
+		return;
+	}
+	if (++steps <= WARMUP) return;
+	window_ns += step_ns;
+	window_part_steps += n_parts;
+	if (steps < WARMUP + WINDOW) return;
+
+	s.cost[candidate] = std::min(s.cost[candidate], (float)window_ns / std::max(window_part_steps, (uint64_t)1));
+	next_trial();
+}
+
+void Autotuner::print_results() const {
+	for (uint8_t i=0; i<settings.size(); i++) {
+		const Setting& s = settings[i];
+		if (!finished && i >= setting) break; // Not tuned yet
+		std::cout << "\t" << s.name << " :";
+		for (uint8_t c=0; c<s.candidates.size(); c++) {
+			std::cout << "  " << s.labels[c] << (c == s.best ? "*" : "") << " ";
+			if (s.rejected[c]) std::cout << "(not equivalent)";
+			else std::cout << "(" << s.cost[c] << " ns/particle)";
+		}
+		std::cout << std::endl;
+	}
+}
@@ -0,0 +1,52 @@
+#include "Checkpointer.hpp"
+#include "Particle_simulator.hpp"
+#include "SaveLoader.hpp"
+
+#include <chrono>
+#include <iostream>
+
+Checkpointer::Checkpointer(std::string name_, double period_, double start_time) : name(name_), period(period_), next_time(start_time + period_), state(new SimState) {
+	std::cout << "\tWriting a checkpoint every " << period << " simulated seconds as " << name << "-<step>" << std::endl;
+	writer = std::thread(&Checkpointer::write_checkpoints, this);
+}
+
+Checkpointer::~Checkpointer() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	full.notify_all();
+	writer.join();
+	delete state;
+}
+
+void Checkpointer::write_checkpoints() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		full.wait(lock, [this]() {return writing || !running;});
+		if (!writing) return; // The checkpoint submitted is written before stopping
+		lock.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		SaveLoader saver;
+		bool res = saver.saveCheckpoint(*state, SaveLoader::checkpointName(name, state->steps));
+		if (res) std::cout << "\tat " << state->time[0] << " s, in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+
+		lock.lock();
+		writing = false;
+	}
+}
+
+SimState* Checkpointer::acquire() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return writing ? nullptr : state;
+}
+
+void Checkpointer::submit(double time) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		writing = true;
+		next_time = time + period;
+	}
+	full.notify_all();
+}
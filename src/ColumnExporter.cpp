@@ -0,0 +1,112 @@
+#include "ColumnExporter.hpp"
+#include "SaveLoader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+void ColumnChunk::clear(uint64_t first_frame_) {
+	first_frame = first_frame_;
+	time.clear();
+	start.assign(1, 0);
+	id.clear();
+	x.clear();
+	y.clear();
+	vx.clear();
+	vy.clear();
+	speed.clear();
+	cell.clear();
+}
+
+void ColumnChunk::append(const Particle* particles, uint32_t n_parts, double frame_time, const uint32_t* ids, const ColumnLayout& layout) {
+	if (start.empty()) start.push_back(0);
+	time.push_back(frame_time);
+	start.push_back(start.back() + n_parts);
+	for (uint32_t p=0; p<n_parts; p++) {
+		const Particle& part = particles[p];
+		id.push_back(ids ? ids[p] : p);
+		x.push_back(part.position[0]);
+		y.push_back(part.position[1]);
+		if (layout.speeds) {
+			vx.push_back(part.speed[0]);
+			vy.push_back(part.speed[1]);
+		}
+		if (layout.speed_norm) speed.push_back(std::hypot(part.speed[0], part.speed[1]));
+		if (layout.hasCells()) {
+			uint16_t cx = std::min(std::max(part.position[0] / layout.cell_size[0], 0.f), (float)layout.grid_size[0]-1);
+			uint16_t cy = std::min(std::max(part.position[1] / layout.cell_size[1], 0.f), (float)layout.grid_size[1]-1);
+			cell.push_back((uint32_t)cy*layout.grid_size[0] + cx);
+		}
+	}
+}
+
+
+ColumnExporter::ColumnExporter(std::string name_, ColumnLayout layout_, uint32_t max_particles, uint32_t chunk_frames_, double min_delta_time_)
+	: name(name_), layout(layout_), chunk_frames(std::max(chunk_frames_, 1u)), min_delta_time(min_delta_time_) {
+	uint64_t rows = (uint64_t)chunk_frames*max_particles;
+	for (ColumnChunk& chunk : chunks) {
+		chunk.id.reserve(rows);
+		chunk.x.reserve(rows);
+		chunk.y.reserve(rows);
+		if (layout.speeds) {
+			chunk.vx.reserve(rows);
+			chunk.vy.reserve(rows);
+		}
+		if (layout.speed_norm) chunk.speed.reserve(rows);
+		if (layout.hasCells()) chunk.cell.reserve(rows);
+	}
+	chunks[filling].clear(0);
+	std::cout << "\tExporting columns in chunks of " << chunk_frames << " frames as " << name << "-<first frame>" << std::endl;
+	writer = std::thread(&ColumnExporter::write_chunks, this);
+}
+
+ColumnExporter::~ColumnExporter() {
+	if (chunks[filling].frames()) submit();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	full.notify_all();
+	writer.join();
+	if (stall_s > 0) std::cout << "Column export : the simulation waited " << stall_s << " s for the disk" << std::endl;
+}
+
+void ColumnExporter::write_chunks() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		full.wait(lock, [this]() {return writing || !running;});
+		if (!writing) return; // The chunk submitted is written before stopping
+		ColumnChunk& chunk = chunks[1-filling];
+		lock.unlock();
+
+		SaveLoader saver;
+		saver.saveColumns(chunk, SaveLoader::columnsName(name, chunk.first_frame));
+
+		lock.lock();
+		writing = false;
+		written.notify_all();
+	}
+}
+
+void ColumnExporter::submit() {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (writing) {
+		auto stall_start = std::chrono::steady_clock::now();
+		written.wait(lock, [this]() {return !writing;});
+		stall_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - stall_start).count();
+	}
+	filling = 1-filling;
+	chunks[filling].clear(n_frames);
+	writing = true;
+	full.notify_all();
+}
+
+bool ColumnExporter::record(const Particle* particle_array, uint32_t part_arr_size, double time, const uint32_t* ids) {
+	if (time - time_of_last_record < min_delta_time) return false;
+	time_of_last_record = time;
+
+	chunks[filling].append(particle_array, part_arr_size, time, ids, layout);
+	n_frames++;
+	if (chunks[filling].frames() >= chunk_frames) submit();
+	return true;
+}
@@ -0,0 +1,127 @@
+#include "DensityImage.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+DensityImage::DensityImage() {
+	uint32_t n_threads = std::max(std::thread::hardware_concurrency()/2, 1u) - 1; // The calling thread works too
+	counts.resize(n_threads+1);
+	speeds.resize(n_threads+1);
+	thread_max.resize(n_threads+1);
+	for (uint32_t t=0; t<n_threads; t++) threads.emplace_back(&DensityImage::help, this, t+1);
+}
+
+DensityImage::~DensityImage() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	work.notify_all();
+	for (std::thread& thread : threads) thread.join();
+}
+
+void DensityImage::help(uint8_t th_id) {
+	uint64_t seen = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		work.wait(lock, [&]() {return !running || generation != seen;});
+		if (!running) return;
+		seen = generation;
+		if (th_id >= job_threads) continue; // Not needed for this job
+		lock.unlock();
+
+		(this->*job)(th_id, job_threads);
+
+		lock.lock();
+		if (!--n_working) done.notify_all();
+	}
+}
+
+void DensityImage::run(void (DensityImage::*job_)(uint8_t, uint8_t), uint8_t n_threads) {
+	if (n_threads <= 1) {
+		(this->*job_)(0, 1);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = job_;
+		job_threads = n_threads;
+		n_working = n_threads-1;
+		generation++;
+	}
+	work.notify_all();
+	(this->*job_)(0, n_threads);
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() {return !n_working;});
+}
+
+void DensityImage::update(const Particle* particles_, uint32_t n_parts_, uint32_t width_, const float rect_[2][2], float max_speed_, bool speed_colour_) {
+	particles = particles_;
+	n_parts = n_parts_;
+	max_speed = max_speed_ > 0 ? max_speed_ : 1;
+	speed_colour = speed_colour_;
+	for (uint8_t c=0; c<2; c++) {
+		for (uint8_t d=0; d<2; d++) rect[c][d] = rect_[c][d];
+	}
+	float world_width = rect[1][0] - rect[0][0];
+	float world_height = rect[1][1] - rect[0][1];
+	width = std::max(width_, 1u);
+	height = world_width > 0 ? std::max((uint32_t)std::lround(width * world_height / world_width), 1u) : 1;
+	pixels.resize((size_t)width*height*4);
+
+	uint8_t n_threads = n_parts < MIN_PARALLEL ? 1 : counts.size();
+	for (uint8_t t=0; t<n_threads; t++) {
+		counts[t].resize((size_t)width*height);
+		speeds[t].resize((size_t)width*height);
+	}
+	run(&DensityImage::bin, n_threads);
+	std::fill(thread_max.begin(), thread_max.end(), 0);
+	run(&DensityImage::colour, n_threads);
+	max_count = std::max(*std::max_element(thread_max.begin(), thread_max.end()), 1u);
+}
+
+void DensityImage::bin(uint8_t th_id, uint8_t n_threads) {
+	std::vector<uint32_t>& count = counts[th_id];
+	std::vector<float>& speed = speeds[th_id];
+	std::fill(count.begin(), count.end(), 0);
+	std::fill(speed.begin(), speed.end(), 0.f);
+	float scale = width / (rect[1][0] - rect[0][0]);
+	uint32_t start = (uint64_t)n_parts* th_id   /n_threads;
+	uint32_t end =   (uint64_t)n_parts*(th_id+1)/n_threads;
+	for (uint32_t p=start; p<end; p++) {
+		const Particle& part = particles[p];
+		float x = (part.position[0] - rect[0][0]) * scale;
+		float y = (part.position[1] - rect[0][1]) * scale;
+		if (!(x >= 0 && x < width && y >= 0 && y < height)) continue; // Also skips NaNs
+		size_t pixel = (size_t)y*width + (uint32_t)x;
+		count[pixel]++;
+		speed[pixel] += std::sqrt(part.speed[0]*part.speed[0] + part.speed[1]*part.speed[1]);
+	}
+}
+
+void DensityImage::colour(uint8_t th_id, uint8_t n_threads) {
+	float inv_log_max = 1 / std::log1p((float)max_count);
+	uint32_t fullest = 0;
+	uint32_t row_start = (uint64_t)height* th_id   /n_threads;
+	uint32_t row_end =   (uint64_t)height*(th_id+1)/n_threads;
+	for (size_t pixel = (size_t)row_start*width; pixel < (size_t)row_end*width; pixel++) {
+		uint32_t count = 0;
+		float speed = 0;
+		for (uint8_t t=0; t<n_threads; t++) { // As many images as threads binning
+			count += counts[t][pixel];
+			speed += speeds[t][pixel];
+		}
+		fullest = std::max(fullest, count);
+		uint8_t* rgba = &pixels[4*pixel];
+		if (!count) {
+			rgba[0] = rgba[1] = rgba[2] = rgba[3] = 0;
+			continue;
+		}
+		float ratio = speed_colour ? speed / count / max_speed : 8; // The same colours as the Particles, white otherwise
+		rgba[0] = 255 * std::min(ratio, 1.f);
+		rgba[1] = 255 * std::min(ratio/4, 1.f);
+		rgba[2] = 255 * std::min(ratio/8, 1.f);
+		rgba[3] = 255 * std::min(std::log1p((float)count) * inv_log_max, 1.f);
+	}
+	thread_max[th_id] = fullest;
+}
@@ -26,6 +26,11 @@ FileHandler::~FileHandler() {
 }
 
 
+std::string FileHandler::getSaveFolder() {
+	return SAVE_FOLDER;
+}
+
+
 bool FileHandler::prepareForSaving(uint32_t max_size_saving, ByteSize size_type, FullFileName fileName, bool binary) {
 	max_writable_size = (uint64_t)max_size_saving * size_type;
 	file_in_binary = binary;
@@ -40,6 +45,7 @@ bool FileHandler::prepareForSaving(uint32_t max_size_saving, ByteSize size_type,
 		oss << SAVE_FOLDER << fileName.getCompleted();
 	}
 	std::string name = oss.str();
+	file_path = name;
 
 	if (binary) file.open(name, std::ios::out | std::ios::trunc | std::ios::binary);
 	else        file.open(name, std::ios::out | std::ios::trunc);
@@ -83,7 +89,8 @@ bool FileHandler::prepareForLoading(FullFileName fileName) {
 		fileName.directory = "";
 		fileName.extension = "";
 	}
-	file.open(fileName.getCompleted(), std::ios::in | std::ios::binary);
+	file_path = fileName.getCompleted();
+	file.open(file_path, std::ios::in | std::ios::binary);
 	
 	if (file.is_open()) {
 		uint8_t bin_byte;
@@ -96,6 +103,61 @@ bool FileHandler::prepareForLoading(FullFileName fileName) {
 	}
 }
 
+bool FileHandler::replace_in_string(FullFileName fileName, const std::vector<std::pair<std::string, std::string>>& values) {
+	std::string name = SAVE_FOLDER + fileName.getCompleted();
+	std::ifstream in(name);
+	if (!in.is_open()) {
+		std::cout << "Failed opening file : " << name << std::endl;
+		return false;
+	}
+	std::vector<std::string> lines;
+	std::string line;
+	while (std::getline(in, line)) lines.push_back(line);
+	in.close();
+
+	std::vector<bool> found(values.size(), false);
+	size_t section_end = lines.size();
+	for (size_t l=0; l<lines.size(); l++) {
+		if (!lines[l].empty() && lines[l][0] == '^') { // Start of section 1
+			section_end = l;
+			break;
+		}
+		size_t equal = lines[l].find('=');
+		if (lines[l].empty() || lines[l][0] == '#' || equal == std::string::npos) continue;
+		for (size_t v=0; v<values.size(); v++) {
+			if (lines[l].compare(0, equal, values[v].first) != 0) continue;
+			size_t comment = lines[l].find('#', equal);
+			lines[l] = values[v].first + '=' + values[v].second + (comment == std::string::npos ? "" : ' ' + lines[l].substr(comment));
+			found[v] = true;
+		}
+	}
+	// Missing variables are added at the end of section 0, after its last non-empty line
+	while (section_end > 1 && lines[section_end-1].empty()) section_end--; // The first line is the byte telling the file is in text
+	for (size_t v=0; v<values.size(); v++) {
+		if (!found[v]) lines.insert(lines.begin() + section_end++, values[v].first + '=' + values[v].second);
+	}
+
+	std::ofstream out(name, std::ios::out | std::ios::trunc);
+	for (std::string& l : lines) out << l << '\n';
+	if (!out.good()) {
+		std::cout << "Failed writing file : " << name << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool FileHandler::overwrite(FullFileName fileName, size_t offset, void* obj, size_t byte_size_obj) {
+	std::string name = SAVE_FOLDER + fileName.getCompleted();
+	std::fstream out(name, std::ios::in | std::ios::out | std::ios::binary);
+	if (!out.is_open()) {
+		std::cout << "Failed opening file : " << name << std::endl;
+		return false;
+	}
+	out.seekp(1 + offset);
+	out.write((char*)obj, byte_size_obj);
+	return out.good();
+}
+
 void FileHandler::done() {
 	if (file.is_open())	file.close();
 }
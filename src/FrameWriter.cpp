@@ -0,0 +1,100 @@
+#include "FrameWriter.hpp"
+#include "FileHandler.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#define FRAME_FOL "Frames/"
+#define PPM_EXT ".ppm" // Binary Portable PixMap image
+#define RAW_EXT ".rgba" // Raw RGBA images one after the other
+
+FrameWriter::FrameWriter(std::string name_, uint32_t width_, uint32_t height_, format_t format_)
+	: name(name_), width(width_), height(height_), format(format_) {
+	std::error_code error;
+	std::filesystem::create_directories(FileHandler::getSaveFolder() + FRAME_FOL, error);
+	for (std::vector<uint8_t>& image : images) image.resize((size_t)width*height*4);
+	if (format == format_t::RAW) {
+		stream.open(FileHandler::getSaveFolder() + FRAME_FOL + name + RAW_EXT, std::ios::out | std::ios::trunc | std::ios::binary);
+		failed = !stream.is_open();
+		if (failed) std::cout << "Failed opening file : " << FileHandler::getSaveFolder() << FRAME_FOL << name << RAW_EXT << std::endl;
+	}
+	writer = std::thread(&FrameWriter::write_frames, this);
+}
+
+FrameWriter::~FrameWriter() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	full.notify_all();
+	writer.join();
+}
+
+void FrameWriter::write_frames() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		full.wait(lock, [this]() {return writing || !running;});
+		if (!writing) return; // The image submitted is written before stopping
+		const std::vector<uint8_t>& image = images[1-filling];
+		uint32_t frame = n_frames-1;
+		lock.unlock();
+
+		bool res = write(image, frame);
+
+		lock.lock();
+		failed |= !res;
+		writing = false;
+		written.notify_all();
+	}
+}
+
+bool FrameWriter::write(const std::vector<uint8_t>& image, uint32_t frame) {
+	if (format == format_t::RAW) {
+		stream.write((const char*)image.data(), image.size());
+		return stream.good();
+	}
+
+	std::ostringstream path;
+	path << FileHandler::getSaveFolder() << FRAME_FOL << name << '-' << std::setw(6) << std::setfill('0') << frame << PPM_EXT;
+	std::ofstream file(path.str(), std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Failed opening file : " << path.str() << std::endl;
+		return false;
+	}
+	file << "P6\n" << width << ' ' << height << "\n255\n";
+	std::vector<uint8_t> rgb(3*(size_t)width); // PPM has no alpha, which is always opaque anyway
+	for (uint32_t y=0; y<height; y++) {
+		const uint8_t* row = &image[4*(size_t)y*width];
+		for (uint32_t x=0; x<width; x++) {
+			for (uint8_t c=0; c<3; c++) rgb[3*x + c] = row[4*x + c];
+		}
+		file.write((const char*)rgb.data(), rgb.size());
+	}
+	return file.good();
+}
+
+bool FrameWriter::submit(const uint8_t* rgba) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (writing) {
+		auto stall_start = std::chrono::steady_clock::now();
+		written.wait(lock, [this]() {return !writing;});
+		stall_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - stall_start).count();
+	}
+	lock.unlock();
+	std::copy(rgba, rgba + images[filling].size(), images[filling].begin()); // The writer only reads the other image
+	lock.lock();
+	filling = 1-filling;
+	n_frames++;
+	writing = true;
+	full.notify_all();
+	return !failed;
+}
+
+void FrameWriter::print_stats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::cout << "Frame writer : " << n_frames << " frames of " << width << "x" << height << " written as " << FileHandler::getSaveFolder() << FRAME_FOL << name
+		<< (format == format_t::RAW ? RAW_EXT : "-<frame>" PPM_EXT) << (failed ? " (some failed)" : "") << ", waited " << stall_s << " s for the disk" << std::endl;
+}
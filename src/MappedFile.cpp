@@ -0,0 +1,67 @@
+#include "MappedFile.hpp"
+
+#include <algorithm>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& path) {
+	close();
+#ifdef MAPPED_FILE_MMAP
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat info;
+	if (fstat(fd, &info) || info.st_size <= 0) {
+		::close(fd);
+		return false;
+	}
+	void* mapping = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd); // The mapping keeps the file open
+	if (mapping == MAP_FAILED) return false;
+	bytes = (uint8_t*)mapping;
+	n_bytes = info.st_size;
+	return true;
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+void MappedFile::close() {
+#ifdef MAPPED_FILE_MMAP
+	if (bytes) munmap(bytes, n_bytes);
+#endif
+	bytes = nullptr;
+	n_bytes = 0;
+	sequential = false;
+}
+
+void MappedFile::advise_sequential(bool sequential_) {
+	if (!bytes || sequential == sequential_) return;
+	sequential = sequential_;
+#ifdef MAPPED_FILE_MMAP
+	madvise(bytes, n_bytes, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+#endif
+}
+
+void MappedFile::will_need(size_t offset, size_t length) {
+	if (!bytes || offset >= n_bytes) return;
+	length = std::min(length, n_bytes - offset);
+#ifdef MAPPED_FILE_MMAP
+	// madvise needs an address at the start of a page
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t start = offset - offset % page;
+	madvise(bytes + start, length + offset - start, MADV_WILLNEED);
+#else
+	(void)length;
+#endif
+}
@@ -3,10 +3,16 @@
 #include "utilities.hpp"
 
 #include <cmath>
+#include <algorithm>
 #include <cstdlib>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <thread>
 
+#define ELASTIC_WINDOW 64 // Number of steps over which a number of simulation threads is measured
+#define ELASTIC_MAX_AGE 32 // Number of windows after which a measure is outdated
+
 PSparam PSparam::Default {
 	Default.n_threads = 6,
 	Default.max_part = 24000,
@@ -53,10 +59,25 @@ PSparam PSparam::Default {
 	Default.pp_collision_fun = (uint8_t)Particle_simulator::pp_collision_t::BASE,
 	Default.ps_collision_fun = (uint8_t)Particle_simulator::ps_collision_t::BASE,
 	Default.world_border_fun = (uint8_t)Particle_simulator::world_border_t::BASE,
+
+	Default.decomposition = (uint8_t)Particle_simulator::decomposition_t::INDEX,
+	Default.rebalance_period = 500,
+	Default.pinning = (uint8_t)Topology::pinning_t::NONE,
+	Default.elastic_threads = true,
+
+	Default.quickstep_sps = 20,
+
+	Default.chunks_per_thread = 5,
+	Default.seg_storage = (uint8_t)Particle_simulator::seg_storage_t::AUTO,
+	Default.zone_comparison = (uint8_t)Particle_simulator::zone_comparison_t::AUTO,
 };
 
 
 
+const char* Particle_simulator::phase_names[(uint8_t)phase_t::NB_PHASES] = {
+	"synchronization", "migration", "grid filling", "forces", "pp collisions", "ps collisions", "borders", "zones", "position update", "grid emptying"
+};
+
 
 Particle_simulator::Particle_simulator(World& world_, PSparam& parameters, SLinfoPos SLI_) : world(world_), SLI(SLI_) {
 	std::cout << "Particle_simulator::Particle_simulator()" << std::endl;
@@ -66,23 +87,50 @@ Particle_simulator::Particle_simulator(World& world_, PSparam& parameters, SLinf
 	parameters.pp_energy_conservation = std::max(parameters.pp_energy_conservation, 0.5f); // Below 0.5 this causes some calculations to NaN the Particles.
 	setParameters(parameters);
 	nb_max_part = parameters.max_part;
-	used_n_threads = parameters.n_threads;
+	used_n_threads = parameters.n_threads ? parameters.n_threads : topology.getNbCores();
+	topology.print();
 	particle_array.reserve(nb_max_part);
 	particle_array.resize(nb_max_part);
+	if (params.pinning != (uint8_t)Topology::pinning_t::NONE) first_touch(particle_array, true);
+	part_id.resize(nb_max_part);
+	id_index.resize(nb_max_part);
+	free_ids.resize(nb_max_part);
+	rng_seed = ((uint64_t)rand() << 32) ^ rand();
 	initialize_particles();
+	if (SLI.isLoadCheckpoint()) {
+		SaveLoader loader;
+		SimState state;
+		if (loader.loadCheckpoint(state, SaveLoader::checkpointName(SLI.checkpointName(), SLI.checkpoint_step)) >= 0) restore_state(state);
+	}
 
-	world.chg_seg_store_sys(nb_active_part);
+	choose_seg_storage();
 
+	double save_interval = params.dt * (SLI.save_every > 1 ? SLI.save_every - 0.5 : 1); // Half a step short, so rounding errors on the time don't delay a save by a step
 	if (SLI.isSavePos() || SLI.isLoadPos()) {
 		partLoader = new SaveLoader;
 		if (SLI.isSavePos()) {
-			partLoader->prepareSavePos(30, FileHandler::GB, SLI, nb_max_part, world, params.dt);
+			partLoader->prepareSavePos(30, FileHandler::GB, SLI, nb_max_part, world, save_interval);
+			recorder = new PosRecorder(*partLoader, nb_max_part, save_interval, SLI.isDropFrames() ? PosRecorder::policy_t::DROP : PosRecorder::policy_t::WAIT);
 		}
 		if (SLI.isLoadPos()) {
 			conso.start_perf_check("loading time", 10000);
 			partLoader->prepareLoadPos(nb_max_part, SLI);
+			if (SLI.isInterpolated()) interpolator = new ReplayInterpolator(nb_max_part, partLoader->getPosIdBound(), !partLoader->getCompression().isCompOutSpeed());
+			if (!partLoader->isPosInPlace()) reader = new PosReader(*partLoader, nb_max_part, interpolator ? 2 : 1); // Otherwise there is nothing to decode
 		}
 	}
+	if (SLI.isSaveCheckpoint() && !SLI.isLoadPos()) checkpointer = new Checkpointer(SLI.checkpointName(), SLI.checkpoint_period, time[0]);
+	if (SLI.isExportColumns() && !SLI.isLoadPos()) {
+		ColumnLayout layout;
+		if (SLI.export_diagnostics) {
+			layout.speed_norm = true;
+			for (uint8_t d=0; d<2; d++) {
+				layout.cell_size[d] = world.getCellSize(d);
+				layout.grid_size[d] = world.getGridSize(d);
+			}
+		}
+		exporter = new ColumnExporter(SLI.posName(), layout, nb_max_part, SLI.export_chunk ? SLI.export_chunk : DEFAULT_EXPORT_CHUNK, save_interval);
+	}
 
 	std::cout << "\t" << i2s(world.n_cell_seg) << " cells with a segment" << std::endl;
 	std::cout << "\t" << i2s(nb_max_part) << " particles" << std::endl;
@@ -96,6 +144,11 @@ Particle_simulator::~Particle_simulator() {
 	simulate = false;
 	stop_simulation_threads();
 
+	if (recorder) delete recorder; // Writes the frames still waiting before the file is closed
+	if (checkpointer) delete checkpointer; // Same for the checkpoint being written
+	if (exporter) delete exporter; // And the last chunk of columns
+	if (reader) delete reader;
+	if (interpolator) delete interpolator;
 	if (partLoader) delete partLoader;
 }
 
@@ -161,6 +214,131 @@ void Particle_simulator::initialize_particles() {
 		// particle_array[i].speed[0] = i ? -500 : 0;
 		// particle_array[i].speed[1] = i ? 0 : 0;
 	}
+	initialize_ids();
+}
+
+void Particle_simulator::initialize_ids() {
+	for (uint32_t p=0; p<nb_max_part; p++) {
+		part_id[p] = p;
+		id_index[p] = p < nb_active_part ? p : NULLPART;
+		free_ids[p] = p; // The free IDs are from nb_active_part
+	}
+	free_head = nb_active_part % std::max(nb_max_part, 1u);
+}
+
+void Particle_simulator::prepare_snapshot() {
+	Snapshot& snapshot = snapshots.write_slot();
+	if (snapshot.particles.size() < particle_array.size()) { // Each slot is allocated the first time it is filled, so nothing is allocated if nothing is displayed
+		snapshot.particles.resize(particle_array.size());
+		snapshot.ids.resize(particle_array.size());
+	}
+}
+
+void Particle_simulator::snapshot_all() {
+	prepare_snapshot();
+	Snapshot& snapshot = snapshots.write_slot();
+	std::copy(particle_array.begin(), particle_array.begin() + nb_active_part, snapshot.particles.begin());
+	std::copy(part_id.begin(), part_id.begin() + nb_active_part, snapshot.ids.begin());
+	snapshot.n_parts = nb_active_part;
+	snapshot.time = time[0];
+	snapshots.publish();
+	prepare_snapshot(); // The next one may be filled by update_pos during this step
+}
+
+uint32_t Particle_simulator::get_index(uint32_t id) {
+	if (SLI.isLoadPos()) {
+		if (!replay_ids) return id < nb_active_part ? id : NULLPART;
+		for (uint32_t p=0; p<nb_active_part; p++) {
+			if (replay_ids[p] == id) return p;
+		}
+		return NULLPART;
+	}
+	return id < nb_max_part ? id_index[id] : NULLPART;
+}
+
+Particle_simulator::DisplayFrame Particle_simulator::get_display_frame() {
+	if (SLI.isLoadPos()) return {get_particle_data(), replay_ids, nb_active_part, time[0]};
+	if (snapshots.acquire()) snapshot_read = true;
+	if (!snapshot_read) return {particle_array.data(), part_id.data(), nb_active_part, NAN};
+	const Snapshot& snapshot = snapshots.read_slot();
+	return {snapshot.particles.data(), snapshot.ids.data(), snapshot.n_parts, snapshot.time};
+}
+
+void Particle_simulator::get_state(SimState& state) {
+	state.world_params = world.getParams();
+	state.segments.resize(4*world.seg_array.size());
+	for (uint32_t i=0; i<world.seg_array.size(); i++) {
+		state.segments[4*i   ] = world.seg_array[i].pos[0][0];
+		state.segments[4*i +1] = world.seg_array[i].pos[0][1];
+		state.segments[4*i +2] = world.seg_array[i].pos[1][0];
+		state.segments[4*i +3] = world.seg_array[i].pos[1][1];
+	}
+	state.zones.resize(4*world.getNbOfZones());
+	state.zone_funs.resize(world.getNbOfZones());
+	for (uint16_t i=0; i<world.getNbOfZones(); i++) {
+		Zone& zone = world.getZone(i);
+		state.zones[4*i   ] = zone.pos(0);
+		state.zones[4*i +1] = zone.pos(1);
+		state.zones[4*i +2] = zone.size(0);
+		state.zones[4*i +3] = zone.size(1);
+		state.zone_funs[i] = zone.fun;
+	}
+	state.params = params;
+	state.time[0] = time[0];
+	state.time[1] = time[1];
+	state.steps = total_steps;
+	state.seed = rng_seed;
+	state.particles.assign(particle_array.begin(), particle_array.begin() + nb_active_part);
+	state.ids.assign(part_id.begin(), part_id.begin() + nb_active_part);
+	state.free_ids.resize(nb_max_part - nb_active_part);
+	for (uint32_t i=0; i<state.free_ids.size(); i++) state.free_ids[i] = free_ids[(free_head + i) % nb_max_part];
+}
+
+void Particle_simulator::restore_state(const SimState& state) {
+	nb_active_part = std::min((uint32_t)state.particles.size(), nb_max_part);
+	std::copy(state.particles.begin(), state.particles.begin() + nb_active_part, particle_array.begin());
+
+	// The IDs are kept only if each one is given once, to an active Particle or as free
+	bool valid_ids = state.ids.size() == nb_active_part && state.ids.size() + state.free_ids.size() == nb_max_part;
+	std::fill(id_index.begin(), id_index.end(), NULLPART);
+	std::vector<bool> freed(nb_max_part, false);
+	for (uint32_t p=0; valid_ids && p<nb_active_part; p++) {
+		uint32_t id = state.ids[p];
+		valid_ids = id < nb_max_part && id_index[id] == NULLPART;
+		if (valid_ids) {
+			part_id[p] = id;
+			id_index[id] = p;
+		}
+	}
+	for (uint32_t i=0; valid_ids && i<state.free_ids.size(); i++) {
+		uint32_t id = state.free_ids[i];
+		valid_ids = id < nb_max_part && id_index[id] == NULLPART && !freed[id];
+		if (valid_ids) freed[id] = true;
+	}
+	if (valid_ids) {
+		std::copy(state.free_ids.begin(), state.free_ids.end(), free_ids.begin());
+		free_head = 0;
+	}
+	else initialize_ids();
+
+	time[0] = state.time[0];
+	time[1] = state.time[1];
+	total_steps = state.steps;
+	rng_seed = state.seed;
+	std::cout << "\tRestarting from " << time[0] << " s (step " << i2s(total_steps) << ") with " << i2s(nb_active_part) << " particles" << std::endl;
+}
+
+void Particle_simulator::take_checkpoint() {
+	Profiler::Scope scope(profiler, "take_checkpoint");
+	SimState* state = checkpointer->acquire();
+	if (!state) return; // Taken at a later step, once the previous one is written
+	get_state(*state);
+	checkpointer->submit(time[0]);
+}
+
+float Particle_simulator::random(uint64_t key, uint32_t draw) const {
+	uint64_t hash = mix64(rng_seed ^ mix64(total_steps ^ mix64(key ^ ((uint64_t)draw << 32))));
+	return (hash >> 40) * (1.f / (1 << 24)); // The 24 bits a float can hold
 }
 
 
@@ -168,9 +346,28 @@ void Particle_simulator::start_simulation_threads() {
 	std::cout << "Particle_simulator::start_simulation_threads()" << std::endl;
 	if (!simulate) {
 		threadHandler.set_nb_fun(16+world.seg_array.size());
+		used_n_threads = std::min(used_n_threads, nb_max_part);
+		active_n_threads = used_n_threads;
+		step_cost.assign(used_n_threads+1, 0);
+		cost_part.assign(used_n_threads+1, 0);
+		cost_age.assign(used_n_threads+1, UINT32_MAX);
+		step_interrupted = true;
+		profiler.set_nb_threads(used_n_threads);
+		thread_counters.assign(used_n_threads, StepCounters());
+		hw_threads.clear();
+		if (hw_counters) {
+			for (uint32_t t=0; t<used_n_threads; t++) hw_threads.emplace_back(new HwThread);
+		}
+		step_arrival.assign(used_n_threads, std::chrono::steady_clock::now());
+		paused_ns = 0;
+		n_steps = 0;
+		particle_steps = 0;
+		for (Consometre& phase : phase_conso) phase.setZero();
+		stripes = params.decomposition == (uint8_t)decomposition_t::STRIPES;
+		if (stripes) prepare_bands();
 		simulate = true;
 		// threadHandler.give_new_thread(new std::thread(&Particle_simulator::simulation_thread2, this, 0));
-		for (uint8_t i=0; i<std::min((uint32_t)used_n_threads, nb_max_part); i++) {
+		for (uint8_t i=0; i<used_n_threads; i++) {
 			threadHandler.give_new_thread(new std::thread(&Particle_simulator::simulation_thread, this, i));
 		}
 	}
@@ -179,9 +376,32 @@ void Particle_simulator::start_simulation_threads() {
 	}
 }
 
+void Particle_simulator::first_touch(std::vector<Particle>& array, bool with_grid) {
+	uint32_t n_threads = std::min((uint32_t)used_n_threads, nb_max_part);
+	Topology::release_pages(array.data(), array.size()*sizeof(Particle));
+	if (with_grid) Topology::release_pages(world.getCell_ptr(0, 0), world.getGridSize(0)*world.getGridSize(1)*sizeof(Cell));
+
+	std::vector<std::thread> touchers;
+	for (uint32_t th=0; th<n_threads; th++) {
+		touchers.emplace_back([this, &array, with_grid, n_threads, th]() {
+			Topology::pin_current_thread(topology.cpu_for_thread(th, (Topology::pinning_t)params.pinning));
+			uint32_t p_start = (uint64_t)array.size()*th/n_threads;
+			uint32_t p_end = (uint64_t)array.size()*(th+1)/n_threads;
+			std::memset((void*)&array[p_start], 0, (p_end-p_start)*sizeof(Particle));
+			if (with_grid) world.empty_grid_particle_blind((uint32_t)world.getGridSize(1)*th/n_threads, (uint32_t)world.getGridSize(1)*(th+1)/n_threads);
+		});
+	}
+	for (std::thread& toucher : touchers) toucher.join();
+}
+
 void Particle_simulator::stop_simulation_threads() {
 	// std::cout << "Particle_simulator::stop_simulation_threads()" << std::endl;
-	simulate = false;
+	{
+		std::lock_guard<std::mutex> lock(order_mutex);
+		simulate = false;
+	}
+	order_condition.notify_all();
+	threadHandler.wake_parked();
 	threadHandler.wait_for_threads_end();
 }
 
@@ -192,101 +412,155 @@ void Particle_simulator::simulation_thread(uint8_t th_id) {
 	uint32_t sub_nppt;
 	uint8_t num_fun;
 
-	threadHandler.synchronize_last(used_n_threads, 1, this, &Particle_simulator::pause_wait); // This is here only to make so the simulation can start paused before looping once.
+	if (params.pinning != (uint8_t)Topology::pinning_t::NONE) {
+		if (!Topology::pin_current_thread(topology.cpu_for_thread(th_id, (Topology::pinning_t)params.pinning)) && !th_id) std::cout << "Could not pin the simulation threads" << std::endl;
+	}
+	Profiler::set_thread(th_id);
+	if (hw_counters) {
+		HwThread& hw = *hw_threads[th_id];
+		hw.opened = hw.counters.open(!th_id);
+		hw.counters.read(hw.last);
+	}
+	barrier("wait pause", &Particle_simulator::pause_wait); // This is here only to make so the simulation can start paused before looping once.
+	StepCounters::local().reset();
+	auto step_start = std::chrono::steady_clock::now();
 
 	if (!th_id) {
 		conso.start_perf_check("average sim loop", 20000);
 		conso2.start_perf_check("Collision particles", 20000);
+		current_phase = phase_t::SYNC;
+		phase_conso[(uint8_t)phase_t::SYNC].Start();
 	}
 	while (simulate) {
 		num_fun = 0;
 		// Synchronize & do stuff that shouldn't be done by multiple threads, like changing the number of Particles
-		threadHandler.synchronize_last(used_n_threads, 1, this, &Particle_simulator::create_destroy_wait);
-		nppt = nb_active_part/used_n_threads; // number of particles per thread +- 1
-		sub_nppt = std::max(nppt/5, (uint32_t)10);
+		mark_phase(th_id, phase_t::SYNC);
+		hand_over_counters(th_id, step_start);
+		barrier("wait create_destroy", &Particle_simulator::create_destroy_wait);
+		if (th_id >= active_n_threads) { // This thread isn't needed for now
+			Profiler::Scope scope(profiler, "parked");
+			threadHandler.park_until(this, &Particle_simulator::may_work, th_id);
+			if (!simulate) break;
+		}
+		StepCounters::local().idle_ns = 0; // The wait at the barrier was counted by the last thread
+		step_start = std::chrono::steady_clock::now();
+		nppt = nb_active_part/active_n_threads; // number of particles per thread +- 1
+		sub_nppt = std::max(nppt/std::max(params.chunks_per_thread, (uint8_t)1), (uint32_t)10);
+
+		// Moving the Particles to the band they will be in
+		if (stripes) {
+			mark_phase(th_id, phase_t::MIGRATION);
+			if (rebalance_due) {
+				count_rows(th_id);
+				barrier("wait rebalance_bands", &Particle_simulator::rebalance_bands);
+			}
+			find_migrants(th_id);
+			barrier("wait prepare_migration", &Particle_simulator::prepare_migration);
+			migrate_particles(th_id);
+			barrier("wait end_migration", &Particle_simulator::end_migration);
+		}
 		
 		// Filling the grid
 		if (params.apl_pp_collision || params.apl_ps_collision) {
+			mark_phase(th_id, phase_t::GRID);
 			auto bound_update_grid_particle_contenance = std::bind(&World::update_grid_particle_contenance, &world, particle_array.data(), std::placeholders::_1, std::placeholders::_2, params.dt);
-			threadHandler.load_repartition(bound_update_grid_particle_contenance, num_fun++, nb_active_part, sub_nppt);
+			particle_repartition(th_id, "update_grid_particle_contenance", bound_update_grid_particle_contenance, num_fun++, sub_nppt);
 		}
 			
 
 		// Simulation -- applying forces and collisions
+		mark_phase(th_id, phase_t::FORCES);
 		switch (appliedForce) {
 			case userForce::None:
 				break;
 			case userForce::Translation:
-				threadHandler.load_repartition(this, &Particle_simulator::attraction, num_fun++, nb_active_part, sub_nppt);
+				particle_repartition(th_id, "attraction", this, &Particle_simulator::attraction, num_fun++, sub_nppt);
 				break;
 			case userForce::Rotation:
-				threadHandler.load_repartition(this, &Particle_simulator::rotation, num_fun++, nb_active_part, sub_nppt);
+				particle_repartition(th_id, "rotation", this, &Particle_simulator::rotation, num_fun++, sub_nppt);
 				break;
 			case userForce::Vortex:
-				threadHandler.load_repartition(this, &Particle_simulator::vortex, num_fun++, nb_active_part, sub_nppt);
+				particle_repartition(th_id, "vortex", this, &Particle_simulator::vortex, num_fun++, sub_nppt);
 				break;
 		}
 
 		if (params.apl_point_gravity)
-			threadHandler.load_repartition(this, &Particle_simulator::point_gravity, num_fun++, nb_active_part, sub_nppt);
+			particle_repartition(th_id, "point_gravity", this, &Particle_simulator::point_gravity, num_fun++, sub_nppt);
 		if (params.apl_point_gravity_invSquared)
-			threadHandler.load_repartition(this, &Particle_simulator::point_gravity_invSquared, num_fun++, nb_active_part, sub_nppt);
+			particle_repartition(th_id, "point_gravity_invSquared", this, &Particle_simulator::point_gravity_invSquared, num_fun++, sub_nppt);
 		if (params.apl_gravity)
-			threadHandler.load_repartition(this, &Particle_simulator::gravity, num_fun++, nb_active_part, sub_nppt);
+			particle_repartition(th_id, "gravity", this, &Particle_simulator::gravity, num_fun++, sub_nppt);
 		if (params.apl_vibrate)
-			threadHandler.load_repartition(this, &Particle_simulator::vibrate, num_fun++, nb_active_part, sub_nppt);
+			particle_repartition(th_id, "vibrate", this, &Particle_simulator::vibrate, num_fun++, sub_nppt);
 		if (params.apl_fluid_friction)
-			threadHandler.load_repartition(this, &Particle_simulator::fluid_friction, num_fun++, nb_active_part, sub_nppt);
+			particle_repartition(th_id, "fluid_friction", this, &Particle_simulator::fluid_friction, num_fun++, sub_nppt);
 
 
+		mark_phase(th_id, phase_t::PP_COLLISION);
 		if (!th_id) conso2.Start();
 		if (params.apl_pp_collision)
-			threadHandler.load_repartition(this, pp_collision_ptr, num_fun++, nb_active_part, sub_nppt);
+			particle_repartition(th_id, "collision_pp", this, pp_collision_ptr, num_fun++, sub_nppt);
 		if (!th_id) conso2.Tick_fine(true);
 
+		mark_phase(th_id, phase_t::PS_COLLISION);
 		if (params.apl_ps_collision) {
 			if (world.sig()) {
-				threadHandler.load_repartition(this, &Particle_simulator::comparison_ps_grid, num_fun++, nb_active_part, sub_nppt);
+				particle_repartition(th_id, "comparison_ps_grid", this, &Particle_simulator::comparison_ps_grid, num_fun++, sub_nppt);
 			} else {
 				for (uint16_t i=0; i<world.seg_array.size(); i++) {
 					auto bound_collision_pl_grid = std::bind(&Particle_simulator::comparison_sp_grid, this, std::placeholders::_1, std::placeholders::_2, i);
 					auto work_set = world.seg_array[i].cells.size();
-					threadHandler.load_repartition(bound_collision_pl_grid, num_fun++, work_set, work_set/(5*used_n_threads));
+					Profiler::Scope scope(profiler, "comparison_sp_grid");
+					threadHandler.load_repartition(bound_collision_pl_grid, num_fun++, work_set, work_set/(5*active_n_threads));
 				}
 			}
 		}
 		
+		mark_phase(th_id, phase_t::BORDERS);
 		if (params.apl_world_border)
-			threadHandler.load_repartition(this, world_borders_ptr, num_fun++, nb_active_part, sub_nppt);
+			particle_repartition(th_id, "world_borders", this, world_borders_ptr, num_fun++, sub_nppt);
 
+		mark_phase(th_id, phase_t::FORCES);
 		if (params.apl_static_friction)
-			threadHandler.load_repartition(this, &Particle_simulator::static_friction, num_fun++, nb_active_part, sub_nppt);
+			particle_repartition(th_id, "static_friction", this, &Particle_simulator::static_friction, num_fun++, sub_nppt);
 
+		mark_phase(th_id, phase_t::ZONES);
 		if (params.apl_zone) {
-			if (nb_active_part < world.getNZoneCoveredCells()) {
-				threadHandler.load_repartition(this, &Particle_simulator::comparison_pz, num_fun++, nb_active_part, sub_nppt);
+			if (particles_find_zones()) {
+				particle_repartition(th_id, "comparison_pz", this, &Particle_simulator::comparison_pz, num_fun++, sub_nppt);
 			} else {
 				for (uint16_t i=0; i<world.getNbOfZones(); i++) {
 					auto bound_comparison_zp = std::bind(&Particle_simulator::comparison_zp, this, std::placeholders::_1, std::placeholders::_2, i);
 					auto work_set = world.getZone(i).getLength(); // work set along the length of the zone
-					threadHandler.load_repartition(bound_comparison_zp, num_fun++, work_set, work_set/(5*used_n_threads));
+					Profiler::Scope scope(profiler, "comparison_zp");
+					threadHandler.load_repartition(bound_comparison_zp, num_fun++, work_set, work_set/(5*active_n_threads));
 				}
 			}
 		}
 
 		// updating position
-		threadHandler.synchronize_last(used_n_threads, 1, this, &Particle_simulator::pause_wait);
-		threadHandler.load_repartition(this, &Particle_simulator::update_pos, num_fun++, nb_active_part, sub_nppt);
+		mark_phase(th_id, phase_t::SYNC);
+		barrier("wait pause", &Particle_simulator::pause_wait);
+		mark_phase(th_id, phase_t::UPDATE);
+		particle_repartition(th_id, "update_pos", this, &Particle_simulator::update_pos, num_fun++, sub_nppt);
 
 		// Removing the particles from the grid, thus preparing for the next loop
 		if (params.apl_pp_collision || params.apl_ps_collision) {
-			if (world.emptying_blindly()) threadHandler.load_repartition(&world, &World::empty_grid_particle_blind, num_fun++, world.getGridSize(1), world.getGridSize(1)/(2*used_n_threads));
+			mark_phase(th_id, phase_t::EMPTYING);
+			if (world.emptying_blindly()) {
+				Profiler::Scope scope(profiler, "empty_grid_particle_blind");
+				if (stripes) world.empty_grid_particle_blind(band_rows[th_id], band_rows[th_id+1]);
+				else threadHandler.load_repartition(&world, &World::empty_grid_particle_blind, num_fun++, world.getGridSize(1), world.getGridSize(1)/(2*active_n_threads));
+			}
 			else {
-				threadHandler.load_repartition(&world, &World::empty_grid_particle_pbased, num_fun++, nb_active_part, sub_nppt);
+				particle_repartition(th_id, "empty_grid_particle_pbased", &world, &World::empty_grid_particle_pbased, num_fun++, sub_nppt);
 			}
 		}
 
 	}
+	mark_phase(th_id, phase_t::SYNC);
+	profiler.switch_phase(nullptr);
+	Profiler::set_thread(-1);
 }
 
 void Particle_simulator::simulation_thread2(uint8_t th_id) {
@@ -370,6 +644,144 @@ void Particle_simulator::simulation_thread2(uint8_t th_id) {
 }
 
 
+void Particle_simulator::setPaused(bool pause) {
+	{
+		std::lock_guard<std::mutex> lock(order_mutex);
+		paused = pause;
+	}
+	order_condition.notify_all();
+}
+
+void Particle_simulator::orderStep() {
+	{
+		std::lock_guard<std::mutex> lock(order_mutex);
+		step = true;
+	}
+	order_condition.notify_all();
+}
+
+void Particle_simulator::setQuickstep(bool quick) {
+	{
+		std::lock_guard<std::mutex> lock(order_mutex);
+		quickstep = quick;
+	}
+	order_condition.notify_all();
+}
+
+
+bool Particle_simulator::order(const SimCommand& command) {
+	if (!commands.push(command)) {
+		if (!dropping_orders) std::cout << "Too many orders waiting for the simulator, orders are dropped" << std::endl;
+		dropping_orders = true;
+		return false;
+	}
+	dropping_orders = false;
+	if (paused) { // The simulation thread waits on order_condition, so it mustn't check for orders between the push and the notification
+		std::lock_guard<std::mutex> lock(order_mutex);
+	}
+	order_condition.notify_all();
+	return true;
+}
+
+void Particle_simulator::apply_commands(bool paused_) {
+	SimCommand command;
+	bool reordered = false; // Whether Particles were deleted or reset, so the world's grid doesn't match their indices anymore
+	while (commands.pop(command)) {
+		switch (command.type) {
+			case SimCommand::type_t::FORCE :
+				appliedForce = (userForce)command.force;
+				params.range = command.value;
+				user_point[0] = command.point[0];
+				user_point[1] = command.point[1];
+				break;
+			case SimCommand::type_t::POINT :
+				user_point[0] = command.point[0];
+				user_point[1] = command.point[1];
+				break;
+			case SimCommand::type_t::RELEASE :
+				appliedForce = userForce::None;
+				deletion_order = false;
+				break;
+			case SimCommand::type_t::DELETION :
+				params.range = command.value;
+				user_point[0] = command.point[0];
+				user_point[1] = command.point[1];
+				if (paused_) { // Deleting once, so the user sees what is deleted
+					delete_range(user_point[0], user_point[1], params.range);
+					reordered = true;
+				}
+				else deletion_order = true;
+				break;
+			case SimCommand::type_t::DELETE_PARTICLE : {
+				uint32_t p = get_index(command.part);
+				if (p < nb_active_part) {
+					delete_particle(p);
+					reordered = true;
+				}
+				break;
+			}
+			case SimCommand::type_t::MOVE_PARTICLE : {
+				uint32_t p = get_index(command.part);
+				if (p < nb_active_part) {
+					Particle& particle = particle_array[p];
+					if (grid_filled && !reordered) world.change_cell_part(p, particle.position[0], particle.position[1], command.point[0], command.point[1]);
+					particle.position[0] = command.point[0];
+					particle.position[1] = command.point[1];
+					if (!std::isnan(command.speed[0])) particle.speed[0] = command.speed[0];
+					if (!std::isnan(command.speed[1])) particle.speed[1] = command.speed[1];
+				}
+				break;
+			}
+			case SimCommand::type_t::SCALE_DT :
+				params.dt *= command.value;
+				break;
+			case SimCommand::type_t::RESET :
+				if (SLI.isLoadPos()) resetPosLoading();
+				else {
+					total_steps = 0;
+					initialize_particles();
+					time[0] = 0;
+					time[1] = 0;
+					reordered = true;
+				}
+				break;
+			case SimCommand::type_t::THREADS :
+				forced_n_threads = command.value;
+				break;
+			case SimCommand::type_t::COUNTERS :
+				stream_counters(command.value ? COUNTERS_FILE : "");
+				break;
+			case SimCommand::type_t::AUTOTUNE : // Done at the end of the step, as the grid might be in use
+				autotune_order = true;
+				autotune_grid = command.value;
+				break;
+			case SimCommand::type_t::SEEK :
+				if (SLI.isLoadPos() && partLoader && partLoader->getPosFrameCount()) {
+					replay_target = partLoader->findPosFrame(time[0] + command.value);
+					finished_loading = false;
+				}
+				break;
+			case SimCommand::type_t::REPLAY_STRIDE : {
+				int32_t stride = std::round(replay_stride * command.value);
+				if (!stride) stride = replay_stride < 0 ? -1 : 1; // Halving a stride of 1 keeps it
+				replay_stride = std::min(std::max(stride, (int32_t)-MAX_REPLAY_STRIDE), (int32_t)MAX_REPLAY_STRIDE);
+				if (replay_stride < 0) finished_loading = false; // Can go back from the end
+				std::cout << "Replay stride : " << replay_stride << std::endl;
+				break;
+			}
+		}
+	}
+
+	if (reordered) {
+		if (stripes) clamp_bands();
+		if (grid_filled) { // Filling the grid again as the Particles aren't where the grid says anymore
+			world.empty_grid_particle_blind(0, world.getGridSize(1));
+			world.update_grid_particle_contenance(particle_array.data(), 0, nb_active_part, params.dt);
+		}
+	}
+}
+
+
 void Particle_simulator::loop_wait() {
 	pause_wait();
 	create_destroy_wait();
@@ -379,14 +791,35 @@ void Particle_simulator::loop_wait() {
 * @details I had to split loop_wait in 2 so I could change where I pause the simulation relative to emptying the world grid.
 */
 void Particle_simulator::pause_wait() {
+	Profiler::Scope scope(profiler, "pause_wait");
 	// std::cout << "pause_wait" << std::endl;
-	if (SLI.isSavePos()) partLoader->savePos(particle_array.data(), nb_active_part, time[0]);
+	if (recorder) recorder->record(particle_array.data(), nb_active_part, time[0], part_id.data());
+	if (exporter) exporter->record(particle_array.data(), nb_active_part, time[0], part_id.data());
 	conso.Tick_fine(true);
-	while (simulate && paused && !step && !quickstep) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	std::unique_lock<std::mutex> lock(order_mutex);
+	if (paused || quickstep) step_interrupted = true; // So the pause doesn't count in the step duration
+	auto pause_start = std::chrono::steady_clock::now();
+	auto resumed = [this]() {return !simulate || !paused || step || quickstep;};
+	while (!resumed()) { // Orders given while paused are applied right away
+		if (snapshot_wanted.load(std::memory_order_relaxed)) { // So the display shows what the orders changed
+			lock.unlock();
+			snapshot_all();
+			lock.lock();
+		}
+		order_condition.wait(lock, [&]() {return resumed() || commands.size();});
+		lock.unlock();
+		apply_commands(true);
+		lock.lock();
 	}
 	step = false;
-	if (quickstep) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	if (quickstep && params.quickstep_sps > 0) {
+		// Waiting for the next quickstep, unless the quickstep stops or a step is ordered
+		auto next_step = last_quickstep + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(1/params.quickstep_sps));
+		order_condition.wait_until(lock, next_step, [this]() {return !simulate || !quickstep || step;});
+		step = false;
+		last_quickstep = std::chrono::steady_clock::now();
+	}
+	paused_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - pause_start).count();
 	conso.Start();
 }
 
@@ -394,23 +827,444 @@ void Particle_simulator::pause_wait() {
 * @details I had to split loop_wait in 2 so I could change where I pause the simulation relative to emptying the world grid.
 */
 void Particle_simulator::create_destroy_wait() {
+	Profiler::Scope scope(profiler, "create_destroy_wait");
 	threadHandler.prep_new_work_loop();
+	merge_counters();
+	auto now = std::chrono::steady_clock::now();
+	uint64_t step_time = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_step_start).count();
+	last_step_start = now;
+	if (!step_interrupted) autotuner.measure(step_time, nb_active_part);
+	if (checkpointer && checkpointer->is_due(time[0])) take_checkpoint(); // Between the end of a step and the start of the next, like when the simulation threads start
 	time[0] += params.dt;
-	world.chg_seg_store_sys(nb_active_part);
+	if (snapshot_filling) { // update_pos copied the step that just ended
+		Snapshot& snapshot = snapshots.write_slot();
+		snapshot.n_parts = nb_active_part;
+		snapshot.time = time[0];
+		snapshots.publish();
+	}
+	total_steps++;
+	if (++n_steps >= step_limit) simulate = false; // This step is the last one
+	grid_filled = false;
+	apply_commands(false);
+	if (autotune_order) {
+		autotune_order = false;
+		if (autotuner.is_running()) autotuner.stop();
+		else start_autotune(autotune_grid);
+	}
+	choose_seg_storage();
 	if (deletion_order) {
 		delete_range(user_point[0], user_point[1], params.range);
 	}
-	if (!(rand()%4096)) {
+	if (random(NULLPART, 0) < 1.f/4096) {
 		delete_NaNs(0, nb_active_part);
 	}
-	if (reinitialize_order) {
-		initialize_particles();
-		time[0] = 0;
-		time[1] = 0;
-		reinitialize_order = false;
-	}
 	float to_create = params.pps*params.dt;
-	create_particles((uint32_t)to_create + ((float)rand()/RAND_MAX < to_create - (uint32_t)to_create));
+	create_particles((uint32_t)to_create + (random(NULLPART, 1) < to_create - (uint32_t)to_create));
+
+	choose_n_threads(step_time);
+
+	if (stripes) {
+		clamp_bands();
+		if (params.rebalance_period && ++steps_since_rebalance >= params.rebalance_period) rebalance_due = true;
+	}
+	grid_filled = params.apl_pp_collision || params.apl_ps_collision; // The grid will be filled when the simulation can pause
+	particle_steps += nb_active_part;
+	snapshot_filling = snapshot_wanted.load(std::memory_order_relaxed);
+	if (snapshot_filling) prepare_snapshot();
+}
+
+
+void Particle_simulator::hand_over_counters(uint8_t th_id, std::chrono::steady_clock::time_point step_start) {
+	StepCounters& counters = StepCounters::local();
+	step_arrival[th_id] = std::chrono::steady_clock::now();
+	uint64_t step_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(step_arrival[th_id] - step_start).count();
+	counters.busy_ns = step_ns - std::min(counters.idle_ns, step_ns);
+	thread_counters[th_id] = counters;
+	counters.reset();
+}
+
+void Particle_simulator::merge_counters() {
+	auto now = std::chrono::steady_clock::now();
+	uint8_t next = !last_counters.load(std::memory_order_relaxed);
+	StepCounters& sum = step_counters[next];
+	sum.reset();
+	for (uint32_t t=0; t<active_n_threads; t++) {
+		StepCounters& counters = thread_counters[t];
+		counters.idle_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(now - step_arrival[t]).count(); // Waiting for the slowest thread
+		counters.idle_ns -= std::min(paused_ns, counters.idle_ns);
+		sum += counters;
+	}
+	sum += StepCounters::local(); // What the last thread did since handing over its counters, e.g. applying orders
+	StepCounters::local().reset();
+	paused_ns = 0;
+	last_counters.store(next, std::memory_order_release);
+
+	if (counters_stream.is_open()) {
+		counters_stream << n_steps << ',' << time[0] << ',' << nb_active_part << ',' << active_n_threads << ',';
+		sum.write_csv(counters_stream);
+		for (uint32_t t=0; t<used_n_threads; t++) counters_stream << ',' << (t < active_n_threads ? thread_counters[t].idle_ns : 0);
+		counters_stream << '\n';
+	}
+}
+
+bool Particle_simulator::stream_counters(const std::string& file_name) {
+	if (counters_stream.is_open()) counters_stream.close();
+	if (file_name.empty()) return true;
+	counters_stream.open(file_name);
+	if (!counters_stream.is_open()) {
+		std::cout << "Couldn't open " << file_name << std::endl;
+		return false;
+	}
+	counters_stream << "step,time,particles,threads,";
+	StepCounters::write_csv_header(counters_stream);
+	for (uint32_t t=0; t<used_n_threads; t++) counters_stream << ",idle_ns_" << t;
+	counters_stream << '\n';
+	std::cout << "Writing the counters of each step in " << file_name << std::endl;
+	return true;
+}
+
+
+void Particle_simulator::count_hw_phase(uint8_t th_id, phase_t phase) {
+	HwThread& hw = *hw_threads[th_id];
+	PerfCounters::Sample now;
+	if (!hw.counters.read(now)) return;
+	hw.phases[(uint8_t)hw.phase] += now - hw.last;
+	hw.last = now;
+	hw.phase = phase;
+}
+
+bool Particle_simulator::hw_counters_open() {
+	for (std::unique_ptr<HwThread>& hw : hw_threads) {
+		if (hw->opened) return true;
+	}
+	return false;
+}
+
+PerfCounters::Sample Particle_simulator::get_phase_hw(phase_t phase) {
+	PerfCounters::Sample sum;
+	for (std::unique_ptr<HwThread>& hw : hw_threads) sum += hw->phases[(uint8_t)phase];
+	return sum;
+}
+
+
+uint64_t Particle_simulator::checksum() {
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char* bytes = (const unsigned char*)particle_array.data();
+	for (size_t b=0; b<nb_active_part*sizeof(Particle); b++) {
+		hash ^= bytes[b];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+void Particle_simulator::print_phase_timings() {
+	long total = 0;
+	for (Consometre& phase : phase_conso) total += phase.count();
+	std::cout << "Phase timings of the thread 0 over " << n_steps << " steps :" << std::endl;
+	for (uint8_t i=0; i<(uint8_t)phase_t::NB_PHASES; i++) {
+		std::cout << "\t" << phase_names[i] << " : " << (float)phase_conso[i].count() / std::max(n_steps, (uint64_t)1) / 1000000 << " ms/step (" << (total ? 100.f*phase_conso[i].count()/total : 0) << "%)" << std::endl;
+	}
+
+	if (!hw_counters_open()) return;
+	std::cout << "Hardware counters of all threads per step :" << std::endl;
+	std::cout << "\t" << std::left << std::setw(16) << "phase" << std::right << std::setw(14) << "cycles" << std::setw(8) << "IPC";
+	for (uint8_t e=(uint8_t)PerfCounters::event_t::L1D_MISSES; e<PerfCounters::NB_EVENTS; e++) std::cout << std::setw(16) << PerfCounters::event_names[e];
+	std::cout << std::endl;
+	uint64_t steps = std::max(n_steps, (uint64_t)1);
+	for (uint8_t i=0; i<(uint8_t)phase_t::NB_PHASES; i++) {
+		PerfCounters::Sample hw = get_phase_hw((phase_t)i);
+		std::cout << "\t" << std::left << std::setw(16) << phase_names[i] << std::right << std::setw(14) << hw.values[0] / steps << std::setw(8) << std::setprecision(3) << hw.ipc();
+		for (uint8_t e=(uint8_t)PerfCounters::event_t::L1D_MISSES; e<PerfCounters::NB_EVENTS; e++) {
+			if (hw_threads[0]->counters.counts((PerfCounters::event_t)e)) std::cout << std::setw(16) << hw.values[e] / steps;
+			else std::cout << std::setw(16) << "n/a";
+		}
+		std::cout << std::setprecision(6) << std::endl;
+	}
+}
+
+
+void Particle_simulator::choose_n_threads(uint64_t step_time) {
+	uint32_t target = active_n_threads;
+	if (forced_n_threads) target = std::min(forced_n_threads, used_n_threads);
+	else if (!params.elastic_threads) target = used_n_threads;
+	else if (!autotuner.is_running()) { // Changing the number of threads would disturb the trials
+		if (!step_interrupted) {
+			window_time += step_time;
+			window_steps++;
+		}
+		if (window_steps >= ELASTIC_WINDOW) {
+			step_cost[active_n_threads] = (float)window_time/window_steps;
+			cost_part[active_n_threads] = nb_active_part;
+			for (uint32_t& age : cost_age) age += (age != UINT32_MAX);
+			cost_age[active_n_threads] = 0;
+			window_time = 0;
+			window_steps = 0;
+			target = best_n_threads();
+		}
+	}
+	step_interrupted = false;
+
+	if (target != active_n_threads) {
+		active_n_threads = target;
+		window_time = 0;
+		window_steps = 0;
+		step_interrupted = true; // The first step with a different number of threads isn't representative
+		if (stripes) reset_bands();
+		threadHandler.wake_parked();
+	}
+}
+
+uint32_t Particle_simulator::best_n_threads() {
+	uint32_t n = active_n_threads;
+	auto is_known = [this](uint32_t m) {
+		return cost_age[m] < ELASTIC_MAX_AGE && std::abs((float)cost_part[m] - nb_active_part) <= 0.5f*nb_active_part;
+	};
+	auto cost = [this](uint32_t m) { // Step durations are compared per Particle as the number of Particles changes between measures
+		return step_cost[m] / std::max(cost_part[m], (uint32_t)1);
+	};
+	// Measuring the neighbouring numbers of threads if they weren't recently, or with about as many Particles
+	if (n < used_n_threads && !is_known(n+1)) return n+1;
+	if (n > 1 && !is_known(n-1)) return n-1;
+
+	uint32_t best = n;
+	if (n < used_n_threads && cost(n+1) < 0.95f*cost(best)) best = n+1;
+	if (n > 1 && cost(n-1) < 0.95f*cost(best)) best = n-1;
+	return best;
+}
+
+
+void Particle_simulator::start_autotune(bool with_grid) {
+	autotuner.clear();
+	bool grid_used = params.apl_pp_collision || params.apl_ps_collision; // comparison_sp_grid and comparison_zp find the Particles in the grid
+	auto same_contacts = [this]() {return !get_step_counters().cell_overflows;};
+
+	if (!stripes && used_n_threads > 1) {
+		std::vector<float> chunks = {2, 5, 10, 20};
+		if (std::find(chunks.begin(), chunks.end(), params.chunks_per_thread) == chunks.end()) chunks.push_back(params.chunks_per_thread);
+		uint8_t initial = std::find(chunks.begin(), chunks.end(), params.chunks_per_thread) - chunks.begin();
+		autotuner.add_setting("chunks_per_thread", chunks, {}, initial, [this](float c) {params.chunks_per_thread = c;});
+	}
+
+	if (params.apl_ps_collision && world.seg_array.size()) {
+		autotuner.add_setting("seg_storage", {(float)seg_storage_t::GRID, (float)seg_storage_t::SEGMENTS}, {"GRID", "SEGMENTS"}, !world.sig(),
+			[this](float storage) {
+				params.seg_storage = storage;
+				choose_seg_storage();
+			},
+			[this]() {return !get_step_counters().cell_overflows && !world.seg_grid_overflows();}
+		);
+	}
+
+	if (params.apl_zone && world.getNbOfZones() && grid_used) {
+		autotuner.add_setting("zone_comparison", {(float)zone_comparison_t::PARTICLES, (float)zone_comparison_t::ZONES}, {"PARTICLES", "ZONES"}, !particles_find_zones(),
+			[this](float comparison) {params.zone_comparison = comparison;}, same_contacts);
+	}
+
+	if (with_grid && grid_used) {
+		// Distance under which 2 Particles interact. Every Particle within it must be in the cs Cells around a Particle.
+		bool tlev = params.pp_collision_fun == (uint8_t)pp_collision_t::TLEV || params.pp_collision_fun == (uint8_t)pp_collision_t::COHERENT;
+		float reach = params.apl_pp_collision ? (tlev ? 4 : 2)*params.radii : 0;
+		GridCandidate initial{{world.getCellSize(0), world.getCellSize(1)}, params.cs};
+		if (params.cs * std::min(initial.cellSize[0], initial.cellSize[1]) < reach) {
+			std::cout << "cs*cellSize is below the collision distance (" << reach << "), so the grid isn't autotuned" << std::endl;
+		}
+		else {
+			grid_candidates.assign(1, initial);
+			for (float factor : {0.5f, 0.75f, 1.f, 1.5f, 2.f}) {
+				GridCandidate grid{{initial.cellSize[0]*factor, initial.cellSize[1]*factor}, params.cs};
+				if (reach) grid.cs = std::max(1.f, std::ceil(reach / std::min(grid.cellSize[0], grid.cellSize[1]) - 1e-4f));
+				bool valid = (factor != 1 || grid.cs != initial.cs) &&
+					2*params.radii < std::min(grid.cellSize[0], grid.cellSize[1]) && // A Particle can't be bigger than a Cell
+					world.getSize(0)/grid.cellSize[0] < UINT16_MAX && world.getSize(1)/grid.cellSize[1] < UINT16_MAX &&
+					(!stripes || used_n_threads <= std::ceil(world.getSize(1)/grid.cellSize[1])) && // Each band needs a row
+					world.fits_cell_size(grid.cellSize);
+				if (valid) grid_candidates.push_back(grid);
+			}
+			std::vector<float> candidates;
+			std::vector<std::string> labels;
+			for (size_t g=0; g<grid_candidates.size(); g++) {
+				std::ostringstream label;
+				label << "cellSize " << grid_candidates[g].cellSize[0] << " cs " << (short)grid_candidates[g].cs;
+				candidates.push_back(g);
+				labels.push_back(label.str());
+			}
+			if (grid_candidates.size() == 1) std::cout << "No other grid keeps the Particles smaller than the Cells and the Zones in place, so the grid isn't autotuned" << std::endl;
+			autotuner.add_setting("cellSize, cs", candidates, labels, 0, [this](float g) {set_grid(grid_candidates[(size_t)g]);}, same_contacts);
+		}
+	}
+
+	if (autotuner.start()) std::cout << "Autotuning the simulation" << std::endl;
+	else std::cout << "Nothing to autotune in this scene" << std::endl;
+}
+
+void Particle_simulator::set_grid(const GridCandidate& grid) {
+	if (grid.cellSize[0] == world.getCellSize(0) && grid.cellSize[1] == world.getCellSize(1)) {
+		params.cs = grid.cs;
+		return;
+	}
+	world.set_cell_size(grid.cellSize);
+	params.cs = grid.cs;
+	if (stripes) {
+		uint16_t rows = world.getGridSize(1);
+		row_band.resize(rows);
+		for (std::vector<uint32_t>& count : row_count) count.assign(rows, 0);
+		reset_bands();
+	}
+}
+
+void Particle_simulator::choose_seg_storage() {
+	if (params.seg_storage == (uint8_t)seg_storage_t::AUTO) world.chg_seg_store_sys(nb_active_part);
+	else world.set_seg_store_sys(params.seg_storage == (uint8_t)seg_storage_t::GRID);
+}
+
+
+void Particle_simulator::particle_repartition(uint8_t th_id, const char* name, std::function<void(uint32_t, uint32_t)> array_worker, uint16_t fun_id, uint32_t work_subset) {
+	Profiler::Scope scope(profiler, name);
+	if (stripes) array_worker(band_parts[th_id], band_parts[th_id+1]);
+	else threadHandler.load_repartition(array_worker, fun_id, nb_active_part, work_subset);
+}
+
+
+void Particle_simulator::prepare_bands() {
+	uint16_t rows = world.getGridSize(1);
+	used_n_threads = std::max((uint32_t)1, std::min({used_n_threads, (uint32_t)rows, (uint32_t)UINT8_MAX})); // Each band needs at least a row
+	active_n_threads = std::min((uint32_t)active_n_threads, used_n_threads);
+	std::cout << "\tdecomposition in at most " << used_n_threads << " bands of rows" << std::endl;
+
+	band_rows.resize(used_n_threads+1);
+	band_parts.resize(used_n_threads+1);
+	band_parts_next.resize(used_n_threads+1);
+	row_band.resize(rows);
+	migrants.resize(used_n_threads);
+	migration_count.assign(used_n_threads*used_n_threads, 0);
+	row_count.assign(used_n_threads, std::vector<uint32_t>(rows, 0));
+	particle_buffer.reserve(nb_max_part);
+	particle_buffer.resize(nb_max_part);
+	if (params.pinning != (uint8_t)Topology::pinning_t::NONE) first_touch(particle_buffer, false);
+	id_buffer.resize(nb_max_part);
+
+	reset_bands();
+}
+
+void Particle_simulator::reset_bands() {
+	uint16_t rows = world.getGridSize(1);
+	for (uint32_t b=0; b<=active_n_threads; b++) {
+		band_rows[b] = (uint32_t)rows*b/active_n_threads;
+		band_parts[b] = (uint64_t)nb_active_part*b/active_n_threads;
+	}
+	for (uint32_t b=0; b<active_n_threads; b++) {
+		std::fill(row_band.begin() + band_rows[b], row_band.begin() + band_rows[b+1], b);
+	}
+	rebalance_due = true; // So the next step balances the bands by their number of Particles
+}
+
+void Particle_simulator::count_rows(uint8_t th_id) {
+	Profiler::Scope scope(profiler, "count_rows");
+	std::vector<uint32_t>& count = row_count[th_id];
+	std::fill(count.begin(), count.end(), 0);
+	float row;
+	for (uint32_t p=band_parts[th_id]; p<band_parts[th_id+1]; p++) {
+		row = (particle_array[p].position[1] + particle_array[p].speed[1]*params.dt) / world.getCellSize(1);
+		if (0 <= row && row < world.getGridSize(1)) count[(uint16_t)row]++;
+	}
+}
+
+void Particle_simulator::rebalance_bands() {
+	Profiler::Scope scope(profiler, "rebalance_bands");
+	uint16_t rows = world.getGridSize(1);
+	uint16_t min_height = std::min((uint32_t)2*params.cs+1, rows/active_n_threads);
+	uint64_t total = 0;
+	for (uint32_t th=0; th<active_n_threads; th++) {
+		for (uint16_t r=0; r<rows; r++) total += row_count[th][r];
+	}
+
+	uint64_t cumul = 0;
+	uint16_t row = 0;
+	for (uint32_t b=0; b+1<active_n_threads; b++) {
+		uint64_t target = total*(b+1)/active_n_threads;
+		uint16_t lowest = band_rows[b] + min_height;
+		uint16_t highest = rows - (active_n_threads-1-b)*min_height; // Leaving enough rows for the next bands
+		while (row < highest && (row < lowest || cumul < target)) {
+			for (uint32_t th=0; th<active_n_threads; th++) cumul += row_count[th][row];
+			row++;
+		}
+		band_rows[b+1] = row;
+		std::fill(row_band.begin() + band_rows[b], row_band.begin() + band_rows[b+1], b);
+	}
+	std::fill(row_band.begin() + band_rows[active_n_threads-1], row_band.end(), active_n_threads-1);
+
+	rebalance_due = false;
+	steps_since_rebalance = 0;
+}
+
+void Particle_simulator::find_migrants(uint8_t th_id) {
+	Profiler::Scope scope(profiler, "find_migrants");
+	std::vector<Migrant>& out = migrants[th_id];
+	uint32_t* count = &migration_count[th_id*active_n_threads];
+	out.clear();
+	std::fill(count, count + active_n_threads, 0);
+
+	float row;
+	uint8_t band;
+	for (uint32_t p=band_parts[th_id]; p<band_parts[th_id+1]; p++) {
+		row = (particle_array[p].position[1] + particle_array[p].speed[1]*params.dt) / world.getCellSize(1);
+		if (0 <= row && row < world.getGridSize(1)) { // Particles outside the grid aren't put in it, so they can stay in any band
+			band = row_band[(uint16_t)row];
+			if (band != th_id) {
+				out.push_back({p, band});
+				count[band]++;
+			}
+		}
+	}
+}
+
+void Particle_simulator::prepare_migration() {
+	Profiler::Scope scope(profiler, "prepare_migration");
+	band_parts_next[0] = 0;
+	for (uint32_t b=0; b<active_n_threads; b++) {
+		uint32_t size = band_parts[b+1] - band_parts[b] - migrants[b].size();
+		for (uint32_t from=0; from<active_n_threads; from++) size += migration_count[from*active_n_threads + b];
+		band_parts_next[b+1] = band_parts_next[b] + size;
+	}
+}
+
+void Particle_simulator::migrate_particles(uint8_t th_id) {
+	Profiler::Scope scope(profiler, "migrate_particles");
+	uint32_t dest = band_parts_next[th_id];
+
+	// Particles staying in the band, in the same order
+	std::vector<Migrant>& out = migrants[th_id];
+	uint32_t m = 0;
+	// Each Particle has a single destination, so the threads write different entries of id_index
+	auto move = [&](uint32_t p) {
+		id_buffer[dest] = part_id[p];
+		id_index[part_id[p]] = dest;
+		particle_buffer[dest++] = particle_array[p];
+	};
+	for (uint32_t p=band_parts[th_id]; p<band_parts[th_id+1]; p++) {
+		if (m < out.size() && out[m].part == p) m++;
+		else move(p);
+	}
+
+	// Particles arriving from the other bands
+	for (uint32_t from=0; from<active_n_threads; from++) {
+		if (!migration_count[from*active_n_threads + th_id]) continue;
+		for (Migrant& migrant : migrants[from]) {
+			if (migrant.band == th_id) move(migrant.part);
+		}
+	}
+}
+
+void Particle_simulator::end_migration() {
+	Profiler::Scope scope(profiler, "end_migration");
+	particle_array.swap(particle_buffer);
+	part_id.swap(id_buffer);
+	band_parts.swap(band_parts_next);
+}
+
+void Particle_simulator::clamp_bands() {
+	for (uint32_t b=0; b<active_n_threads; b++) band_parts[b] = std::min(band_parts[b], nb_active_part);
+	band_parts[active_n_threads] = nb_active_part;
 }
 
 
@@ -420,6 +1274,11 @@ void Particle_simulator::update_pos(uint32_t p_start, uint32_t p_end) {
 		particle_array[p].position[0] += particle_array[p].speed[0] * params.dt;
 		particle_array[p].position[1] += particle_array[p].speed[1] * params.dt;
 	}
+	if (snapshot_filling) { // Each thread copies its own Particles while they are still in its cache
+		Snapshot& snapshot = snapshots.write_slot();
+		std::copy(particle_array.begin() + p_start, particle_array.begin() + p_end, snapshot.particles.begin() + p_start);
+		std::copy(part_id.begin() + p_start, part_id.begin() + p_end, snapshot.ids.begin() + p_start);
+	}
 }
 
 
@@ -452,6 +1311,11 @@ void Particle_simulator::collision_pp_grid(uint32_t p_start, uint32_t p_end) {
 	uint32_t p2;
 	uint16_t x, y;
 	uint16_t min_x, max_x, min_y, max_y;
+	// The 2 levels collisions also act between 2 and 4 radii
+	constexpr bool two_levels = collision_handler == &Particle_simulator::collision_pp_2lev || collision_handler == &Particle_simulator::collision_pp_coherent;
+	float contact_dist = (two_levels ? 4 : 2) * params.radii;
+	uint64_t candidates = 0;
+	uint64_t contacts = 0;
 	for (uint32_t p1=p_start; p1<p_end; p1++) {
 		next_pos[0] = particle_array[p1].position[0] + particle_array[p1].speed[0]*params.dt;
 		next_pos[1] = particle_array[p1].position[1] + particle_array[p1].speed[1]*params.dt;
@@ -475,6 +1339,8 @@ void Particle_simulator::collision_pp_grid(uint32_t p_start, uint32_t p_end) {
 						vec[0] = particle_array[p2].position[0] + particle_array[p2].speed[0]*params.dt - next_pos[0];
 						vec[1] = particle_array[p2].position[1] + particle_array[p2].speed[1]*params.dt - next_pos[1];
 						dist = sqrt(vec[0]*vec[0] + vec[1]*vec[1]);
+						candidates++;
+						contacts += dist < contact_dist;
 						// std::cout << "Comparing " << p1 << " with " << p2 << " : dits=" << dist;
 						// print_vect("vec", vec);
 						
@@ -492,6 +1358,9 @@ void Particle_simulator::collision_pp_grid(uint32_t p_start, uint32_t p_end) {
 		// std::cout << std::endl;
 
 	}
+	StepCounters& counters = StepCounters::local();
+	counters.pp_candidates += candidates;
+	counters.pp_contacts[std::min(params.pp_collision_fun, (uint8_t)3)] += contacts;
 }
 
 
@@ -648,30 +1517,37 @@ void Particle_simulator::collision_pl(uint32_t p_start, uint32_t p_end) {
 			check_collision_ps(p, s);
 		}
 	}
+	StepCounters::local().seg_candidates += (uint64_t)world.seg_array.size() * (p_end-p_start);
 }
 
 void Particle_simulator::comparison_ps_grid(uint32_t p_start, uint32_t p_end) {
 	// std::cout << "Particle_simulator::comparison_ps_grid()" << std::endl;
 	uint16_t x, y;
+	uint64_t candidates = 0;
 	for (uint32_t p=p_start; p<p_end; p++) {
 		if (world.getCellCoord_fromPos(particle_array[p].position[0], particle_array[p].position[1], &x, &y)) {
 			Cell_seg& cell = world.getCell_seg(x, y);
+			candidates += cell.nb_segs;
 			for (uint8_t seg=0; seg<cell.nb_segs; seg++) {
 				check_collision_ps(p, cell.segs[seg]);
 			}
 		}
 	}
+	StepCounters::local().seg_candidates += candidates;
 }
 
 void Particle_simulator::comparison_sp_grid(uint32_t c_start, uint32_t c_end, uint16_t seg_num) {
 	// std::cout << "Particle_simulator::comparison_sp_grid(" << c_start << ", " << c_end << ", " << seg_num << ")" << std::endl;
 	Segment& segment = world.seg_array[seg_num];
+	uint64_t candidates = 0;
 	for (uint32_t c=c_start; c<c_end; c++) {
 		Cell& cell = world.getCell(segment.cells[c][0], segment.cells[c][1]);
+		candidates += cell.nb_parts;
 		for (uint8_t p_c=0; p_c<cell.nb_parts; p_c++) {
 			check_collision_ps(cell.parts[p_c], seg_num);
 		}
 	}
+	StepCounters::local().seg_candidates += candidates;
 }
 
 void Particle_simulator::check_collision_ps(uint32_t p, uint16_t s) {
@@ -806,15 +1682,18 @@ void Particle_simulator::world_borders_rebound(uint32_t p_start, uint32_t p_end)
 
 void Particle_simulator::comparison_pz(uint32_t p_start, uint32_t p_end) {
 	// std::cout << "comparison_pz(" << p_start << ", " << p_end << ")" << std::endl;
+	uint64_t hits = 0;
 	for (uint32_t p=p_start; p<p_end; p++) {
 		for (uint16_t z=0; z<world.getNbOfZones(); z++) {
 			// check if the Particle p is in the Zone z
 			Zone& zone = world.getZone(z);
 			if (zone.check_in(particle_array[p].position)) {
 				zone_functions(p, zone);
+				hits++;
 			}
 		}
 	}
+	StepCounters::local().zone_hits += hits;
 }
 
 void Particle_simulator::comparison_zp(uint32_t c_start, uint32_t c_end, uint16_t zone_num) {
@@ -828,14 +1707,17 @@ void Particle_simulator::comparison_zp(uint32_t c_start, uint32_t c_end, uint16_
 	bounds[0][ zone.lc()] = zone.getLengthLowBound() + c_start;
 	bounds[1][ zone.lc()] = zone.getLengthLowBound() + c_end;
 	
+	uint64_t hits = 0;
 	for (uint16_t cy=bounds[0][1]; cy<bounds[1][1]; cy++) {
 		for (uint16_t cx=bounds[0][0]; cx<bounds[1][0]; cx++) {
 			Cell& cell = world.getCell(cx, cy);
+			hits += cell.nb_parts;
 			for (uint8_t p_c=0; p_c<cell.nb_parts; p_c++) {
 				zone_functions(cell.parts[p_c], zone);
 			}
 		}
 	}
+	StepCounters::local().zone_hits += hits;
 }
 
 void Particle_simulator::zone_functions(uint32_t p, Zone& zone) {
@@ -854,6 +1736,7 @@ void Particle_simulator::delete_NaNs(uint32_t p_start, uint32_t p_end) {
 				std::abs(particle_array[p1].position[0]) == INFINITY || std::abs(particle_array[p1].position[1]) == INFINITY) {
 			delete_particle(p1--);
 			p_end--; // p_end-- as I only use it on 1 thread for now. I'll need to think about it :/
+			StepCounters::local().nan_deletions++;
 			// found++;
 		}
 	}
@@ -995,7 +1878,15 @@ void Particle_simulator::delete_particle(uint32_t p) {
 	particle_array[nb_active_part-1] = particle_array[p];
 	particle_array[p] = swap;
 
+	// The last Particle takes its ID with it, and the ID of p is freed after the others
+	uint32_t id = part_id[p];
+	part_id[p] = part_id[nb_active_part-1];
+	id_index[part_id[p]] = p;
+	id_index[id] = NULLPART;
+	free_ids[(free_head + nb_max_part - nb_active_part) % nb_max_part] = id;
+
 	nb_active_part--;
+	StepCounters::local().deleted++;
 }
 
 /**
@@ -1023,9 +1914,13 @@ uint32_t Particle_simulator::create_particles(uint32_t n_particles) {
 	if (nb_active_part < nb_max_part) {
 		uint32_t before = nb_active_part;
 		nb_active_part = std::min(nb_active_part+n_particles, nb_max_part);
+		StepCounters::local().created += nb_active_part - before;
 
 		for (uint32_t p=before; p<nb_active_part; p++) {
 			particle_init(p, world.getSpawnRect());
+			part_id[p] = free_ids[free_head];
+			id_index[part_id[p]] = p;
+			free_head = (free_head + 1) % nb_max_part;
 		}
 		
 		return nb_active_part;
@@ -1037,38 +1932,122 @@ uint32_t Particle_simulator::create_particles(uint32_t n_particles) {
 
 void Particle_simulator::particle_init(uint32_t part, Rectangle pos_rect) {
 	// std::cout << "\tparticle_init(" << part << ") rect=[" << pos_rect.pos(0) << ", " << pos_rect.pos(1) << "],  [" << pos_rect.size(0) << ", " << pos_rect.size(1) << "]" << std::endl;
-	particle_array[part].position[0] = pos_rect.pos(0) + rand()*pos_rect.size(0)/RAND_MAX;
-	particle_array[part].position[1] = pos_rect.pos(1) + rand()*pos_rect.size(1)/RAND_MAX;
+	particle_array[part].position[0] = pos_rect.pos(0) + random(part, 0)*pos_rect.size(0);
+	particle_array[part].position[1] = pos_rect.pos(1) + random(part, 1)*pos_rect.size(1);
 
-	float theta = (float)rand()/RAND_MAX *2*M_PI;
+	float theta = random(part, 2) *2*M_PI;
 	particle_array[part].speed[0] = params.temperature*cos(theta) + params.spawn_speed[0];
 	particle_array[part].speed[1] = params.temperature*sin(theta) + params.spawn_speed[1];
 }
 
 
 bool Particle_simulator::load_next_positions() {
-	if (reinitialize_order) {
-		resetPosLoading();
-		reinitialize_order = false;
+	apply_commands(paused);
+	if (interpolator && replay_from.particles && replay_target == NULLPART && !finished_loading) {
+		// A new stride starts from the frame the displayed one is interpolated from, so the replay jumps back by less than a loaded frame
+		if (!replay_to.particles || (int64_t)replay_to.index - replay_from.index != replay_stride) replay_target = replay_from.index;
 	}
-	if (!finished_loading && (!paused || step || quickstep)) {
-		step = false;
-		if (quickstep) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	bool seeking = replay_target != NULLPART;
+	if (seeking || (!finished_loading && (!paused || step || quickstep))) {
+		if (!seeking) {
+			std::lock_guard<std::mutex> lock(order_mutex);
+			if (quickstep && !step && params.quickstep_sps > 0) { // The display thread calls this, so rather than sleeping it comes back later
+				if (std::chrono::steady_clock::now() - last_quickstep < std::chrono::duration<float>(1/params.quickstep_sps)) return finished_loading;
+				last_quickstep = std::chrono::steady_clock::now();
+			}
+			step = false;
+		}
 		conso.Start();
-		uint32_t returned = partLoader->loadPos(particle_array.data(), nb_max_part, &time[0]);
-		if (returned == NULLPART) {
-			finished_loading = true;
-			std::cout << "Finished loading particle positions" << std::endl;
-		} 
-		else nb_active_part = returned; 
+		if (interpolator) load_interpolated(seeking);
+		else {
+			ReplayInterpolator::Frame frame;
+			fetch_t fetched = fetch_frame(seeking, paused, frame);
+			if (fetched == fetch_t::READY) show_frame(frame);
+			else if (fetched == fetch_t::END) {
+				finished_loading = true;
+				std::cout << "Finished loading particle positions" << std::endl;
+			}
+		}
 		conso.Tick_fine(true);
 	}
 	return finished_loading;
 }
 
+Particle_simulator::fetch_t Particle_simulator::fetch_frame(bool seeking, bool wait, ReplayInterpolator::Frame& frame) {
+	if (reader) { // Taking the frame read ahead in the background
+		bool restarted = seeking || reader->get_stride() != replay_stride;
+		if (restarted) {
+			reader->restart(seeking ? replay_target : std::max<int64_t>((int64_t)replay_frame + replay_stride, 0), replay_stride);
+			replay_target = NULLPART;
+		}
+		bool end;
+		// While playing, the last frame stays displayed until the next one is read. After a restart it may be overwritten, so the next one is waited for
+		PosReader::Frame* read = reader->pop(restarted || wait, end);
+		if (!read && !end) return fetch_t::NOT_READY;
+		if (!read || read->n_parts == NULLPART) return fetch_t::END;
+		frame = {read->particles.data(), read->ids.empty() ? nullptr : read->ids.data(), read->n_parts, read->time, read->index};
+	}
+	else { // The frame is displayed where it is in the file, without copying it
+		int64_t target = seeking ? replay_target : (int64_t)replay_frame + replay_stride;
+		if (!replay_view && !seeking) target = 0; // Nothing was loaded yet
+		replay_target = NULLPART;
+		ReplayInterpolator::Frame mapped;
+		mapped.particles = target < 0 ? nullptr : partLoader->mapPos(target, &mapped.n_parts, &mapped.time, replay_stride, &mapped.ids);
+		if (!mapped.particles) return fetch_t::END;
+		mapped.n_parts = std::min(mapped.n_parts, nb_max_part);
+		mapped.index = target;
+		frame = mapped;
+	}
+	replay_frame = frame.index;
+	return fetch_t::READY;
+}
+
+void Particle_simulator::show_frame(const ReplayInterpolator::Frame& frame) {
+	replay_view = frame.particles;
+	replay_ids = frame.ids;
+	time[0] = frame.time;
+	nb_active_part = frame.n_parts;
+}
+
+void Particle_simulator::load_interpolated(bool seeking) {
+	if (!seeking && replay_to.particles && replay_sub+1 < SLI.replay_substeps) replay_sub++;
+	else {
+		ReplayInterpolator::Frame frame;
+		bool starting = seeking || !replay_to.particles; // Both ends of the interval are loaded
+		fetch_t fetched = fetch_frame(seeking, paused || starting, frame);
+		if (fetched == fetch_t::NOT_READY) return; // The end of the interval stays displayed
+		if (fetched == fetch_t::READY && starting) {
+			replay_from = frame;
+			show_frame(replay_from); // In case it is the last one
+			fetched = fetch_frame(false, true, frame);
+		}
+		else if (fetched == fetch_t::READY) replay_from = replay_to;
+		else if (!starting) { // The end of the last interval stays displayed
+			replay_from = replay_to;
+			show_frame(replay_from);
+		}
+
+		if (fetched != fetch_t::READY) {
+			replay_to = ReplayInterpolator::Frame();
+			finished_loading = true;
+			std::cout << "Finished loading particle positions" << std::endl;
+			return;
+		}
+		replay_to = frame;
+		replay_sub = 0;
+		interpolator->set_interval(replay_from, replay_to);
+	}
+
+	float s = (float)replay_sub / SLI.replay_substeps;
+	ReplayInterpolator::Frame shown = replay_from;
+	shown.particles = interpolator->interpolate(s);
+	shown.time = replay_from.time + s*(replay_to.time - replay_from.time);
+	show_frame(shown);
+}
+
 void Particle_simulator::resetPosLoading() {
 	if (partLoader) {
-		partLoader->resetPosLoading();
+		replay_target = 0; // Loaded even while paused
 		finished_loading = false;
 	}
 };
\ No newline at end of file
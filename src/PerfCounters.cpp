@@ -0,0 +1,111 @@
+#include "PerfCounters.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+const char* PerfCounters::event_names[PerfCounters::NB_EVENTS] = {"cycles", "instructions", "L1d misses", "LLC misses", "branch misses"};
+
+#ifdef __linux__
+/**
+* @brief Opens the event (type, config) for the calling thread on any CPU. group is the leader's file descriptor, or -1 to lead a new group.
+*/
+static int open_event(uint32_t type, uint64_t config, int group) {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group == -1; // The whole group is enabled at once
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static constexpr uint64_t cache_miss(uint64_t cache) {
+	return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+PerfCounters::PerfCounters() {
+	for (uint8_t e=0; e<NB_EVENTS; e++) {
+		fds[e] = -1;
+		slots[e] = -1;
+	}
+}
+
+PerfCounters::~PerfCounters() {
+	close();
+}
+
+bool PerfCounters::open(bool verbose) {
+	close();
+#ifdef __linux__
+	const uint32_t types[NB_EVENTS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+	const uint64_t configs[NB_EVENTS] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		cache_miss(PERF_COUNT_HW_CACHE_L1D),
+		PERF_COUNT_HW_CACHE_MISSES, // Usually the last level cache
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	fds[0] = open_event(types[0], configs[0], -1);
+	if (fds[0] < 0) {
+		if (verbose) std::cout << "Hardware counters unavailable : perf_event_open failed (" << std::strerror(errno) << "). See /proc/sys/kernel/perf_event_paranoid" << std::endl;
+		return false;
+	}
+	slots[0] = n_open++;
+	for (uint8_t e=1; e<NB_EVENTS; e++) {
+		fds[e] = open_event(types[e], configs[e], fds[0]);
+		if (fds[e] >= 0) slots[e] = n_open++;
+		else if (verbose) std::cout << "Hardware counter " << event_names[e] << " unavailable (" << std::strerror(errno) << ")" << std::endl;
+	}
+
+	ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+#else
+	if (verbose) std::cout << "Hardware counters are only read on Linux" << std::endl;
+	return false;
+#endif
+}
+
+void PerfCounters::close() {
+#ifdef __linux__
+	// The members first, then the leader
+	for (int8_t e=NB_EVENTS-1; e>=0; e--) {
+		if (fds[e] >= 0) ::close(fds[e]);
+	}
+#endif
+	for (uint8_t e=0; e<NB_EVENTS; e++) {
+		fds[e] = -1;
+		slots[e] = -1;
+	}
+	n_open = 0;
+}
+
+bool PerfCounters::read(Sample& sample) {
+	if (!n_open) return false;
+#ifdef __linux__
+	// Layout of a group reading : number of events, time enabled, time running, then the value of each event
+	uint64_t buffer[3 + NB_EVENTS];
+	if (::read(fds[0], buffer, (3 + n_open)*sizeof(uint64_t)) != (ssize_t)((3 + n_open)*sizeof(uint64_t))) return false;
+	double scale = buffer[2] && buffer[2] < buffer[1] ? (double)buffer[1] / buffer[2] : 1;
+	for (uint8_t e=0; e<NB_EVENTS; e++) {
+		sample.values[e] = slots[e] >= 0 ? (uint64_t)(buffer[3 + slots[e]] * scale) : 0;
+	}
+	return true;
+#else
+	(void)sample;
+	return false;
+#endif
+}
@@ -0,0 +1,371 @@
+#include "PosCodec.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// rANS with 32 bits states written 16 bits at a time, and probabilities on 12 bits
+#define RANS_SCALE_BITS 12
+#define RANS_SCALE (1u << RANS_SCALE_BITS)
+#define RANS_LOW (1u << 15) // Lower bound of the normalized state, so it stays below 2^31 as RansSymbol needs. A single 16 bits word is written or read per symbol at most
+
+#define HEADER_SIZE (4 + 1 + 4 + 1) // n_parts, flags, size of the varints, entropy coder
+#define TABLE_MAX_SIZE (1 + 256*3) // Number of symbols, then each symbol and its frequency
+#define RANS_STATES_SIZE 8 // Final states of the 2 interleaved rANS, written before their output
+
+enum coder_t : uint8_t {RAW, RANS};
+
+static inline void put_u32(uint8_t*& out, uint32_t v) {
+	std::memcpy(out, &v, 4);
+	out += 4;
+}
+
+static inline uint32_t get_u32(const uint8_t*& in) {
+	uint32_t v;
+	std::memcpy(&v, in, 4);
+	in += 4;
+	return v;
+}
+
+static inline uint16_t zigzag(uint16_t diff) {
+	return ((int16_t)diff >> 15) ^ (uint16_t)(diff << 1);
+}
+
+static inline uint16_t unzigzag(uint16_t z) {
+	return (z >> 1) ^ -(z & 1);
+}
+
+static inline uint32_t zigzag32(uint32_t diff) {
+	return ((int32_t)diff >> 31) ^ (diff << 1);
+}
+
+static inline uint32_t unzigzag32(uint32_t z) {
+	return (z >> 1) ^ -(z & 1);
+}
+
+/**
+* A symbol prepared for rANS encoding, with the division by its frequency replaced by a multiplication by its reciprocal (as in F. Giesen's rans_byte).
+*/
+struct RansSymbol {
+	uint32_t x_max; //< The state is renormalized to be below x_max before encoding the symbol.
+	uint32_t rcp_freq;
+	uint32_t bias;
+	uint16_t cmpl_freq;
+	uint16_t rcp_shift;
+
+	RansSymbol() = default;
+	RansSymbol(uint32_t start, uint32_t freq) {
+		x_max = ((RANS_LOW >> RANS_SCALE_BITS) << 16) * freq;
+		cmpl_freq = RANS_SCALE - freq;
+		if (freq < 2) { // x*RANS_SCALE + start, with rcp_freq*x >> 32 = x-1
+			rcp_freq = ~0u;
+			rcp_shift = 32;
+			bias = start + RANS_SCALE - 1;
+		}
+		else {
+			uint32_t shift = 0;
+			while (freq > (1u << shift)) shift++;
+			rcp_freq = (uint32_t)(((1ull << (shift + 31)) + freq-1) / freq);
+			rcp_shift = shift - 1 + 32;
+			bias = start;
+		}
+	};
+};
+
+/**
+* @brief Scales the counts of the symbols so they sum to RANS_SCALE, keeping every used symbol at least at 1.
+*/
+static void normalize_freqs(const uint32_t counts[256], uint32_t total, uint16_t freqs[256]) {
+	uint32_t sum = 0;
+	uint16_t largest = 0;
+	for (uint16_t s=0; s<256; s++) {
+		freqs[s] = counts[s] ? std::max((uint64_t)1, (uint64_t)counts[s] * RANS_SCALE / total) : 0;
+		sum += freqs[s];
+		if (freqs[s] > freqs[largest]) largest = s;
+	}
+	if (sum < RANS_SCALE) freqs[largest] += RANS_SCALE - sum;
+	while (sum > RANS_SCALE) { // Some rare symbols were raised to 1, taking it from the most frequent ones
+		for (uint16_t s=0; s<256; s++) if (freqs[s] > freqs[largest]) largest = s;
+		uint32_t take = std::min(sum - RANS_SCALE, (uint32_t)freqs[largest] / 2);
+		freqs[largest] -= take;
+		sum -= take;
+	}
+}
+
+PosCodec::PosCodec(uint8_t n_channels_, uint32_t max_particles_, uint32_t id_bound_) : n_channels(n_channels_), max_particles(max_particles_), id_bound(id_bound_) {
+	for (uint8_t b=0; b<(id_bound ? 5 : 3); b++) buffers[b].assign((size_t)n_channels * max_particles, 0);
+	current = buffers[0].data();
+	previous = buffers[1].data();
+	before = buffers[2].data();
+	aligned_previous = buffers[3].data();
+	aligned_before = buffers[4].data();
+	varints.resize(3 * (size_t)n_channels * max_particles);
+	if (id_bound) {
+		for (std::vector<uint32_t>& buffer : id_buffers) buffer.assign(max_particles, 0);
+		ids = id_buffers[0].data();
+		previous_ids = id_buffers[1].data();
+		id_slot.assign(id_bound, NO_SLOT);
+		history.assign(max_particles, 0);
+		previous_history.assign(max_particles, 0);
+		varints.resize(varints.size() + 5 * (size_t)max_particles); // An ID takes up to 5 bytes
+	}
+	coded.resize(2*varints.size() + 16);
+}
+
+void PosCodec::reset() {
+	if (id_bound) {
+		for (uint32_t p=0; p<n_previous; p++) if (previous_ids[p] < id_bound) id_slot[previous_ids[p]] = NO_SLOT;
+	}
+	n_previous = 0;
+	n_before = 0;
+	frames_since_key = 0;
+}
+
+void PosCodec::rotate(uint32_t n_parts) {
+	if (id_bound) {
+		for (uint32_t p=0; p<n_previous; p++) if (previous_ids[p] < id_bound) id_slot[previous_ids[p]] = NO_SLOT;
+		for (uint32_t p=0; p<n_parts; p++) {
+			if (ids[p] < id_bound) id_slot[ids[p]] = p;
+			previous_history[p] = std::min(history[p]+1, 2);
+		}
+		std::swap(ids, previous_ids);
+		// The frame before the new one is the last one, in the order of the new one
+		uint16_t* free_buffer = previous;
+		previous = current;
+		current = free_buffer;
+		std::swap(before, aligned_previous);
+		n_previous = n_parts;
+		return;
+	}
+	uint16_t* oldest = before;
+	before = previous;
+	previous = current;
+	current = oldest;
+	n_before = isLastKey() ? 0 : std::min(n_previous, n_parts); // The frame after a keyframe mustn't depend on the frames before it either
+	n_previous = n_parts;
+}
+
+void PosCodec::align(uint32_t n_parts, bool key) {
+	for (uint32_t p=0; p<n_parts; p++) {
+		uint32_t slot = !key && ids[p] < id_bound ? id_slot[ids[p]] : NO_SLOT;
+		history[p] = slot == NO_SLOT ? 0 : previous_history[slot];
+		if (!history[p]) continue;
+		for (uint8_t c=0; c<n_channels; c++) {
+			aligned_previous[c*max_particles + p] = previous[c*max_particles + slot];
+			aligned_before[c*max_particles + p] = before[c*max_particles + slot];
+		}
+	}
+}
+
+template<typename F> void PosCodec::predict_channel(uint8_t order, uint8_t c, uint32_t n_parts, F&& use) const {
+	uint32_t p = 0;
+	if (id_bound) {
+		for (; p<n_parts; p++) use(p, predict(order, c, p));
+		return;
+	}
+	const uint16_t* prev = previous + c*max_particles;
+	const uint16_t* bef = before + c*max_particles;
+	if (order == 2) for (; p<std::min(n_before, n_parts); p++) use(p, 2*prev[p] - bef[p]);
+	if (order >= 1) for (; p<std::min(n_previous, n_parts); p++) use(p, prev[p]);
+	for (; p<n_parts; p++) use(p, 0);
+}
+
+size_t PosCodec::max_encoded_size() const {
+	return HEADER_SIZE + n_channels + TABLE_MAX_SIZE + 4 + varints.size();
+}
+
+size_t PosCodec::encode(uint32_t n_parts, uint8_t* out) {
+	n_parts = std::min(n_parts, max_particles);
+	bool key = !n_previous || frames_since_key >= KEYFRAME_INTERVAL;
+	frames_since_key = key ? 1 : frames_since_key+1;
+
+	uint8_t* start = out;
+	put_u32(out, n_parts);
+	*out++ = key; // At KEY_BYTE
+	uint8_t* orders = out;
+	out += n_channels;
+
+	uint8_t* v = varints.data();
+	auto put = [&v](uint32_t z) {
+		while (z >= 0x80) {
+			*v++ = (z & 0x7f) | 0x80;
+			z >>= 7;
+		}
+		*v++ = z;
+	};
+	// IDs, predicted from the same index in the previous frame, or following the one before them as new Particles take the IDs freed in order
+	if (id_bound) {
+		for (uint32_t p=0; p<n_parts; p++) {
+			uint32_t prediction = !key && p < n_previous ? previous_ids[p] : (p ? ids[p-1]+1 : 0);
+			put(zigzag32(ids[p] - prediction));
+		}
+		align(n_parts, key);
+	}
+
+	// Differences with the best prediction of each channel
+	for (uint8_t c=0; c<n_channels; c++) {
+		const uint16_t* values = frame(c);
+		uint8_t order = 0;
+		if (!key) {
+			// Estimating on a sample is enough to choose
+			uint64_t cost[3] = {0, 0, 0};
+			for (uint32_t p=0; p<(id_bound ? n_parts : std::min(n_before, n_parts)); p+=8) {
+				for (uint8_t o=1; o<=2; o++) cost[o] += std::abs((int16_t)(values[p] - predict(o, c, p)));
+			}
+			order = cost[2] < cost[1] ? 2 : 1;
+		}
+		orders[c] = order;
+		predict_channel(order, c, n_parts, [&](uint32_t p, uint16_t prediction) {put(zigzag(values[p] - prediction));});
+	}
+	uint32_t n_varints = v - varints.data();
+	put_u32(out, n_varints);
+
+	// Entropy coding, kept only if it is smaller
+	uint32_t counts[256] = {0};
+	for (uint32_t i=0; i<n_varints; i++) counts[varints[i]]++;
+	uint16_t freqs[256];
+	normalize_freqs(counts, std::max(n_varints, (uint32_t)1), freqs);
+	uint16_t n_symbols = 0;
+	RansSymbol symbols[256];
+	for (uint16_t s=0, c=0; s<256; s++) {
+		if (freqs[s]) symbols[s] = RansSymbol(c, freqs[s]);
+		c += freqs[s];
+		n_symbols += freqs[s] > 0;
+	}
+
+	// 2 interleaved states, so the encoding of a symbol doesn't wait for the previous one
+	uint8_t* end = coded.data() + coded.size();
+	uint8_t* ptr = end;
+	auto put_symbol = [&ptr](uint32_t& x, const RansSymbol& sym) {
+		// Without branch as whether a word is written is unpredictable. When it isn't, the word is written in the free space and ptr doesn't move
+		uint32_t emit = x >= sym.x_max;
+		uint16_t word = x;
+		std::memcpy(ptr - 2, &word, 2);
+		ptr -= 2*emit;
+		x >>= 16*emit;
+		x += sym.bias + (uint32_t)(((uint64_t)x * sym.rcp_freq) >> sym.rcp_shift) * sym.cmpl_freq; // x = (x/freq)*RANS_SCALE + x%freq + start, without dividing
+	};
+	// rANS decodes backward, so it is encoded from the end. Symbol i goes to the state i%2
+	uint32_t states[2] = {RANS_LOW, RANS_LOW};
+	uint32_t i = n_varints;
+	if (i & 1) {
+		i--;
+		put_symbol(states[0], symbols[varints[i]]);
+	}
+	while (i) {
+		i -= 2;
+		put_symbol(states[1], symbols[varints[i+1]]);
+		put_symbol(states[0], symbols[varints[i]]);
+	}
+	ptr -= RANS_STATES_SIZE;
+	std::memcpy(ptr, states, RANS_STATES_SIZE);
+	size_t rans_size = end - ptr;
+
+	if (n_varints && 1 + n_symbols*3 + 4 + rans_size < n_varints) {
+		*out++ = RANS;
+		*out++ = n_symbols-1;
+		for (uint16_t s=0; s<256; s++) {
+			if (!freqs[s]) continue;
+			*out++ = s;
+			std::memcpy(out, &freqs[s], 2);
+			out += 2;
+		}
+		put_u32(out, rans_size);
+		std::memcpy(out, ptr, rans_size);
+		out += rans_size;
+	}
+	else {
+		*out++ = RAW;
+		std::memcpy(out, varints.data(), n_varints);
+		out += n_varints;
+	}
+
+	rotate(n_parts);
+	return out - start;
+}
+
+uint32_t PosCodec::decode(const uint8_t* in, size_t size) {
+	const uint32_t CORRUPTED = -1;
+	const uint8_t* in_end = in + size;
+	if (size < (size_t)HEADER_SIZE + n_channels) return CORRUPTED;
+	uint32_t n_parts = get_u32(in);
+	bool key = *in++;
+	const uint8_t* orders = in;
+	in += n_channels;
+	uint32_t n_varints = get_u32(in);
+	uint8_t coder = *in++;
+	if (n_parts > max_particles || n_varints > varints.size() || (!key && !n_previous)) return CORRUPTED;
+	for (uint8_t c=0; c<n_channels; c++) if (orders[c] > 2) return CORRUPTED;
+
+	if (coder == RAW) {
+		if ((size_t)(in_end - in) < n_varints) return CORRUPTED;
+		std::memcpy(varints.data(), in, n_varints);
+	}
+	else if (coder == RANS) {
+		if (in_end - in < 1) return CORRUPTED;
+		uint16_t n_symbols = *in++ + 1;
+		if (in_end - in < n_symbols*3 + 4) return CORRUPTED;
+		uint16_t freqs[256] = {0}, cumul[256];
+		for (uint16_t i=0; i<n_symbols; i++) {
+			uint8_t s = *in++;
+			std::memcpy(&freqs[s], in, 2);
+			in += 2;
+		}
+		uint8_t slot_symbol[RANS_SCALE];
+		uint32_t c = 0;
+		for (uint16_t s=0; s<256; s++) {
+			cumul[s] = c;
+			if (c + freqs[s] > RANS_SCALE) return CORRUPTED;
+			std::memset(slot_symbol + c, s, freqs[s]);
+			c += freqs[s];
+		}
+		if (c != RANS_SCALE) return CORRUPTED;
+
+		uint32_t rans_size = get_u32(in);
+		if (rans_size < RANS_STATES_SIZE || (size_t)(in_end - in) < rans_size) return CORRUPTED;
+		const uint8_t* end = in + rans_size;
+		uint32_t states[2];
+		std::memcpy(states, in, RANS_STATES_SIZE);
+		in += RANS_STATES_SIZE;
+		for (uint32_t i=0; i<n_varints; i++) {
+			uint32_t& x = states[i & 1];
+			uint32_t slot = x & (RANS_SCALE-1);
+			uint8_t s = slot_symbol[slot];
+			varints[i] = s;
+			x = freqs[s] * (x >> RANS_SCALE_BITS) + slot - cumul[s];
+			if (x < RANS_LOW && end - in >= 2) {
+				uint16_t word;
+				std::memcpy(&word, in, 2);
+				in += 2;
+				x = (x << 16) | word;
+			}
+		}
+	}
+	else return CORRUPTED;
+
+	const uint8_t* v = varints.data();
+	const uint8_t* v_end = v + n_varints;
+	auto get = [&v, v_end](uint8_t bits) {
+		uint32_t z = 0;
+		for (uint8_t shift=0; shift<bits && v < v_end; shift+=7) {
+			uint8_t byte = *v++;
+			z |= (uint32_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) break;
+		}
+		return z;
+	};
+	if (id_bound) {
+		for (uint32_t p=0; p<n_parts; p++) {
+			uint32_t prediction = !key && p < n_previous ? previous_ids[p] : (p ? ids[p-1]+1 : 0);
+			ids[p] = unzigzag32(get(32)) + prediction;
+		}
+		align(n_parts, key);
+	}
+	for (uint8_t c=0; c<n_channels; c++) {
+		uint16_t* values = frame(c);
+		predict_channel(orders[c], c, n_parts, [&](uint32_t p, uint16_t prediction) {values[p] = unzigzag(get(16)) + prediction;});
+	}
+	frames_since_key = key ? 1 : frames_since_key+1;
+	rotate(n_parts);
+	return n_parts;
+}
@@ -0,0 +1,88 @@
+#include "PosReader.hpp"
+#include "SaveLoader.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+PosReader::PosReader(SaveLoader& loader_, uint32_t max_particles, uint8_t n_held_, uint8_t n_frames) : loader(loader_), n_file_frames(loader_.getPosFrameCount()), n_held(std::max(n_held_, (uint8_t)1)) {
+	size_t part_size = sizeof(Particle) + (loader.getCompression().isSaveIds() ? sizeof(uint32_t) : 0);
+	n_frames = std::min<uint64_t>(n_frames, MAX_POOL_BYTES / (max_particles*part_size + 1));
+	n_frames = std::max(n_frames, (uint8_t)(n_held+1)); // n_held are displayed while the others are read
+	frames.resize(n_frames);
+	for (Frame& frame : frames) {
+		frame.particles.resize(max_particles);
+		if (loader.getCompression().isSaveIds()) frame.ids.resize(max_particles);
+	}
+	ready.assign(n_frames, 0);
+	n_seq = n_file_frames;
+
+	bool parallel = loader.isPosMapped();
+	uint32_t n_threads = parallel ? std::min(std::max(std::thread::hardware_concurrency()/2, 1u), (uint32_t)n_frames-n_held) : 1;
+	std::cout << "\tReading up to " << n_frames-n_held << " frames ahead on " << n_threads << " thread" << (n_threads > 1 ? "s" : "") << std::endl;
+	for (uint32_t t=0; t<n_threads; t++) threads.emplace_back(&PosReader::decode_frames, this, parallel);
+}
+
+PosReader::~PosReader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	work.notify_all();
+	decoded.notify_all();
+	for (std::thread& thread : threads) thread.join();
+}
+
+void PosReader::decode_frames(bool parallel) {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		// The slots of the frames given by the last n_held pops are kept for the display
+		work.wait(lock, [this]() {return !running || (next_seq < n_seq && next_seq < head + frames.size() - n_held);});
+		if (!running) return;
+		uint64_t seq = next_seq++;
+		uint32_t index = start + (int64_t)seq * stride;
+		Frame& frame = frames[seq % frames.size()];
+		in_flight++;
+		lock.unlock();
+
+		uint32_t* ids = frame.ids.empty() ? nullptr : frame.ids.data();
+		if (parallel) frame.n_parts = loader.decodePos(index, frame.particles.data(), frame.particles.size(), &frame.time, ids);
+		else frame.n_parts = loader.seekPos(index, frame.particles.data(), frame.particles.size(), &frame.time, ids);
+		frame.index = index;
+
+		lock.lock();
+		in_flight--;
+		ready[seq % frames.size()] = seq + 1;
+		decoded.notify_all();
+	}
+}
+
+void PosReader::restart(uint32_t first, int32_t stride_) {
+	std::unique_lock<std::mutex> lock(mutex);
+	n_seq = 0; // No new frame is started
+	decoded.wait(lock, [this]() {return !in_flight;});
+
+	start = first;
+	stride = stride_ ? stride_ : 1;
+	if (first >= n_file_frames) n_seq = 0;
+	else if (stride > 0) n_seq = (n_file_frames-1 - first) / stride + 1;
+	else n_seq = first / -stride + 1;
+	next_seq = 0;
+	head = 0;
+	std::fill(ready.begin(), ready.end(), 0);
+	work.notify_all();
+}
+
+PosReader::Frame* PosReader::pop(bool wait, bool& end) {
+	std::unique_lock<std::mutex> lock(mutex);
+	end = head >= n_seq;
+	if (end) return nullptr;
+	uint32_t slot = head % frames.size();
+	if (ready[slot] != head + 1) {
+		if (!wait) return nullptr;
+		decoded.wait(lock, [&]() {return !running || ready[slot] == head + 1;});
+		if (!running) return nullptr;
+	}
+	head++;
+	work.notify_all(); // The slot of the frame given n_held pops ago is free
+	return &frames[slot];
+}
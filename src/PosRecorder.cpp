@@ -0,0 +1,114 @@
+#include "PosRecorder.hpp"
+#include "SaveLoader.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+PosRecorder::PosRecorder(SaveLoader& saver_, uint32_t max_particles, double min_delta_time_, policy_t policy_, uint8_t n_frames)
+	: saver(saver_), policy(policy_), min_delta_time(min_delta_time_), free_frames(n_frames), full_frames(n_frames) {
+	n_frames = std::max(n_frames, (uint8_t)1);
+	frames.resize(n_frames);
+	for (uint8_t f=0; f<n_frames; f++) {
+		frames[f].particles.resize(max_particles);
+		if (saver.getCompression().isSaveIds()) frames[f].ids.resize(max_particles);
+		free_frames.push(f);
+	}
+	std::cout << "\tRecording positions in the background with " << (short)n_frames << " frames of " << max_particles*sizeof(Particle) << " bytes, "
+		<< (policy == policy_t::WAIT ? "waiting for the disk" : "dropping frames") << " when they are all in use" << std::endl;
+	writer = std::thread(&PosRecorder::write_frames, this);
+}
+
+PosRecorder::~PosRecorder() {
+	stop();
+}
+
+void PosRecorder::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	frame_full.notify_one();
+	if (writer.joinable()) writer.join();
+}
+
+bool PosRecorder::record(const Particle* particle_array, uint32_t part_arr_size, double time, const uint32_t* ids) {
+	if (time - time_of_last_record < min_delta_time) return false;
+	time_of_last_record = time;
+
+	uint8_t f;
+	if (!free_frames.pop(f)) {
+		if (policy == policy_t::DROP) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		auto stall_start = std::chrono::steady_clock::now();
+		std::unique_lock<std::mutex> lock(mutex);
+		frame_free.wait(lock, [&]() {return !running || free_frames.pop(f);});
+		if (!running) return false;
+		stall_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - stall_start).count(), std::memory_order_relaxed);
+	}
+
+	Frame& frame = frames[f];
+	part_arr_size = std::min(part_arr_size, (uint32_t)frame.particles.size());
+	std::memcpy(frame.particles.data(), particle_array, part_arr_size*sizeof(Particle));
+	frame.has_ids = ids && frame.ids.size();
+	if (frame.has_ids) std::memcpy(frame.ids.data(), ids, part_arr_size*sizeof(uint32_t));
+	frame.n_parts = part_arr_size;
+	frame.time = time;
+	full_frames.push(f); // Can't fail, there are as many slots as frames
+	recorded.fetch_add(1, std::memory_order_relaxed);
+
+	uint32_t depth = full_frames.size();
+	if (depth > max_queue_depth.load(std::memory_order_relaxed)) max_queue_depth.store(depth, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(mutex); // So the writer can't miss the notification between checking the queue and sleeping
+	}
+	frame_full.notify_one();
+	return true;
+}
+
+void PosRecorder::write_frames() {
+	uint8_t f;
+	while (true) {
+		if (!full_frames.pop(f)) {
+			std::unique_lock<std::mutex> lock(mutex);
+			if (!running && !full_frames.size()) return; // Everything was written
+			frame_full.wait(lock, [this]() {return !running || full_frames.size();});
+			continue;
+		}
+
+		Frame& frame = frames[f];
+		uint64_t written_before = saver.getWrittenBytes();
+		auto write_start = std::chrono::steady_clock::now();
+		saver.savePos(frame.particles.data(), frame.n_parts, frame.time, frame.has_ids ? frame.ids.data() : nullptr);
+		write_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - write_start).count(), std::memory_order_relaxed);
+		bytes.fetch_add(saver.getWrittenBytes() - written_before, std::memory_order_relaxed);
+
+		free_frames.push(f);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+		}
+		frame_free.notify_one();
+	}
+}
+
+PosRecorder::Stats PosRecorder::get_stats() {
+	Stats stats;
+	stats.queue_depth = full_frames.size();
+	stats.max_queue_depth = max_queue_depth.load(std::memory_order_relaxed);
+	stats.capacity = frames.size();
+	stats.recorded = recorded.load(std::memory_order_relaxed);
+	stats.dropped = dropped.load(std::memory_order_relaxed);
+	stats.bytes = bytes.load(std::memory_order_relaxed);
+	stats.write_s = write_ns.load(std::memory_order_relaxed) / 1e9;
+	stats.stall_s = stall_ns.load(std::memory_order_relaxed) / 1e9;
+	return stats;
+}
+
+void PosRecorder::print_stats() {
+	Stats stats = get_stats();
+	std::cout << "Position recorder : " << stats.recorded << " frames recorded, " << stats.dropped << " dropped" << std::endl;
+	std::cout << "\tqueue depth " << stats.queue_depth << "/" << stats.capacity << " (at most " << stats.max_queue_depth << ")" << std::endl;
+	std::cout << "\t" << stats.bytes / 1000000.f << " MB written at " << stats.MBps() << " MB/s, simulation waited " << stats.stall_s << " s for the disk" << std::endl;
+}
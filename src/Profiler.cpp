@@ -0,0 +1,57 @@
+#include "Profiler.hpp"
+
+#include <fstream>
+#include <iostream>
+
+thread_local int16_t Profiler::thread_index = -1;
+
+Profiler::Profiler(uint32_t capacity_) : capacity(capacity_ ? capacity_ : 1) {
+	epoch = std::chrono::steady_clock::now();
+}
+
+void Profiler::set_nb_threads(uint16_t n) {
+	if (n == n_threads) return;
+	rings.reset(new Ring[n]);
+	for (uint16_t t=0; t<n; t++) rings[t].events.reset(new Event[capacity]);
+	n_threads = n;
+}
+
+void Profiler::start_recording() {
+	recording_start = now();
+	enabled = true;
+}
+
+bool Profiler::export_chrome_trace(const std::string& file_name) {
+	std::ofstream file(file_name);
+	if (!file.is_open()) {
+		std::cout << "Couldn't open " << file_name << std::endl;
+		return false;
+	}
+
+	uint64_t n_events = 0;
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Particle_sim2\"}}";
+	for (uint16_t t=0; t<n_threads; t++) {
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t << ",\"args\":{\"name\":\"Simulation thread " << t << "\"}}";
+
+		Ring& ring = rings[t];
+		uint64_t written = ring.written.load(std::memory_order_acquire);
+		// The oldest events may be overwritten while copying them, so an eighth of the ring is left aside
+		uint64_t margin = capacity / 8;
+		uint64_t first = written > capacity - margin ? written - (capacity - margin) : 0;
+		for (uint64_t e=first; e<written; e++) {
+			Event event = ring.events[e % capacity];
+			if (event.start < recording_start) continue;
+			// Timestamps are in µs
+			file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t
+				<< ",\"ts\":" << event.start / 1000 << '.' << (char)('0' + event.start / 100 % 10)
+				<< ",\"dur\":" << (event.end - event.start) / 1000 << '.' << (char)('0' + (event.end - event.start) / 100 % 10) << '}';
+			n_events++;
+		}
+	}
+	file << "\n]}\n";
+	file.close();
+
+	std::cout << "Trace of " << n_events << " events written in " << file_name << std::endl;
+	return true;
+}
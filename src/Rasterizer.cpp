@@ -0,0 +1,168 @@
+#include "Rasterizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+Rasterizer::Rasterizer(World& world, uint32_t width_, float radius_, float max_speed_, uint32_t n_threads)
+	: width(std::max(width_, 2u)), max_speed(max_speed_ > 0 ? max_speed_ : 1) {
+	scale = width / world.getSize(0);
+	height = std::max<uint32_t>(std::lround(world.getSize(1) * scale / 2) * 2, 2);
+	radius = radius_ * scale;
+	n_tiles = (height + TILE_ROWS-1) / TILE_ROWS;
+	pixels.resize((size_t)width*height*4);
+
+	background.assign((size_t)width*height*4, 0);
+	for (size_t i=3; i<background.size(); i+=4) background[i] = 255;
+	const float zone_colour[3] = {0, 0, 255};
+	for (uint16_t z=0; z<world.getNbOfZones(); z++) {
+		Zone& zone = world.getZone(z);
+		uint32_t x0 = std::min<float>(std::max(std::lround(zone.pos(0) * scale), 0l), width);
+		uint32_t x1 = std::min<float>(std::max(std::lround(zone.endPos(0) * scale), 0l), width);
+		uint32_t y0 = std::min<float>(std::max(std::lround(zone.pos(1) * scale), 0l), height);
+		uint32_t y1 = std::min<float>(std::max(std::lround(zone.endPos(1) * scale), 0l), height);
+		for (uint32_t y=y0; y<y1; y++) {
+			for (uint32_t x=x0; x<x1; x++) blend(&background[4*((size_t)y*width + x)], zone_colour, 0.25f);
+		}
+	}
+
+	overlay.assign((size_t)width*height, 0);
+	float corners[4][2] = {{0, 0}, {world.getSize(0), 0}, {world.getSize(0), world.getSize(1)}, {0, world.getSize(1)}};
+	for (uint8_t c=0; c<4; c++) draw_line(corners[c], corners[(c+1)%4]);
+	for (const Segment& segment : world.seg_array) draw_line(segment.pos[0], segment.pos[1]);
+
+	if (!n_threads) n_threads = std::max(std::thread::hardware_concurrency()/2, 1u);
+	n_threads = std::min(n_threads, 255u);
+	tile_parts.resize((size_t)n_threads*n_tiles);
+	for (uint32_t t=1; t<n_threads; t++) threads.emplace_back(&Rasterizer::help, this, t);
+}
+
+Rasterizer::~Rasterizer() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	work.notify_all();
+	for (std::thread& thread : threads) thread.join();
+}
+
+void Rasterizer::help(uint8_t th_id) {
+	uint64_t seen = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		work.wait(lock, [&]() {return !running || generation != seen;});
+		if (!running) return;
+		seen = generation;
+		if (th_id >= job_threads) continue; // Not needed for this job
+		lock.unlock();
+
+		(this->*job)(th_id, job_threads);
+
+		lock.lock();
+		if (!--n_working) done.notify_all();
+	}
+}
+
+void Rasterizer::run(void (Rasterizer::*job_)(uint8_t, uint8_t), uint8_t n_threads) {
+	if (n_threads <= 1) {
+		(this->*job_)(0, 1);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = job_;
+		job_threads = n_threads;
+		n_working = n_threads-1;
+		generation++;
+	}
+	work.notify_all();
+	(this->*job_)(0, n_threads);
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() {return !n_working;});
+}
+
+void Rasterizer::draw_line(const float a[2], const float b[2]) {
+	float start[2] = {a[0] * scale, a[1] * scale};
+	float move[2] = {(b[0] - a[0]) * scale, (b[1] - a[1]) * scale};
+	uint32_t steps = std::max<float>(std::ceil(std::max(std::abs(move[0]), std::abs(move[1]))), 1);
+	for (uint32_t i=0; i<=steps; i++) { // One pixel per row or column crossed
+		int32_t x = std::floor(start[0] + move[0] * i / steps);
+		int32_t y = std::floor(start[1] + move[1] * i / steps);
+		x = std::min(std::max(x, 0), (int32_t)width-1); // The world's borders are on the last pixels
+		y = std::min(std::max(y, 0), (int32_t)height-1);
+		overlay[(size_t)y*width + x] = 255;
+	}
+}
+
+const uint8_t* Rasterizer::draw(const Particle* particles_, uint32_t n_parts_) {
+	particles = particles_;
+	n_parts = n_parts_;
+	n_sorting = n_parts < MIN_PARALLEL ? 1 : getThreads();
+	run(&Rasterizer::sort, n_sorting);
+	next_tile = 0;
+	run(&Rasterizer::draw_tiles, getThreads());
+	return pixels.data();
+}
+
+void Rasterizer::sort(uint8_t th_id, uint8_t n_threads) {
+	std::vector<uint32_t>* lists = &tile_parts[(size_t)th_id*n_tiles];
+	for (uint32_t tile=0; tile<n_tiles; tile++) lists[tile].clear();
+	float reach = std::max(radius, 0.5f);
+	uint32_t start = (uint64_t)n_parts* th_id   /n_threads;
+	uint32_t end =   (uint64_t)n_parts*(th_id+1)/n_threads;
+	for (uint32_t p=start; p<end; p++) {
+		float x = particles[p].position[0] * scale;
+		float y = particles[p].position[1] * scale;
+		if (!(x > -reach && x < width + reach && y > -reach && y < height + reach)) continue; // Also skips NaNs
+		uint32_t first = std::max<float>(std::floor(y - reach), 0) / TILE_ROWS;
+		uint32_t last = std::min<float>(std::floor(y + reach), height-1) / TILE_ROWS;
+		for (uint32_t tile=first; tile<=last; tile++) lists[tile].push_back(p);
+	}
+}
+
+void Rasterizer::draw_tiles(uint8_t th_id, uint8_t n_threads) {
+	for (uint32_t tile = next_tile++; tile < n_tiles; tile = next_tile++) draw_tile(tile);
+}
+
+void Rasterizer::draw_tile(uint32_t tile) {
+	int32_t row_start = tile * TILE_ROWS;
+	int32_t row_end = std::min(row_start + TILE_ROWS, height);
+	std::memcpy(&pixels[(size_t)row_start*width*4], &background[(size_t)row_start*width*4], (size_t)(row_end-row_start)*width*4);
+
+	float inv_radius = radius > 0 ? 1/radius : 0;
+	float dot_alpha = std::min((float)M_PI * radius*radius, 1.f);
+	for (uint8_t t=0; t<n_sorting; t++) { // The threads sorted consecutive shares, so the Particles stay in order
+		for (uint32_t p : tile_parts[(size_t)t*n_tiles + tile]) {
+			const Particle& part = particles[p];
+			float speed_ratio = std::sqrt(part.speed[0]*part.speed[0] + part.speed[1]*part.speed[1]) / max_speed;
+			float colour[3] = {255 * std::min(speed_ratio, 1.f), 255 * std::min(speed_ratio/4, 1.f), 255 * std::min(speed_ratio/8, 1.f)};
+			float cx = part.position[0] * scale;
+			float cy = part.position[1] * scale;
+
+			if (radius < 0.75f) { // Smaller than a pixel : only the pixel it is in, as opaque as the disc covers it
+				int32_t x = std::floor(cx), y = std::floor(cy);
+				if (x >= 0 && x < (int32_t)width && y >= row_start && y < row_end) blend(&pixels[4*((size_t)y*width + x)], colour, dot_alpha);
+				continue;
+			}
+			int32_t y0 = std::max<float>(std::floor(cy - radius), row_start);
+			int32_t y1 = std::min<float>(std::floor(cy + radius), row_end-1);
+			int32_t x0 = std::max<float>(std::floor(cx - radius), 0);
+			int32_t x1 = std::min<float>(std::floor(cx + radius), width-1);
+			for (int32_t y=y0; y<=y1; y++) {
+				float dy = (y + 0.5f - cy) * inv_radius;
+				for (int32_t x=x0; x<=x1; x++) {
+					float dx = (x + 0.5f - cx) * inv_radius;
+					float dist2 = dx*dx + dy*dy;
+					if (dist2 >= 1) continue;
+					float edge = std::min(std::max((std::sqrt(dist2) - 0.8f) * 5, 0.f), 1.f); // The same edge as in shader/particle.frag.glsl
+					blend(&pixels[4*((size_t)y*width + x)], colour, 1 - edge*edge*(3 - 2*edge));
+				}
+			}
+		}
+	}
+
+	const float white[3] = {255, 255, 255};
+	for (size_t i = (size_t)row_start*width; i < (size_t)row_end*width; i++) {
+		if (overlay[i]) blend(&pixels[4*i], white, overlay[i] / 255.f);
+	}
+}
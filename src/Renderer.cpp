@@ -3,6 +3,10 @@
 #include "Segment.hpp"
 #include "World.hpp"
 
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
 
 #if OPENGL_INCLUDE_SUCCESS
 // CODE USING OpenGL FOR DISPLAYING
@@ -18,6 +22,10 @@ std::vector<Attribute> cell_attr = {
 std::vector<Attribute> default_attr = { // just 2D position for when nothing else is really needed
 	Attribute(OPGL::Type::FLOAT, 2),
 };
+std::vector<Attribute> density_attr = { // 2D position and texture coordinates
+	Attribute(OPGL::Type::FLOAT, 2),
+	Attribute(OPGL::Type::FLOAT, 2),
+};
 
 // VertexArray(const std::vector<Attribute>& attribute_list, OPGL::DrawUse usage_, OPGL::Primitive primitive_, uint64_t number_of_vertices=0, void* vertices_=nullptr, size_t mem_size_vertices = 0)
 
@@ -36,6 +44,7 @@ Renderer::Renderer(Particle_simulator& particle_sim_) :
 	worldGrid_vertices.set(cell_attr, OPGL::DrawUse::DYNAMIC_DRAW, OPGL::Primitive::POINTS);
 	zone_vertices.set(default_attr, OPGL::DrawUse::STATIC_DRAW, OPGL::Primitive::TRIANGLES, 6*particle_sim.world.getNbOfZones());
 	user_interact_zone.set(default_attr, OPGL::DrawUse::DYNAMIC_DRAW, OPGL::Primitive::LINE_LOOP, 30);
+	density_vertices.set(density_attr, OPGL::DrawUse::DYNAMIC_DRAW, OPGL::Primitive::TRIANGLE_STRIP, 4);
 
 	if (dp_worldGrid) {
 		worldGrid_vertices.setupMemory(particle_sim.world.getGridSize(0) * particle_sim.world.getGridSize(1));
@@ -63,6 +72,7 @@ Renderer::Renderer(Particle_simulator& particle_sim_) :
 		if (default_shader.loadFromFile("shader/default.vert.glsl", "shader/default.frag.glsl")) {
 			// default_shader.setUniform("colour", sf::Glsl::Vec4(0.f, 0.f, 1.f, 1.f));
 		}
+		density_shader.loadFromFile("shader/density.vert.glsl", "shader/density.frag.glsl");
 	}
 
 	// Counting time
@@ -82,6 +92,8 @@ void Renderer::setDefaultParameters() {
 	radius_multiplier = liquid_shader ? 8 : 1;
 	colour_momentum = 0.67f;
 	speed_colour_rate = 100;
+	lod_density = 4;
+	capture_interval = 1/30.f;
 
 	enable_displaying = true;
 	dp_particles = true;
@@ -105,12 +117,15 @@ void Renderer::update_display() {
 		}
 	}
 	
+	particle_sim.want_snapshots(enable_displaying);
 	if (enable_displaying) {
 		display_time.Start();
+		Particle_simulator::DisplayFrame frame = particle_sim.get_display_frame();
 
-		if (followed) {
+		uint32_t followed_index = followed == NULLPART ? NULLPART : particle_sim.get_index(followed);
+		if (followed_index < particle_sim.get_active_part()) {
 			changedView = true;
-			worldView.setCenter(sf::Vector2f(followed->position[0], followed->position[1]));
+			worldView.setCenter(sf::Vector2f(particle_sim[followed_index].position[0], particle_sim[followed_index].position[1]));
 		}
 
 		if (changedView) updatedView();
@@ -131,8 +146,19 @@ void Renderer::update_display() {
 			user_interact_zone.updateAndDraw(default_shader.getNativeHandle());
 		}
 		if (dp_particles) {
-			glPointSize(particles_ds);
-			particle_vertices.updateAndDraw(particle_shader.getNativeHandle(), 0, particle_sim.get_active_part(), (void*)particle_sim.get_particle_data());
+			if (use_density(frame)) {
+				update_density(frame, true); // The particle shader always colours by speed
+				for (uint8_t v=0; v<4; v++) {
+					density_vertices.get<sf::Glsl::Vec4>(v) = sf::Glsl::Vec4(density.getCorner(v&1, 0), density.getCorner(v>>1, 1), v&1, v>>1);
+				}
+				sf::Texture::bind(&density_texture);
+				density_vertices.updateAndDraw(density_shader.getNativeHandle());
+				sf::Texture::bind(nullptr);
+			}
+			else {
+				glPointSize(particles_ds);
+				particle_vertices.updateAndDraw(particle_shader.getNativeHandle(), 0, frame.n_parts, (void*)frame.particles);
+			}
 		}
 		if (dp_segments || dp_worldBorder) {
 			default_shader.setUniform("color", sf::Glsl::Vec4(1.f, 1.f, 1.f, 1.f));
@@ -146,6 +172,7 @@ void Renderer::update_display() {
 		// }
 		// window.setView(worldView);
 
+		capture.frame(window);
 		window.display();
 		display_time.Tick_fine(true);
 
@@ -269,6 +296,7 @@ void Renderer::updatedView() {
 	particle_shader.setUniform("modelViewMat", mat);
 	worldGrid_shader.setUniform("modelViewMat", mat);
 	default_shader.setUniform("modelViewMat", mat);
+	density_shader.setUniform("modelViewMat", mat);
 
 	particles_ds = std::max(radius_multiplier * particle_sim.params.radii *2       *  window.getSize().x / worldView.getSize().x, 0.5f);
 	worldGrid_ds = std::ceil(particle_sim.world.getCellSize(0) *  window.getSize().x / worldView.getSize().x);
@@ -411,6 +439,8 @@ void Renderer::setDefaultParameters() {
 	radius_multiplier = liquid_shader ? 8 : 1;
 	colour_momentum = 0.67f;
 	speed_colour_rate = 50;
+	lod_density = 1; // Each Particle is a quad of 4 vertices here, so the density pays off sooner
+	capture_interval = 1/30.f;
 
 	enable_displaying = true;
 	dp_particles = true;
@@ -435,11 +465,14 @@ void Renderer::update_display() {
 		}
 	}
 	
+	particle_sim.want_snapshots(enable_displaying);
 	if (enable_displaying) {
 		sf::RenderStates state;
+		Particle_simulator::DisplayFrame frame = particle_sim.get_display_frame();
 		
-		if (followed) {
-			worldView.setCenter(sf::Vector2f(followed->position[0], followed->position[1]));
+		uint32_t followed_index = followed == NULLPART ? NULLPART : particle_sim.get_index(followed);
+		if (followed_index < particle_sim.get_active_part()) {
+			worldView.setCenter(sf::Vector2f(particle_sim[followed_index].position[0], particle_sim[followed_index].position[1]));
 			changedView = true;
 		}
 
@@ -460,10 +493,19 @@ void Renderer::update_display() {
 			window.draw(user_interact_zone);
 		}
 		if (dp_particles) {
-			update_particle_vertices();
-			state.texture = &particle_texture;
-			state.shader = &particle_shader;
-			window.draw(particle_vertices, state);
+			if (use_density(frame)) {
+				update_density(frame, dp_speed);
+				sf::Sprite sprite(density_texture);
+				sprite.setPosition(density.getCorner(0, 0), density.getCorner(0, 1));
+				sprite.setScale((density.getCorner(1, 0) - density.getCorner(0, 0)) / density.getWidth(), (density.getCorner(1, 1) - density.getCorner(0, 1)) / density.getHeight());
+				window.draw(sprite);
+			}
+			else {
+				update_particle_vertices(frame);
+				state.texture = &particle_texture;
+				state.shader = &particle_shader;
+				window.draw(particle_vertices, state);
+			}
 		}
 		if (dp_segments) {
 			update_segment_vertices();
@@ -476,6 +518,7 @@ void Renderer::update_display() {
 		}
 		window.setView(worldView);
 
+		capture.frame(window);
 		window.display();
 		float time = display_time.Tick_fine(false);
 
@@ -485,14 +528,29 @@ void Renderer::update_display() {
 			oss << "Display time  : " << time << " ms\n";
 			oss << (particle_sim.isLoading() ? "Loading time  : " : "Sim loop time : ") << particle_sim.get_average_loop_time() << " ms\n";
 			oss << "Particles     : " << particle_sim.get_active_part() << '\n';
-			oss << "time          : " << particle_sim.get_time();
+			oss << "time          : " << particle_sim.get_time() << '\n';
+			StepCounters counters = particle_sim.get_step_counters();
+			oss << "Pairs tested  : " << counters.pp_candidates << '\n';
+			oss << "Contacts      : " << counters.contacts() << '\n';
+			oss << "Cell overflows: " << counters.cell_overflows << '\n';
+			oss << "Seg. tested   : " << counters.seg_candidates << '\n';
+			oss << "Zone hits     : " << counters.zone_hits << '\n';
+			oss << "Threads idle  : " << 100*counters.imbalance() << " %";
+			if (PosRecorder* recorder = particle_sim.get_recorder()) {
+				PosRecorder::Stats rec = recorder->get_stats();
+				oss << "\nRecord queue  : " << rec.queue_depth << '/' << rec.capacity << " (" << rec.dropped << " dropped)";
+				oss << "\nRecord speed  : " << rec.MBps() << " MB/s";
+			}
+			if (particle_sim.isLoading()) {
+				oss << "\nReplay frame  : " << particle_sim.get_replay_frame() << '/' << particle_sim.get_replay_frame_count() << " (x" << particle_sim.get_replay_stride() << ')';
+			}
 			FPS_display.setString(oss.str());
 		}
 	}
 }
 
 
-void Renderer::update_particle_vertices() {
+void Renderer::update_particle_vertices(const Particle_simulator::DisplayFrame& frame) {
 	float size = particle_sim.params.radii *radius_multiplier;
 	float quad[4][2] = {
 		-size,	-size,
@@ -509,15 +567,15 @@ void Renderer::update_particle_vertices() {
 		worldView.getCenter().y + worldView.getSize().y/2 + particle_sim.params.radii,
 	};
 	
-	for (uint32_t p=0; p<particle_sim.get_active_part(); p++) {
-		if (viewRectangle[0][0] < particle_sim[p].position[0] && particle_sim[p].position[0] < viewRectangle[1][0] &&
-		    viewRectangle[0][1] < particle_sim[p].position[1] && particle_sim[p].position[1] < viewRectangle[1][1])
+	for (uint32_t p=0; p<frame.n_parts; p++) {
+		if (viewRectangle[0][0] < frame.particles[p].position[0] && frame.particles[p].position[0] < viewRectangle[1][0] &&
+		    viewRectangle[0][1] < frame.particles[p].position[1] && frame.particles[p].position[1] < viewRectangle[1][1])
 		{
 			if (dp_speed) {
-				// r = std::min((0 > particle_sim[p].speed[1]) * std::abs(particle_sim[p].speed[1])/1000 * 255, 255.f);
-				// g = std::min((0 < particle_sim[p].speed[1]) * particle_sim[p].speed[1]/1000 * 255, 255.f);
+				// r = std::min((0 > frame.particles[p].speed[1]) * std::abs(frame.particles[p].speed[1])/1000 * 255, 255.f);
+				// g = std::min((0 < frame.particles[p].speed[1]) * frame.particles[p].speed[1]/1000 * 255, 255.f);
 				// b = 0;
-				float norm = sqrt(particle_sim[p].speed[0]*particle_sim[p].speed[0] + particle_sim[p].speed[1]*particle_sim[p].speed[1]);
+				float norm = sqrt(frame.particles[p].speed[0]*frame.particles[p].speed[0] + frame.particles[p].speed[1]*frame.particles[p].speed[1]);
 				norm = std::max(20.f, norm);
 				norm /= speed_colour_rate;
 				r = particle_vertices[4*p].color.r*colour_momentum + (1-colour_momentum)*255* std::min(norm, 1.f);
@@ -538,8 +596,8 @@ void Renderer::update_particle_vertices() {
 
 
 			for (uint8_t i=0; i<4; i++) {
-				particle_vertices[4*p+i].position.x = particle_sim[p].position[0] + quad[i][0];
-				particle_vertices[4*p+i].position.y = particle_sim[p].position[1] + quad[i][1];
+				particle_vertices[4*p+i].position.x = frame.particles[p].position[0] + quad[i][0];
+				particle_vertices[4*p+i].position.y = frame.particles[p].position[1] + quad[i][1];
 				
 				if (!liquid_shader) {
 					particle_vertices[4*p+i].color.r = r;
@@ -555,7 +613,7 @@ void Renderer::update_particle_vertices() {
 			}
 		}
 	}
-	for (uint32_t p=particle_sim.get_active_part(); p<particle_sim.get_max_part(); p++) {
+	for (uint32_t p=frame.n_parts; p<particle_sim.get_max_part(); p++) {
 		for (uint8_t i=0; i<4; i++) {
 			particle_vertices[4*p+i].color.a = 0;
 		}
@@ -750,6 +808,7 @@ void Renderer::toggleFullScreen() {
 		worldGrid_vertices.reset(cell_attr);
 		zone_vertices.reset(default_attr);
 		user_interact_zone.reset(default_attr);
+		density_vertices.reset(density_attr);
 		update_static_vertices();
 	#endif
 }
@@ -804,11 +863,38 @@ void Renderer::should_use_speed() {
 	dp_speed = !particle_sim.HasNoSpeed();
 }
 
+bool Renderer::use_density(const Particle_simulator::DisplayFrame& frame) {
+	if (lod_density <= 0) return false;
+	float world_pixels = particle_sim.world.getSize(0) * window.getSize().x / worldView.getSize().x
+	                   * particle_sim.world.getSize(1) * window.getSize().y / worldView.getSize().y;
+	return frame.n_parts > lod_density * world_pixels;
+}
+
+void Renderer::update_density(const Particle_simulator::DisplayFrame& frame, bool speed_colour) {
+	float rect[2][2] = {
+		worldView.getCenter().x - worldView.getSize().x/2,
+		worldView.getCenter().y - worldView.getSize().y/2,
+		worldView.getCenter().x + worldView.getSize().x/2,
+		worldView.getCenter().y + worldView.getSize().y/2,
+	};
+	density.update(frame.particles, frame.n_parts, window.getSize().x, rect, speed_colour_rate, speed_colour);
+	if (density_texture.getSize() != sf::Vector2u(density.getWidth(), density.getHeight())) {
+		density_texture.create(density.getWidth(), density.getHeight());
+	}
+	density_texture.update(density.getPixels());
+}
+
 void Renderer::takeScreenShot() {
-	sf::Vector2u windowSize = window.getSize();
-	sf::Texture texture;
-	texture.create(windowSize.x, windowSize.y);
-	texture.update(window);
-	sf::Image screenshot = texture.copyToImage();
-	screenshot.saveToFile("result_images/screenshot.png");
+	capture.screenshot();
+}
+
+void Renderer::toggleCapture() {
+	if (capture.isSequencing()) {
+		capture.stop_sequence();
+		return;
+	}
+	std::time_t now = std::time(nullptr);
+	std::ostringstream name;
+	name << "capture-" << std::put_time(std::localtime(&now), "%Y%m%d-%H%M%S"); // So a sequence doesn't overwrite the previous ones
+	capture.start_sequence(name.str(), capture_interval);
 }
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "ReplayInterpolator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+ReplayInterpolator::ReplayInterpolator(uint32_t max_particles, uint32_t id_bound_, bool hermite_) : hermite(hermite_), id_bound(id_bound_), out(max_particles), to_slot(id_bound_, NO_MATCH) {
+	threadHandler.set_nb_fun(1);
+	uint32_t n_threads = std::max(std::thread::hardware_concurrency()/2, 1u) - 1; // The calling thread works too
+	std::cout << "\tInterpolating frames " << (hermite ? "along curves" : "linearly") << " on " << n_threads+1 << " thread" << (n_threads ? "s" : "") << std::endl;
+	for (uint32_t t=0; t<n_threads; t++) threads.emplace_back(&ReplayInterpolator::help, this);
+}
+
+ReplayInterpolator::~ReplayInterpolator() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	work.notify_all();
+	for (std::thread& thread : threads) thread.join();
+}
+
+void ReplayInterpolator::help() {
+	uint64_t seen = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		work.wait(lock, [&]() {return !running || generation != seen;});
+		if (!running) return;
+		seen = generation;
+		lock.unlock();
+
+		threadHandler.load_repartition(this, job, 0, job_size, WORK_SUBSET);
+
+		lock.lock();
+		if (!--n_working) done.notify_all();
+	}
+}
+
+void ReplayInterpolator::run(void (ReplayInterpolator::*job_)(uint32_t, uint32_t), uint32_t size) {
+	if (threads.empty() || size < MIN_PARALLEL) {
+		(this->*job_)(0, size);
+		return;
+	}
+	threadHandler.prep_new_work_loop();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = job_;
+		job_size = size;
+		n_working = threads.size();
+		generation++;
+	}
+	work.notify_all();
+	threadHandler.load_repartition(this, job_, 0, size, WORK_SUBSET);
+	std::unique_lock<std::mutex> lock(mutex);
+	done.wait(lock, [this]() {return !n_working;});
+}
+
+void ReplayInterpolator::set_interval(const Frame& from_, const Frame& to_) {
+	from = from_;
+	to = to_;
+	from.n_parts = std::min<uint32_t>(from.n_parts, out.size());
+	h = to.time - from.time;
+	by_id = from.ids && to.ids && id_bound;
+	if (by_id) run(&ReplayInterpolator::fill_slots, to.n_parts); // IDs are unique, so the threads write different slots
+}
+
+void ReplayInterpolator::fill_slots(uint32_t start, uint32_t end) {
+	for (uint32_t q=start; q<end; q++) {
+		if (to.ids[q] < id_bound) to_slot[to.ids[q]] = q;
+	}
+}
+
+Particle* ReplayInterpolator::interpolate(float s_) {
+	s = std::min(std::max(s_, 0.f), 1.f);
+	if (hermite) {
+		float s2 = s*s, s3 = s2*s;
+		coef[0] = 2*s3 - 3*s2 + 1;
+		coef[1] = (s3 - 2*s2 + s) * h; // Tangents are speeds times the interval, which also works backwards
+		coef[2] = -2*s3 + 3*s2;
+		coef[3] = (s3 - s2) * h;
+		float inv_h = h ? 1/h : 0;
+		dcoef[0] = (6*s2 - 6*s) * inv_h;
+		dcoef[1] = 3*s2 - 4*s + 1;
+		dcoef[2] = -dcoef[0];
+		dcoef[3] = 3*s2 - 2*s;
+	}
+	run(&ReplayInterpolator::interpolate_range, from.n_parts);
+	return out.data();
+}
+
+void ReplayInterpolator::interpolate_range(uint32_t start, uint32_t end) {
+	float inv_h = h ? 1/h : 0;
+	for (uint32_t p=start; p<end; p++) {
+		const Particle& a = from.particles[p];
+		Particle& o = out[p];
+		uint32_t q = match(p);
+		if (q == NO_MATCH) { // Deleted before to : it keeps going at its speed, or stays where it is
+			for (uint8_t d=0; d<2; d++) {
+				o.speed[d] = hermite ? a.speed[d] : 0;
+				o.position[d] = a.position[d] + o.speed[d]*h*s;
+			}
+			continue;
+		}
+		const Particle& b = to.particles[q];
+
+		float move[2] = {b.position[0] - a.position[0], b.position[1] - a.position[1]};
+		if (hermite) {
+			float reach = 2 * std::max(std::hypot(a.speed[0], a.speed[1]), std::hypot(b.speed[0], b.speed[1])) * std::abs(h);
+			if (move[0]*move[0] + move[1]*move[1] > reach*reach || !h) { // Teleported
+				o = s < 0.5f ? a : b;
+				continue;
+			}
+			for (uint8_t d=0; d<2; d++) {
+				o.position[d] = coef[0]*a.position[d] + coef[1]*a.speed[d] + coef[2]*b.position[d] + coef[3]*b.speed[d];
+				o.speed[d] = dcoef[0]*a.position[d] + dcoef[1]*a.speed[d] + dcoef[2]*b.position[d] + dcoef[3]*b.speed[d];
+			}
+		}
+		else {
+			for (uint8_t d=0; d<2; d++) {
+				o.position[d] = a.position[d] + s*move[d];
+				o.speed[d] = move[d] * inv_h;
+			}
+		}
+	}
+}
@@ -1,22 +1,40 @@
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <filesystem>
 #include <iostream>
+#include <sstream>
 
 #include "SaveLoader.hpp"
+#include "ColumnExporter.hpp"
 #include "Particle_simulator.hpp"
 #include "World.hpp"
 
 #define MAP_FOL "Map/" 
 #define PSP_FOL "PSparameters/"
 #define POS_FOL "Positions/"
+#define CKP_FOL "Checkpoints/"
+#define COL_FOL "Exports/"
 
 #define MAP_EXT ".map" // map file
 #define PSP_EXT ".psp" // Particle Simulator Parameters file
 #define POS_EXT ".pos" // Particle positions file
+#define IDX_EXT ".idx" // Index of a Particle positions file, next to it
+#define CKP_EXT ".ckp" // Checkpoint of a simulation
+#define COL_EXT ".col" // Chunk of exported columns
+#define TMP_EXT ".tmp" // Added to a file name while it is being written
+
+#define POS_ALIGNED 0x80 // Flag of the quantization byte of a positions file : the header is padded so the frames' arrays are aligned for Particles
+#define POS_IDS 0x40 // Flag of the quantization byte of a positions file : each frame has the IDs of its Particles
 
 #define SLI_STARTUP_FILE "loading_orders" // File containing the orders of loading/saving and what file to look for  
 #define SLinfoFILE_EXT ".sli" // Extension for this file 
 
+#define DEFAULT_CKP_NAME "checkpoint" // Name of the checkpoints if none is given
+#define CKP_VERSION 2 // Written after the binary byte of the checkpoints, so a checkpoint of another layout isn't loaded. Version 2 added the IDs of the Particles
+
+static constexpr uint64_t POS_FRAME_HEADER_SIZE = sizeof(double) + sizeof(size_t) + sizeof(uint32_t); //< time, then size of an element and number of elements of the array
+
 
 SaveLoader::~SaveLoader() {
 	delete_comp_data();
@@ -42,6 +60,21 @@ int8_t SaveLoader::load_SLinfo(SLinfo& info) {
 		res |= !load_from_map(map, "posFileName", info.posFileName, SLinfoPos::fileNameSize);
 		res |= !load_from_map(map, "comp_out_speed", info.comp_out_speed);
 		res |= !load_from_map(map, "comp_discreet", info.comp_discreet);
+		res |= !load_from_map(map, "comp_delta", info.comp_delta);
+		res |= !load_from_map(map, "drop_frames", info.drop_frames);
+		res |= !load_from_map(map, "save_ids", info.save_ids);
+		res |= !load_from_map(map, "save_every", info.save_every);
+		res |= !load_from_map(map, "replay_substeps", info.replay_substeps);
+		res |= !load_from_map(map, "export_columns", info.export_columns);
+		res |= !load_from_map(map, "export_chunk", info.export_chunk);
+		res |= !load_from_map(map, "export_diagnostics", info.export_diagnostics);
+
+		res |= !load_from_map(map, "load_checkpoint", info.load_checkpoint);
+		info.load_checkpoint = info.load_checkpoint && !info.load_pos; // Nothing is simulated when loading positions
+		res |= !load_from_map(map, "checkpoint_step", info.checkpoint_step);
+		res |= !load_from_map(map, "checkpoint_period", info.checkpoint_period);
+		res |= !load_from_map(map, "checkpointFileName", info.checkpointFileName, SLinfoPos::fileNameSize);
+		if (!info.checkpointFileName[0]) std::strcpy(info.checkpointFileName, DEFAULT_CKP_NAME);
 
 		res |= !load_from_map(map, "load_world", info.load_world);
 		res |= !load_from_map(map, "load_simP", info.load_simP);
@@ -64,13 +97,22 @@ SLinfo SaveLoader::setParameters(WorldParam& Wparam, PSparam& Sparam) {
 		return SLinfo::Lazy();
 	}
 
-	if (info.isLoadWorld()) {
-		if (loadParam(Wparam, info.worldName()) < 0) Wparam = WorldParam::Default; // If file opening failed,
-	} else Wparam = WorldParam::Default; // or if there is no loading, takes default parameters
+	if (info.isLoadCheckpoint()) { // The parameters are the ones the checkpoint was written with, rather than the ones of the files
+		uint64_t step = findCheckpoint(info.checkpointName(), info.checkpoint_step);
+		if (!step) std::cout << "No checkpoint " << info.checkpointName() << " found in " << CKP_FOL << ", the simulation starts from the parameters files" << std::endl;
+		info.load_checkpoint = step && loadCheckpointParam(Wparam, Sparam, checkpointName(info.checkpointName(), step)) >= 0;
+		info.checkpoint_step = step;
+	}
+
+	if (!info.isLoadCheckpoint()) {
+		if (info.isLoadWorld()) {
+			if (loadParam(Wparam, info.worldName()) < 0) Wparam = WorldParam::Default; // If file opening failed,
+		} else Wparam = WorldParam::Default; // or if there is no loading, takes default parameters
 
-	if (info.isLoadSimP()) {
-		if (loadParam(Sparam, info.simPName()) < 0) Sparam = PSparam::Default;     // If file opening failed,
-	} else Sparam = PSparam::Default; // or if there is no loading, takes default parameters
+		if (info.isLoadSimP()) {
+			if (loadParam(Sparam, info.simPName()) < 0) Sparam = PSparam::Default;     // If file opening failed,
+		} else Sparam = PSparam::Default; // or if there is no loading, takes default parameters
+	}
 
 	// We can't save the world as it would require to create it first. SO we only save Simulation parameters. 
 	if (info.isSaveSimP()) saveParam(Sparam, 10, KB, info.simPName() + "-bin", 1);
@@ -84,6 +126,45 @@ void SaveLoader::saveParameters(World& world, Particle_simulator& sim, std::stri
 }
 
 
+void SaveLoader::saveTuning(World& world, PSparam& param, std::string worldFileName, std::string simPFileName) {
+	auto text = [](auto value) {
+		std::ostringstream oss;
+		oss << value;
+		return oss.str();
+	};
+	// The files are loaded first, so only the tuned parameters change even in binary
+	if (!simPFileName.empty()) {
+		FullFileName name(PSP_FOL, simPFileName, PSP_EXT);
+		PSparam saved;
+		bool res = loadParam(saved, simPFileName) >= 0;
+		if (res && file_in_binary) {
+			saved.cs = param.cs;
+			saved.chunks_per_thread = param.chunks_per_thread;
+			saved.seg_storage = param.seg_storage;
+			saved.zone_comparison = param.zone_comparison;
+			res = overwrite(name, 0, &saved, sizeof(PSparam));
+		}
+		else if (res) res = replace_in_string(name, {
+			{"cs", text((short)param.cs)},
+			{"chunks_per_thread", text((short)param.chunks_per_thread)},
+			{"seg_storage", text((short)param.seg_storage)},
+			{"zone_comparison", text((short)param.zone_comparison)}
+		});
+		std::cout << "Saving tuned Simulation parameters in " << name.getCompleted() << (res ? " : Success" : " : Failed") << std::endl;
+	}
+	if (!worldFileName.empty()) {
+		FullFileName name(MAP_FOL, worldFileName, MAP_EXT);
+		WorldParam saved;
+		bool res = loadParam(saved, worldFileName) >= 0;
+		if (res && file_in_binary) {
+			saved.cellSize[0] = world.getCellSize(0);
+			saved.cellSize[1] = world.getCellSize(1);
+			res = overwrite(name, 0, &saved, sizeof(WorldParam));
+		}
+		else if (res) res = replace_in_string(name, {{"cellSize", text(world.getCellSize(0)) + ", " + text(world.getCellSize(1))}});
+		std::cout << "Saving tuned World parameters in " << name.getCompleted() << (res ? " : Success" : " : Failed") << std::endl;
+	}
+}
 
 
 void SaveLoader::saveWorld(World& world, uint32_t max_size_saving, ByteSize size_type, std::string fileName, bool binary) {
@@ -328,6 +409,24 @@ void SaveLoader::saveParam(PSparam& param, uint32_t max_size_saving, ByteSize si
 		file << "#\tBASE=0, REBOUND=1\n";
 		save_in_string("world_border_fun", param.world_border_fun);
 		file << "#\tBASE=0, REBOUND=1\n";
+		file << '\n';
+
+		save_in_string("decomposition", param.decomposition);
+		file << "#\tINDEX=0, STRIPES=1\n";
+		save_in_string("rebalance_period", param.rebalance_period);
+		save_in_string("pinning", param.pinning);
+		file << "#\tNONE=0, COMPACT=1, SCATTER=2\n";
+		save_in_string("elastic_threads", param.elastic_threads);
+		file << '\n';
+
+		save_in_string("quickstep_sps", param.quickstep_sps);
+		file << '\n';
+
+		save_in_string("chunks_per_thread", param.chunks_per_thread);
+		save_in_string("seg_storage", param.seg_storage);
+		file << "#\tAUTO=0, GRID=1, SEGMENTS=2\n";
+		save_in_string("zone_comparison", param.zone_comparison);
+		file << "#\tAUTO=0, PARTICLES=1, ZONES=2\n";
 	}
 	done();
 	std::cout << "Saving Simulation parameters as " << name.getCompleted() << " : Success" << std::endl;
@@ -393,6 +492,17 @@ int8_t SaveLoader::loadParam(PSparam& param, std::string fileName) {
 		res |= !load_from_map(map, "ps_collision_fun", param.ps_collision_fun);
 		res |= !load_from_map(map, "world_border_fun", param.world_border_fun);
 
+		res |= !load_from_map(map, "decomposition", param.decomposition);
+		res |= !load_from_map(map, "rebalance_period", param.rebalance_period);
+		res |= !load_from_map(map, "pinning", param.pinning);
+		res |= !load_from_map(map, "elastic_threads", param.elastic_threads);
+
+		res |= !load_from_map(map, "quickstep_sps", param.quickstep_sps);
+
+		res |= !load_from_map(map, "chunks_per_thread", param.chunks_per_thread);
+		res |= !load_from_map(map, "seg_storage", param.seg_storage);
+		res |= !load_from_map(map, "zone_comparison", param.zone_comparison);
+
 	}
 
 	param.n_part_start = std::min(param.n_part_start, param.max_part);
@@ -403,27 +513,239 @@ int8_t SaveLoader::loadParam(PSparam& param, std::string fileName) {
 }
 
 
+uint64_t SaveLoader::findCheckpoint(std::string name, uint64_t step) {
+	std::string folder = getSaveFolder() + CKP_FOL;
+	if (step) return std::filesystem::exists(folder + checkpointName(name, step) + CKP_EXT) ? step : 0;
+
+	uint64_t latest = 0;
+	std::string prefix = name + "-";
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(folder, error)) {
+		std::string stem = entry.path().stem().string();
+		if (entry.path().extension() != CKP_EXT || stem.size() <= prefix.size() || stem.compare(0, prefix.size(), prefix)) continue;
+		std::string digits = stem.substr(prefix.size());
+		if (digits.find_first_not_of("0123456789") != std::string::npos) continue; // Another name followed by '-'
+		latest = std::max(latest, (uint64_t)std::stoull(digits));
+	}
+	return latest;
+}
+
+bool SaveLoader::saveColumns(const ColumnChunk& chunk, std::string fileName) {
+	std::error_code error;
+	std::filesystem::create_directories(getSaveFolder() + COL_FOL, error);
+	FullFileName name(COL_FOL, fileName, COL_EXT);
+	if (!prepareForSaving(30, GB, FullFileName(COL_FOL, fileName, COL_EXT TMP_EXT), 1)) {
+		std::cout << "Saving columns as " << name.getCompleted() << " : Failed" << std::endl;
+		return false;
+	}
+
+	struct Column {const char* name; const char* dtype; const void* data; size_t elem_size; uint64_t count;};
+	std::vector<Column> columns = {
+		{"time", "<f8", chunk.time.data(), sizeof(double), chunk.time.size()},
+		{"start", "<u8", chunk.start.data(), sizeof(uint64_t), chunk.start.size()},
+		{"id", "<u4", chunk.id.data(), sizeof(uint32_t), chunk.id.size()},
+		{"x", "<f4", chunk.x.data(), sizeof(float), chunk.x.size()},
+		{"y", "<f4", chunk.y.data(), sizeof(float), chunk.y.size()},
+	};
+	if (chunk.vx.size()) {
+		columns.push_back({"vx", "<f4", chunk.vx.data(), sizeof(float), chunk.vx.size()});
+		columns.push_back({"vy", "<f4", chunk.vy.data(), sizeof(float), chunk.vy.size()});
+	}
+	if (chunk.speed.size()) columns.push_back({"speed", "<f4", chunk.speed.data(), sizeof(float), chunk.speed.size()});
+	if (chunk.cell.size()) columns.push_back({"cell", "<u4", chunk.cell.data(), sizeof(uint32_t), chunk.cell.size()});
+
+	std::ostringstream header;
+	header << "particle_sim2 columns 1\nframes=" << chunk.frames() << "\nrows=" << chunk.rows() << "\nfirst_frame=" << chunk.first_frame << '\n';
+	uint64_t offset = COL_HEADER_SIZE;
+	for (const Column& column : columns) {
+		header << "column=" << column.name << ' ' << column.dtype << ' ' << offset << ' ' << column.count << '\n';
+		offset += (column.count*column.elem_size + 63) / 64 * 64;
+	}
+	header << "end\n";
+	std::string text = header.str();
+	bool res = text.size() < COL_HEADER_SIZE-1;
+	if (res) {
+		text.resize(COL_HEADER_SIZE-1, ' ');
+		res = save(text.data(), text.size());
+	}
+	static const char padding[64] = {};
+	for (const Column& column : columns) {
+		uint64_t bytes = column.count*column.elem_size;
+		res = res && save((void*)column.data, bytes);
+		if (bytes % 64) res = res && save((void*)padding, 64 - bytes % 64);
+	}
+	file.flush();
+	res &= file.good();
+	done();
+
+	// Only a complete chunk takes the name
+	std::filesystem::path path = getFilePath();
+	if (res) std::filesystem::rename(path, std::filesystem::path(path).replace_extension(), error);
+	if (!res || error) std::filesystem::remove(path, error);
+	res = res && !error;
+	if (!res) std::cout << "Saving columns as " << name.getCompleted() << " : Failed" << std::endl;
+	return res;
+}
+
+bool SaveLoader::saveCheckpoint(SimState& state, std::string fileName) {
+	std::error_code error;
+	std::filesystem::create_directories(getSaveFolder() + CKP_FOL, error);
+	FullFileName name(CKP_FOL, fileName, CKP_EXT);
+	if (!prepareForSaving(30, GB, FullFileName(CKP_FOL, fileName, CKP_EXT TMP_EXT), 1)) {
+		std::cout << "Saving checkpoint as " << name.getCompleted() << " : Failed" << std::endl;
+		return false;
+	}
+
+	uint8_t version = CKP_VERSION;
+	bool res = save(&version);
+	// The world, as the parameters files might have changed since
+	res &= save(&state.world_params);
+	uint32_t n = state.segments.size()/4;
+	res &= save(&n);
+	if (n) res &= save(state.segments.data(), 4*n * sizeof(float));
+	n = state.zone_funs.size();
+	res &= save(&n);
+	if (n) {
+		res &= save(state.zones.data(), 4*n * sizeof(float));
+		res &= save(state.zone_funs.data(), n * sizeof(int8_t));
+	}
+	// The simulation
+	res &= save(&state.params);
+	res &= save(state.time, sizeof(state.time));
+	res &= save(&state.steps);
+	res &= save(&state.seed);
+	n = state.particles.size();
+	res &= save(&n);
+	if (n) res &= save(state.particles.data(), n * sizeof(Particle));
+	// Since version 2, the IDs of the Particles
+	n = state.ids.size();
+	res &= save(&n);
+	if (n) res &= save(state.ids.data(), n * sizeof(uint32_t));
+	n = state.free_ids.size();
+	res &= save(&n);
+	if (n) res &= save(state.free_ids.data(), n * sizeof(uint32_t));
+	file.flush();
+	res &= file.good();
+	done();
+
+	// Only a complete checkpoint takes the name
+	std::filesystem::path path = getFilePath();
+	if (res) std::filesystem::rename(path, std::filesystem::path(path).replace_extension(), error);
+	if (!res || error) std::filesystem::remove(path, error);
+	res = res && !error;
+	std::cout << "Saving checkpoint as " << name.getCompleted() << (res ? " : Success" : " : Failed") << std::endl;
+	return res;
+}
+
+int8_t SaveLoader::loadCheckpoint(SimState& state, std::string fileName, bool with_particles) {
+	FullFileName name(CKP_FOL, fileName, CKP_EXT);
+	if (!prepareForLoading(name)) {
+		std::cout << "Loading checkpoint from " << name.getCompleted() << " : Failed" << std::endl;
+		return -1; // return -1 if opening the file fails
+	}
+
+	uint8_t version = 0;
+	bool res = file_in_binary && load(&version, sizeof(version)) && version >= 1 && version <= CKP_VERSION;
+	uint32_t n = 0;
+	res = res && load(&state.world_params, sizeof(WorldParam)) && load(&n, sizeof(n));
+	if (res && n <= UINT16_MAX) { // The world can't have more segments or zones
+		state.segments.resize(4*n);
+		res = load(state.segments.data(), 4*n * sizeof(float)) && load(&n, sizeof(n));
+	}
+	else res = false;
+	if (res && n <= UINT16_MAX) {
+		state.zones.resize(4*n);
+		state.zone_funs.resize(n);
+		res = load(state.zones.data(), 4*n * sizeof(float)) && load(state.zone_funs.data(), n * sizeof(int8_t));
+	}
+	else res = false;
+	res = res && load(&state.params, sizeof(PSparam)) && load(state.time, sizeof(state.time)) && load(&state.steps, sizeof(state.steps)) && load(&state.seed, sizeof(state.seed));
+	state.particles.clear();
+	state.ids.clear();
+	state.free_ids.clear();
+	if (res && with_particles) {
+		res = load(&n, sizeof(n)) && n <= state.params.max_part;
+		if (res) {
+			state.particles.resize(n);
+			res = load(state.particles.data(), n * sizeof(Particle));
+		}
+		if (res && version >= 2) { // Otherwise the simulator gives new IDs
+			res = load(&n, sizeof(n)) && n <= state.params.max_part;
+			if (res) {
+				state.ids.resize(n);
+				res = load(state.ids.data(), n * sizeof(uint32_t)) && load(&n, sizeof(n)) && n <= state.params.max_part;
+			}
+			if (res) {
+				state.free_ids.resize(n);
+				res = load(state.free_ids.data(), n * sizeof(uint32_t));
+			}
+		}
+	}
+	done();
+	std::cout << "Loading checkpoint from " << name.getCompleted() << (res ? " : Success" : " : Failed") << std::endl;
+	return res ? 0 : -1;
+}
+
+int8_t SaveLoader::loadCheckpointParam(WorldParam& Wparam, PSparam& Sparam, std::string fileName) {
+	SimState state;
+	if (loadCheckpoint(state, fileName, false) < 0) return -1;
+	Wparam = state.world_params;
+	Sparam = state.params;
+	return 0;
+}
+
+int8_t SaveLoader::loadCheckpointSegNZones(World& world, std::string fileName) {
+	SimState state;
+	if (loadCheckpoint(state, fileName, false) < 0) return -1;
+	world.seg_array.reserve(state.segments.size()/4);
+	for (uint32_t i=0; i<state.segments.size()/4; i++) {
+		world.add_segment(state.segments[4*i], state.segments[4*i+1], state.segments[4*i+2], state.segments[4*i+3]);
+	}
+	for (uint32_t i=0; i<state.zone_funs.size(); i++) {
+		world.add_zone(state.zone_funs[i], state.zones[4*i], state.zones[4*i+1], state.zones[4*i+2], state.zones[4*i+3]);
+	}
+	return 0;
+}
+
+
 void SaveLoader::set_compression(SLinfoPos compression, uint32_t max_particles) {
 	delete_comp_data();
 	comp_mode = compression;
+	pos_elem_size = sizeof(Particle);
 	switch (comp_mode.compressionMode()) {
 		case SLinfoPos::compression_mode::Discreet:
 			comp_data = new uint16_t[4*max_particles];
+			pos_elem_size = 4*sizeof(uint16_t);
 			break;
 		case SLinfoPos::compression_mode::PosOnly:
 			comp_data = new float[2*max_particles];
+			pos_elem_size = 2*sizeof(float);
 			break;
 		case SLinfoPos::compression_mode::Both:
 			comp_data = new uint16_t[2*max_particles];
+			pos_elem_size = 2*sizeof(uint16_t);
+			break;
+		case SLinfoPos::compression_mode::Delta:
+		case SLinfoPos::compression_mode::DeltaPosOnly:
+			codec = new PosCodec(comp_mode.isCompOutSpeed() ? 2 : 4, max_particles, comp_mode.isSaveIds() ? pos_id_bound : 0);
+			comp_data = new uint8_t[codec->max_encoded_size()];
+			pos_elem_size = 1;
 			break;
 		default: // In the case of default we directly save the particle data array
 			break;
 	}
+	pos_ids.clear();
+	if (comp_mode.isSaveIds()) {
+		pos_ids.resize(max_particles);
+		for (uint32_t p=0; p<max_particles; p++) pos_ids[p] = p;
+	}
 }
 
 void SaveLoader::delete_comp_data() {
 	if (comp_data) delete[]((uint16_t*)comp_data); // no destructor needs to be called no matter the level of compression
 	comp_data = nullptr;
+	if (codec) delete codec;
+	codec = nullptr;
 }
 
 
@@ -431,6 +753,7 @@ void SaveLoader::prepareSavePos(uint32_t max_size_saving, ByteSize size_type, SL
 	min_delta_save_time = min_delta_save_time_;
 	world_size[0] = world.getSize(0);
 	world_size[1] = world.getSize(1);
+	pos_id_bound = max_particles;
 	
 	set_compression(compression, max_particles);
 	std::cout << "\tSaveLoader::prepareSavePos, saving at compression " << (short)comp_mode.compressionMode() << std::endl;
@@ -439,7 +762,10 @@ void SaveLoader::prepareSavePos(uint32_t max_size_saving, ByteSize size_type, SL
 		return;
 	}
 
-	save(&comp_mode.comp_discreet);
+	uint8_t quantization = comp_mode.isCompDelta() ? 2 : comp_mode.isCompDiscreet(); // 0 floats, 1 discreet, 2 discreet and delta. Was a bool before delta, so older files still load
+	quantization |= POS_ALIGNED;
+	if (comp_mode.isSaveIds()) quantization |= POS_IDS;
+	save(&quantization);
 	save(&comp_mode.comp_out_speed);
 	save(&world_size[0]);
 	save(&world_size[1]);
@@ -447,32 +773,143 @@ void SaveLoader::prepareSavePos(uint32_t max_size_saving, ByteSize size_type, SL
 		std::cout << "\tmax speed : " << max_speed[0]  << ", " << max_speed[1] << std::endl;
 		save(&max_speed);
 	}
+	if (comp_mode.isSaveIds()) save(&pos_id_bound);
+	// Every frame's size is a multiple of 4 in Normal mode, so the Particles of all frames are aligned once the first ones are. Then the file can be read in place. @see mapPos
+	uint8_t padding = 0;
+	while ((written + POS_FRAME_HEADER_SIZE) % alignof(Particle)) save(&padding);
+
+	index_file.open(std::filesystem::path(getFilePath()).replace_extension(IDX_EXT), std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!index_file.is_open()) std::cout << "\tFailed opening the index of the positions file, it will be indexed when loaded" << std::endl;
 }
 
 void SaveLoader::prepareLoadPos(uint32_t max_particles, SLinfoPos known) {
 	std::cout << "SaveLoader::prepareLoadPos" << std::endl;
 	prepareForLoading(FullFileName(POS_FOL, known.posName(), POS_EXT));
-	load(&known.comp_discreet);
+	uint8_t quantization = 0;
+	load(&quantization);
+	bool aligned = quantization & POS_ALIGNED;
+	known.save_ids = quantization & POS_IDS;
+	quantization &= ~(POS_ALIGNED | POS_IDS);
+	known.comp_discreet = quantization >= 1;
+	known.comp_delta = quantization == 2;
 	load(&known.comp_out_speed);
 	load(&world_size[0]);
 	load(&world_size[1]);
 	std::cout << "\tPositions saved in a world of size [" << world_size[0] << ", " << world_size[1] << "]. Compression level " << (short)known.compressionMode() << std::endl;
-	set_compression(known, max_particles);
-	if (!comp_mode.isCompOutSpeed()) {
+	if (!known.isCompOutSpeed()) {
 		load(&max_speed);
 		std::cout << "\tloaded max speed "  <<  max_speed[0] << ", " << max_speed[1] << std::endl;
 	}
+	if (known.isSaveIds()) {
+		load(&pos_id_bound);
+		std::cout << "\tParticles have IDs below " << pos_id_bound << std::endl;
+	}
+	set_compression(known, max_particles);
+	if (aligned) {
+		uint64_t offset = file.tellg();
+		file.seekg((alignof(Particle) - (offset + POS_FRAME_HEADER_SIZE) % alignof(Particle)) % alignof(Particle), std::ios_base::cur);
+	}
 
 	// With this member we know to which byte come back once the end of the file has been reach and we want to restart loading positions.
 	loadPos_start_file_offset = file.tellg();
+	index_positions();
+
+	mapped_pos.close();
+	if (!comp_mode.isCompDelta() && aligned) {
+		if (mapped_pos.open(getFilePath())) std::cout << "\tFrames are read from the file mapped in memory" << (isPosInPlace() ? ", in place" : "") << std::endl;
+		else std::cout << "\tThe file couldn't be mapped in memory, frames are read through a stream" << std::endl;
+	}
+}
+
+/**
+* @details Sidecar entries are only trusted while they point forward and inside the file. The last one is read again from the positions file to know where the next frame starts.
+* A frame is : time (double), size of an element (size_t), number of elements (uint32_t), then the elements. @see POS_FRAME_HEADER_SIZE
+* Outside of the Delta modes, the IDs follow as another array : size of an ID, number of IDs, then the IDs.
+*/
+void SaveLoader::index_positions() {
+	pos_index.clear();
+	next_pos_frame = 0;
+	std::error_code error;
+	uint64_t file_size = std::filesystem::file_size(getFilePath(), error);
+	if (error) return;
+
+	std::ifstream sidecar(std::filesystem::path(getFilePath()).replace_extension(IDX_EXT), std::ios::in | std::ios::binary);
+	PosFrame entry;
+	while (sidecar.read((char*)&entry.time, sizeof(entry.time)) && sidecar.read((char*)&entry.offset, sizeof(entry.offset)) && sidecar.read((char*)&entry.key, sizeof(entry.key))) {
+		uint64_t min_offset = pos_index.empty() ? loadPos_start_file_offset : pos_index.back().offset + POS_FRAME_HEADER_SIZE;
+		if (entry.offset < min_offset || entry.offset + POS_FRAME_HEADER_SIZE > file_size) break;
+		pos_index.push_back(entry);
+	}
+	uint32_t from_sidecar = pos_index.size();
+
+	uint64_t offset = loadPos_start_file_offset;
+	if (!pos_index.empty()) {
+		offset = pos_index.back().offset;
+		pos_index.pop_back();
+	}
+	while (offset + POS_FRAME_HEADER_SIZE <= file_size) {
+		size_t elem_size = 0;
+		uint32_t n_elem = 0;
+		file.clear();
+		file.seekg(offset, std::ios_base::beg);
+		file.read((char*)&entry.time, sizeof(entry.time));
+		file.read((char*)&elem_size, sizeof(elem_size));
+		file.read((char*)&n_elem, sizeof(n_elem));
+		if (!file.good()) break;
+		uint64_t end = offset + POS_FRAME_HEADER_SIZE + (uint64_t)elem_size * n_elem;
+		if (end > file_size) break; // The frame was cut short
+
+		entry.offset = offset;
+		entry.key = true;
+		if (codec) {
+			uint8_t key = 0;
+			if (n_elem > PosCodec::KEY_BYTE) {
+				file.seekg(PosCodec::KEY_BYTE, std::ios_base::cur);
+				file.read((char*)&key, 1);
+			}
+			entry.key = key;
+		}
+		else if (comp_mode.isSaveIds()) {
+			size_t id_size = 0;
+			uint32_t n_ids = 0;
+			file.seekg(end, std::ios_base::beg);
+			file.read((char*)&id_size, sizeof(id_size));
+			file.read((char*)&n_ids, sizeof(n_ids));
+			if (!file.good() || id_size != sizeof(uint32_t)) break;
+			end += sizeof(size_t) + sizeof(uint32_t) + (uint64_t)id_size * n_ids;
+			if (end > file_size) break;
+		}
+		pos_index.push_back(entry);
+		offset = end;
+	}
+	if (pos_index.size() > from_sidecar) std::cout << "\t" << pos_index.size() - from_sidecar << " frames weren't in the index file and were found in the positions file" << std::endl;
+	std::cout << "\t" << pos_index.size() << " frames";
+	if (!pos_index.empty()) std::cout << ", from t=" << pos_index.front().time << " to t=" << pos_index.back().time;
+	std::cout << std::endl;
+
+	file.clear();
+	file.seekg(loadPos_start_file_offset, std::ios_base::beg);
+}
+
+/**
+* @brief Quantizes a position for the Delta modes. Unlike the Discreet modes, values outside of the world are clamped since the codec needs every bit to be reproducible.
+*/
+static inline uint16_t quantize_pos(float position, float multiplier) {
+	return std::min(std::max(position * multiplier, 0.f), 65535.f);
 }
 
-void SaveLoader::savePos(Particle* particle_array, uint32_t part_arr_size, double time) {
+static inline uint16_t quantize_speed(float speed, float multiplier) {
+	return (int16_t)std::min(std::max(speed * multiplier, -32768.f), 32767.f);
+}
+
+void SaveLoader::savePos(Particle* particle_array, uint32_t part_arr_size, double time, const uint32_t* ids) {
 	// std::cout << "SaveLoader::savePos, " << time << " - " << time_of_last_save << " < " << min_delta_save_time << "\n";
 
 	if (time - time_of_last_save < min_delta_save_time) return;
 	time_of_last_save = time;
-	save(&time);
+	if (!ids) ids = pos_ids.data();
+	PosFrame entry{time, written, true};
+	bool saved = save(&time);
 
 	size_t byte_size_obj;
 	float discreet_multiplier[2][2] = {
@@ -505,71 +942,237 @@ void SaveLoader::savePos(Particle* particle_array, uint32_t part_arr_size, doubl
 				((uint16_t*)comp_data)[2*p +1] = particle_array[p].position[1] * discreet_multiplier[0][1];
 			}
 			break;
+		case SLinfoPos::compression_mode::Delta:
+		case SLinfoPos::compression_mode::DeltaPosOnly: {
+			byte_size_obj = 0;
+			uint16_t* x = codec->frame(0);
+			uint16_t* y = codec->frame(1);
+			for (uint32_t p=0; p<part_arr_size; p++) {
+				x[p] = quantize_pos(particle_array[p].position[0], discreet_multiplier[0][0]);
+				y[p] = quantize_pos(particle_array[p].position[1], discreet_multiplier[0][1]);
+			}
+			if (!comp_mode.isCompOutSpeed()) {
+				uint16_t* vx = codec->frame(2);
+				uint16_t* vy = codec->frame(3);
+				for (uint32_t p=0; p<part_arr_size; p++) {
+					vx[p] = quantize_speed(particle_array[p].speed[0], discreet_multiplier[1][0]);
+					vy[p] = quantize_speed(particle_array[p].speed[1], discreet_multiplier[1][1]);
+				}
+			}
+			if (codec->hasIds()) std::memcpy(codec->frame_ids(), ids, part_arr_size*sizeof(uint32_t));
+			size_t frame_size = codec->encode(part_arr_size, (uint8_t*)comp_data);
+			entry.key = codec->isLastKey();
+			saved = saved && save_array(comp_data, 1, frame_size);
+			if (!saved) codec->reset(); // The next frame can't refer to this one
+			break;
+		}
 		default:
 			byte_size_obj = 0;
-			save_array(particle_array, sizeof(Particle), part_arr_size);
+			saved = saved && save_array(particle_array, sizeof(Particle), part_arr_size);
 			break;
 	}
-	if (byte_size_obj) save_array(comp_data, byte_size_obj, part_arr_size);
+	if (byte_size_obj) saved = saved && save_array(comp_data, byte_size_obj, part_arr_size);
+	if (comp_mode.isSaveIds() && !codec) saved = saved && save_array((void*)ids, sizeof(uint32_t), part_arr_size);
+
+	if (saved && index_file.is_open()) {
+		index_file.write((char*)&entry.time, sizeof(entry.time));
+		index_file.write((char*)&entry.offset, sizeof(entry.offset));
+		index_file.write((char*)&entry.key, sizeof(entry.key));
+	}
 }
 
 
-uint32_t SaveLoader::loadPos(Particle* particle_array, uint32_t arr_size, double* time) {
+uint32_t SaveLoader::loadPos(Particle* particle_array, uint32_t arr_size, double* time, uint32_t* ids) {
 	// std::cout << "SaveLoader::loadPos" << std::endl;
+	if (mapped_pos.is_open()) {
+		uint32_t n_parts = decodePos(next_pos_frame, particle_array, arr_size, time, ids);
+		if (n_parts != NULLPART) next_pos_frame++;
+		return n_parts;
+	}
 	load(time);
 	if (file.fail()) {
 		return NULLPART;
 	}
 	bool load_success = false;
 	uint32_t loaded_obj = 0;
-	float discreet_multiplier[2][2] = {
-		world_size[0] / 65536,
-		world_size[1] / 65536,
-		max_speed[0]/32768, // max measurable speed
-		max_speed[1]/32768 // The higher, the less saving is precise
-	};
 	switch (comp_mode.compressionMode()) {
 		case SLinfoPos::compression_mode::Discreet:
 			load_success = load(comp_data, 4*sizeof(uint16_t), arr_size, &loaded_obj);
-			if (load_success) {
-				for (uint32_t p=0; p<loaded_obj; p++) {
-					particle_array[p].position[0] = ((uint16_t*)comp_data)[4*p   ] * discreet_multiplier[0][0];
-					particle_array[p].position[1] = ((uint16_t*)comp_data)[4*p +1] * discreet_multiplier[0][1];
-					particle_array[p].speed[0]    = (( int16_t*)comp_data)[4*p +2] * discreet_multiplier[1][0];
-					particle_array[p].speed[1]    = (( int16_t*)comp_data)[4*p +3] * discreet_multiplier[1][1];
-				}
-			}
+			if (load_success) unpack_pos(comp_data, loaded_obj, particle_array);
 			break;
 		case SLinfoPos::compression_mode::PosOnly:
 			load_success = load(comp_data, 2*sizeof(float), arr_size, &loaded_obj);
-			if (load_success) {
-				for (uint32_t p=0; p<loaded_obj; p++) {
-					particle_array[p].position[0] = ((float*)comp_data)[2*p   ];
-					particle_array[p].position[1] = ((float*)comp_data)[2*p +1];
-				}
-			}
+			if (load_success) unpack_pos(comp_data, loaded_obj, particle_array);
 			break;
 		case SLinfoPos::compression_mode::Both:
 			load_success = load(comp_data, 2*sizeof(uint16_t), arr_size, &loaded_obj);
+			if (load_success) unpack_pos(comp_data, loaded_obj, particle_array);
+			break;
+		case SLinfoPos::compression_mode::Delta:
+		case SLinfoPos::compression_mode::DeltaPosOnly: {
+			float discreet_multiplier[2][2] = {
+				world_size[0] / 65536,
+				world_size[1] / 65536,
+				max_speed[0]/32768, // max measurable speed
+				max_speed[1]/32768 // The higher, the less saving is precise
+			};
+			uint32_t frame_size = 0;
+			load_success = load(comp_data, 1, codec->max_encoded_size(), &frame_size);
 			if (load_success) {
+				uint32_t n_parts = codec->decode((uint8_t*)comp_data, frame_size);
+				load_success = n_parts != NULLPART;
+				loaded_obj = load_success ? std::min(n_parts, arr_size) : 0;
+			}
+			if (load_success) {
+				const uint16_t* x = codec->last(0);
+				const uint16_t* y = codec->last(1);
 				for (uint32_t p=0; p<loaded_obj; p++) {
-					particle_array[p].position[0] = ((uint16_t*)comp_data)[2*p   ] * discreet_multiplier[0][0];
-					particle_array[p].position[1] = ((uint16_t*)comp_data)[2*p +1] * discreet_multiplier[0][1];
+					particle_array[p].position[0] = x[p] * discreet_multiplier[0][0];
+					particle_array[p].position[1] = y[p] * discreet_multiplier[0][1];
+				}
+				if (!comp_mode.isCompOutSpeed()) {
+					const int16_t* vx = (const int16_t*)codec->last(2);
+					const int16_t* vy = (const int16_t*)codec->last(3);
+					for (uint32_t p=0; p<loaded_obj; p++) {
+						particle_array[p].speed[0] = vx[p] * discreet_multiplier[1][0];
+						particle_array[p].speed[1] = vy[p] * discreet_multiplier[1][1];
+					}
 				}
+				if (ids && codec->hasIds()) std::memcpy(ids, codec->last_ids(), loaded_obj*sizeof(uint32_t));
 			}
 			break;
+		}
 		default:
 			load_success = load(particle_array, sizeof(Particle), arr_size, &loaded_obj);
 			break;
 	}
-	return load_success ? loaded_obj : NULLPART;
+	if (load_success && comp_mode.isSaveIds() && !codec) { // The IDs are read even if they aren't wanted, so the next frame is read from its start
+		uint32_t loaded_ids = 0;
+		load_success = ids ? load(ids, sizeof(uint32_t), arr_size, &loaded_ids) : load(pos_ids.data(), sizeof(uint32_t), std::min(arr_size, (uint32_t)pos_ids.size()), &loaded_ids);
+	}
+	else if (load_success && ids && !comp_mode.isSaveIds()) {
+		for (uint32_t p=0; p<loaded_obj; p++) ids[p] = p;
+	}
+	if (!load_success) return NULLPART;
+	next_pos_frame++;
+	return loaded_obj;
+}
+
+void SaveLoader::unpack_pos(const void* data, uint32_t n_parts, Particle* particle_array) const {
+	float discreet_multiplier[2][2] = {
+		world_size[0] / 65536,
+		world_size[1] / 65536,
+		max_speed[0]/32768, // max measurable speed
+		max_speed[1]/32768 // The higher, the less saving is precise
+	};
+	switch (comp_mode.compressionMode()) {
+		case SLinfoPos::compression_mode::Discreet:
+			for (uint32_t p=0; p<n_parts; p++) {
+				particle_array[p].position[0] = ((const uint16_t*)data)[4*p   ] * discreet_multiplier[0][0];
+				particle_array[p].position[1] = ((const uint16_t*)data)[4*p +1] * discreet_multiplier[0][1];
+				particle_array[p].speed[0]    = ((const  int16_t*)data)[4*p +2] * discreet_multiplier[1][0];
+				particle_array[p].speed[1]    = ((const  int16_t*)data)[4*p +3] * discreet_multiplier[1][1];
+			}
+			break;
+		case SLinfoPos::compression_mode::PosOnly:
+			for (uint32_t p=0; p<n_parts; p++) {
+				particle_array[p].position[0] = ((const float*)data)[2*p   ];
+				particle_array[p].position[1] = ((const float*)data)[2*p +1];
+			}
+			break;
+		case SLinfoPos::compression_mode::Both:
+			for (uint32_t p=0; p<n_parts; p++) {
+				particle_array[p].position[0] = ((const uint16_t*)data)[2*p   ] * discreet_multiplier[0][0];
+				particle_array[p].position[1] = ((const uint16_t*)data)[2*p +1] * discreet_multiplier[0][1];
+			}
+			break;
+		case SLinfoPos::compression_mode::Normal:
+			std::memcpy(particle_array, data, n_parts*sizeof(Particle));
+			break;
+		default: // The Delta modes need the previous frames, they are decoded by the codec
+			break;
+	}
+}
+
+uint32_t SaveLoader::decodePos(uint32_t frame, Particle* particle_array, uint32_t arr_size, double* time, uint32_t* ids) const {
+	if (!mapped_pos.is_open() || frame >= pos_index.size()) return NULLPART;
+	const uint8_t* header = mapped_pos.data() + pos_index[frame].offset;
+	size_t elem_size;
+	uint32_t n_saved;
+	std::memcpy(time, header, sizeof(double));
+	std::memcpy(&elem_size, header + sizeof(double), sizeof(size_t));
+	std::memcpy(&n_saved, header + sizeof(double) + sizeof(size_t), sizeof(uint32_t));
+	if (elem_size != pos_elem_size) return NULLPART;
+	uint32_t n_parts = std::min(n_saved, arr_size);
+	unpack_pos(header + POS_FRAME_HEADER_SIZE, n_parts, particle_array);
+	if (ids && comp_mode.isSaveIds()) { // The frame was checked to hold its IDs when indexed
+		const uint8_t* id_header = header + POS_FRAME_HEADER_SIZE + elem_size*n_saved;
+		uint32_t n_ids;
+		std::memcpy(&n_ids, id_header + sizeof(size_t), sizeof(uint32_t));
+		std::memcpy(ids, id_header + sizeof(size_t) + sizeof(uint32_t), std::min(n_ids, n_parts)*sizeof(uint32_t));
+	}
+	else if (ids) {
+		for (uint32_t p=0; p<n_parts; p++) ids[p] = p;
+	}
+	return n_parts;
 }
 
 void SaveLoader::resetPosLoading() {
+	if (codec) codec->reset(); // The first frame is a keyframe
+	next_pos_frame = 0;
 	file.clear();
 	file.seekg(loadPos_start_file_offset, std::ios_base::beg);
 }
 
+uint32_t SaveLoader::findPosFrame(double time) {
+	auto after = std::upper_bound(pos_index.begin(), pos_index.end(), time, [](double t, const PosFrame& frame) {return t < frame.time;});
+	return after == pos_index.begin() ? 0 : after - pos_index.begin() - 1;
+}
+
+Particle* SaveLoader::mapPos(uint32_t frame, uint32_t* n_parts, double* time, int32_t stride, const uint32_t** ids) {
+	if (frame >= pos_index.size()) return nullptr;
+	uint8_t* header = mapped_pos.data() + pos_index[frame].offset;
+	size_t elem_size;
+	std::memcpy(time, header, sizeof(double));
+	std::memcpy(&elem_size, header + sizeof(double), sizeof(size_t));
+	std::memcpy(n_parts, header + sizeof(double) + sizeof(size_t), sizeof(uint32_t));
+	if (!isPosInPlace() || elem_size != sizeof(Particle)) return nullptr;
+	next_pos_frame = frame + 1;
+
+	// Playing in order, the kernel reads ahead by itself. Otherwise it is asked to read the frame that should come next
+	mapped_pos.advise_sequential(stride == 1);
+	int64_t next = (int64_t)frame + stride;
+	if (stride != 1 && next >= 0 && next < (int64_t)pos_index.size()) {
+		uint64_t end = next+1 < (int64_t)pos_index.size() ? pos_index[next+1].offset : mapped_pos.size();
+		mapped_pos.will_need(pos_index[next].offset, end - pos_index[next].offset);
+	}
+	// The IDs' array is aligned too, as it comes after a multiple of 4 bytes
+	if (ids) *ids = comp_mode.isSaveIds() ? (const uint32_t*)(header + POS_FRAME_HEADER_SIZE + *n_parts*sizeof(Particle) + sizeof(size_t) + sizeof(uint32_t)) : nullptr;
+	return (Particle*)(header + POS_FRAME_HEADER_SIZE);
+}
+
+uint32_t SaveLoader::seekPos(uint32_t frame, Particle* particle_array, uint32_t arr_size, double* time, uint32_t* ids) {
+	if (frame >= pos_index.size()) return NULLPART;
+
+	uint32_t start = frame;
+	if (codec) {
+		while (start > 0 && !pos_index[start].key) start--;
+		// The codec remembers the frame before next_pos_frame, so reading can go on from there if it is between the keyframe and frame
+		if (next_pos_frame > start && next_pos_frame <= frame) start = next_pos_frame;
+		else codec->reset();
+	}
+	file.clear();
+	file.seekg(pos_index[start].offset, std::ios_base::beg);
+	next_pos_frame = start;
+
+	uint32_t loaded = NULLPART;
+	for (uint32_t f=start; f<=frame; f++) {
+		loaded = loadPos(particle_array, arr_size, time, ids);
+		if (loaded == NULLPART) break;
+	}
+	return loaded;
+}
+
 
 void SaveLoader::proove_you_work_please(bool binary) {
 	std::string name[2];
@@ -0,0 +1,164 @@
+#include "ScreenCapture.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#define CAPTURE_FOL "result_images/"
+
+ScreenCapture::ScreenCapture() {
+	std::error_code error;
+	std::filesystem::create_directories(CAPTURE_FOL, error);
+	worker = std::thread(&ScreenCapture::encode_images, this);
+}
+
+ScreenCapture::~ScreenCapture() {
+	#if OPENGL_INCLUDE_SUCCESS
+		collect(next_pbo);
+		collect(1-next_pbo);
+		if (pbo[0]) glDeleteBuffers(2, pbo);
+	#endif
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+	}
+	queued.notify_all();
+	worker.join();
+}
+
+void ScreenCapture::encode_images() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		queued.wait(lock, [this]() {return !queue.empty() || !running;});
+		if (queue.empty()) return; // The images queued are encoded before stopping
+		Image image = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+
+		sf::Image png;
+		png.create(image.width, image.height, image.pixels.data());
+		if (image.bottom_up) png.flipVertically();
+		if (!png.saveToFile(image.path)) std::cout << "Failed saving " << image.path << std::endl;
+
+		lock.lock();
+		spare.push_back(std::move(image.pixels));
+	}
+}
+
+void ScreenCapture::push(Image& image) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(std::move(image));
+	}
+	queued.notify_all();
+}
+
+std::vector<uint8_t> ScreenCapture::take_spare(size_t size) {
+	std::vector<uint8_t> pixels;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!spare.empty()) {
+			pixels = std::move(spare.back());
+			spare.pop_back();
+		}
+	}
+	pixels.resize(size);
+	return pixels;
+}
+
+void ScreenCapture::start_sequence(std::string name, double interval_) {
+	if (isSequencing()) stop_sequence();
+	sequence_name = name;
+	interval = interval_ > 0 ? interval_ : 0;
+	next_capture = std::chrono::steady_clock::now();
+	n_sequence = 0;
+	n_dropped = 0;
+	std::cout << "Capturing an image every " << interval << " s as " << CAPTURE_FOL << sequence_name << "-<number>.png" << std::endl;
+}
+
+void ScreenCapture::stop_sequence() {
+	if (!isSequencing()) return;
+	std::cout << "Capture : " << n_sequence << " images saved as " << CAPTURE_FOL << sequence_name << "-<number>.png";
+	if (n_dropped) std::cout << ", " << n_dropped << " dropped as encoding couldn't keep up";
+	std::cout << std::endl;
+	sequence_name.clear();
+}
+
+#if OPENGL_INCLUDE_SUCCESS
+void ScreenCapture::collect(uint8_t p) {
+	Image& image = reading[p];
+	if (image.path.empty()) return;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[p]);
+	const uint8_t* data = (const uint8_t*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY); // Only waits if the GPU is still reading the frame
+	if (data) {
+		Image ready = image;
+		ready.pixels = take_spare((size_t)image.width*image.height*4);
+		std::memcpy(ready.pixels.data(), data, ready.pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		push(ready);
+	}
+	else std::cout << "Failed reading the pixels of " << image.path << std::endl;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	image.path.clear();
+}
+#endif
+
+void ScreenCapture::frame(sf::RenderWindow& window) {
+	#if OPENGL_INCLUDE_SUCCESS
+		collect(next_pbo); // Read 2 frames ago, so it should be ready
+	#endif
+
+	auto now = std::chrono::steady_clock::now();
+	bool sequence_due = isSequencing() && now >= next_capture;
+	if (!sequence_due && !screenshot_wanted) return;
+	if (sequence_due) { // Skips the images the display was too slow for, so the sequence keeps its pace
+		auto step = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+		if (step.count() <= 0) next_capture = now;
+		else while (next_capture <= now) next_capture += step;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (queue.size() >= MAX_QUEUED) { // The screenshot waits for the next frame
+			if (sequence_due) n_dropped++;
+			return;
+		}
+	}
+
+	Image image;
+	image.width = window.getSize().x;
+	image.height = window.getSize().y;
+	if (sequence_due) { // A screenshot wanted at the same time is taken at the next frame
+		std::ostringstream path;
+		path << CAPTURE_FOL << sequence_name << '-' << std::setw(6) << std::setfill('0') << n_sequence++ << ".png";
+		image.path = path.str();
+	}
+	else {
+		image.path = CAPTURE_FOL "screenshot.png";
+		screenshot_wanted = false;
+	}
+
+	#if OPENGL_INCLUDE_SUCCESS
+		uint8_t p = next_pbo;
+		uint64_t size = (uint64_t)image.width*image.height*4;
+		if (!pbo[0]) glGenBuffers(2, pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[p]);
+		if (pbo_size[p] < size) {
+			glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+			pbo_size[p] = size;
+		}
+		glReadPixels(0, 0, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); // Returns right away, the GPU copies into pbo[p]
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		image.bottom_up = true;
+		reading[p] = image;
+		next_pbo = 1-next_pbo;
+	#else
+		if (texture.getSize() != window.getSize()) texture.create(image.width, image.height);
+		texture.update(window);
+		sf::Image pixels = texture.copyToImage();
+		image.pixels = take_spare((size_t)image.width*image.height*4);
+		std::memcpy(image.pixels.data(), pixels.getPixelsPtr(), image.pixels.size());
+		push(image);
+	#endif
+}
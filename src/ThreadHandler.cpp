@@ -44,4 +44,10 @@ void ThreadHandler::load_repartition(std::function<void(uint32_t, uint32_t)> arr
 		start = reached_work[fun_id].fetch_add(work_subset, std::memory_order_relaxed);
 		end = std::min(start + work_subset, arr_size);
 	};
-}
\ No newline at end of file
+}
+
+void ThreadHandler::wake_parked() {
+	pthread_mutex_lock(&park_mutex);
+	pthread_cond_broadcast(&park_condition);
+	pthread_mutex_unlock(&park_mutex);
+}
@@ -0,0 +1,164 @@
+#include "Topology.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <tuple>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define SYS_CPU "/sys/devices/system/cpu/"
+#define SYS_NODE "/sys/devices/system/node/"
+
+
+Topology::Topology() {
+	std::vector<uint16_t> online;
+	{
+		std::ifstream file(SYS_CPU "online");
+		std::string list;
+		if (file && std::getline(file, list)) online = parse_cpu_list(list);
+	}
+	if (online.empty()) { // No /sys, every CPU is a core on node 0
+		for (uint16_t i=0; i<std::max(std::thread::hardware_concurrency(), 1u); i++) online.push_back(i);
+	}
+
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	bool has_affinity = sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == 0;
+#endif
+
+	std::map<uint16_t, uint16_t> cpu_node;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(SYS_NODE, error)) {
+		std::string name = entry.path().filename().string();
+		if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit(name[4])) continue;
+		uint16_t node = std::stoi(name.substr(4));
+		std::ifstream file(entry.path() / "cpulist");
+		std::string list;
+		if (file && std::getline(file, list)) {
+			for (uint16_t cpu : parse_cpu_list(list)) cpu_node[cpu] = node;
+		}
+	}
+
+	for (uint16_t id : online) {
+#ifdef __linux__
+		if (has_affinity && id < CPU_SETSIZE && !CPU_ISSET(id, &allowed)) continue;
+#endif
+		std::string dir = SYS_CPU "cpu" + std::to_string(id) + "/topology/";
+		CPU cpu;
+		cpu.id = id;
+		cpu.core = read_sys_int(dir + "core_id", id);
+		cpu.package = read_sys_int(dir + "physical_package_id", 0);
+		cpu.node = cpu_node.count(id) ? cpu_node[id] : 0;
+		cpu.smt = 0;
+		cpus.push_back(cpu);
+	}
+
+	// Rank of each CPU among the hyper-threads of its core
+	std::map<std::tuple<uint16_t, uint16_t>, uint8_t> core_threads;
+	for (CPU& cpu : cpus) { // cpus are sorted by id
+		cpu.smt = core_threads[{cpu.package, cpu.core}]++;
+	}
+	n_cores = core_threads.size();
+	std::map<uint16_t, uint16_t> nodes_cores; // number of cores found in each node so far
+	std::vector<uint16_t> core_rank(cpus.size()); // rank of the core of each CPU in its node
+	for (uint16_t i=0; i<cpus.size(); i++) {
+		if (!cpus[i].smt) core_rank[i] = nodes_cores[cpus[i].node]++;
+	}
+	for (uint16_t i=0; i<cpus.size(); i++) { // hyper-threads get the rank of their core
+		for (uint16_t j=0; j<cpus.size(); j++) {
+			if (cpus[i].smt && !cpus[j].smt && cpus[i].package == cpus[j].package && cpus[i].core == cpus[j].core) core_rank[i] = core_rank[j];
+		}
+	}
+	n_nodes = std::max(nodes_cores.size(), (size_t)1);
+
+	for (uint16_t i=0; i<cpus.size(); i++) {
+		compact_order.push_back(i);
+		scatter_order.push_back(i);
+	}
+	std::sort(compact_order.begin(), compact_order.end(), [&](uint16_t a, uint16_t b) {
+		return std::make_tuple(cpus[a].node, cpus[a].smt, cpus[a].package, cpus[a].core, cpus[a].id) < std::make_tuple(cpus[b].node, cpus[b].smt, cpus[b].package, cpus[b].core, cpus[b].id);
+	});
+	std::sort(scatter_order.begin(), scatter_order.end(), [&](uint16_t a, uint16_t b) {
+		return std::make_tuple(cpus[a].smt, core_rank[a], cpus[a].node, cpus[a].id) < std::make_tuple(cpus[b].smt, core_rank[b], cpus[b].node, cpus[b].id);
+	});
+}
+
+
+int32_t Topology::read_sys_int(const std::string& path, int32_t fallback) {
+	std::ifstream file(path);
+	int32_t value;
+	if (file >> value) return value;
+	return fallback;
+}
+
+std::vector<uint16_t> Topology::parse_cpu_list(const std::string& list) {
+	std::vector<uint16_t> res;
+	size_t pos = 0;
+	while (pos < list.size()) {
+		size_t comma = list.find(',', pos);
+		if (comma == std::string::npos) comma = list.size();
+		std::string range = list.substr(pos, comma - pos);
+		size_t dash = range.find('-');
+		try {
+			uint16_t first = std::stoi(range.substr(0, dash));
+			uint16_t last = dash == std::string::npos ? first : std::stoi(range.substr(dash+1));
+			for (uint32_t cpu=first; cpu<=last; cpu++) res.push_back(cpu);
+		} catch (const std::exception&) {} // empty or malformed range
+		pos = comma + 1;
+	}
+	return res;
+}
+
+
+int32_t Topology::cpu_for_thread(uint16_t th_id, pinning_t policy) const {
+	if (cpus.empty()) return -1;
+	switch (policy) {
+		case pinning_t::COMPACT :
+			return cpus[compact_order[th_id % cpus.size()]].id;
+		case pinning_t::SCATTER :
+			return cpus[scatter_order[th_id % cpus.size()]].id;
+		default :
+			return -1;
+	}
+}
+
+bool Topology::pin_current_thread(int32_t cpu_id) {
+#ifdef __linux__
+	if (cpu_id < 0 || cpu_id >= CPU_SETSIZE) return false;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu_id, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set) == 0;
+#else
+	(void)cpu_id;
+	return false;
+#endif
+}
+
+void Topology::release_pages(void* data, size_t byte_size) {
+#ifdef __linux__
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t start = ((uintptr_t)data + page-1) / page * page;
+	uintptr_t end = ((uintptr_t)data + byte_size) / page * page;
+	if (start < end) madvise((void*)start, end - start, MADV_DONTNEED);
+#else
+	(void)data;
+	(void)byte_size;
+#endif
+}
+
+
+void Topology::print() const {
+	std::cout << "\t" << cpus.size() << " CPUs, " << n_cores << " cores, " << n_nodes << " NUMA node" << (n_nodes > 1 ? "s" : "") << std::endl;
+}
@@ -56,14 +56,15 @@ bool World::getCellCoord_fromPos(float pos_x, float pos_y, uint16_t* x, uint16_t
 	return (*x <= params.size[0] && *y <= params.size[1]); // using uint underflow to check for negative position.
 }
 
-void World::giveCellPart(uint16_t x, uint16_t y, uint32_t part) {
-	giveCellPart(getCell(x, y), part);
+bool World::giveCellPart(uint16_t x, uint16_t y, uint32_t part) {
+	return giveCellPart(getCell(x, y), part);
 }
 
 void World::giveCellSeg(uint16_t x, uint16_t y, uint16_t seg) {
 	// std::cout << "giveCellSeg(" << x << ", " << y << ", " << seg << ")" << std::endl;
 	if (segments_in_grid) {
 		Cell_seg& cell = getCell_seg(x, y);
+		seg_overflows += cell.nb_segs == MAX_SEG_CELL;
 		cell.segs[cell.nb_segs%MAX_SEG_CELL] = seg;
 		cell.nb_segs += (cell.nb_segs < MAX_SEG_CELL);
 	} else {
@@ -88,14 +89,16 @@ void World::remCellSeg(uint16_t x, uint16_t y, uint16_t seg) {
 }
 
 
-void World::giveCellPart(Cell& cell, uint32_t part) {
+bool World::giveCellPart(Cell& cell, uint32_t part) {
 	// std::cout << "giveCellPart(" << cell << ", " << part << ")" << std::endl;
 	uint8_t index = cell.nb_parts.load();
 	cell.nb_parts.store(index + (index!=MAX_PART_CELL));
 	cell.parts[index%MAX_PART_CELL] = part;
+	return index != MAX_PART_CELL;
 }
 
 void World::giveCellSeg(Cell_seg* cell, uint16_t seg) {
+	seg_overflows += cell->nb_segs == MAX_SEG_CELL;
 	cell->segs[cell->nb_segs%MAX_SEG_CELL] = seg;
 	cell->nb_segs += (cell->nb_segs < MAX_SEG_CELL);
 
@@ -104,18 +107,9 @@ void World::giveCellSeg(Cell_seg* cell, uint16_t seg) {
 
 
 bool World::will_use_nParticles(uint32_t max_n) {
-	if (2*max_n < gridSize[0]*gridSize[1]) { // Then we consider emptying the grid blindly is less efficient than emptying the cell we know are filled
-		// This is basically trading memory for speed.
-		filled_coords = new uint16_t[max_n*2];
-		memset(filled_coords, 0, max_n*2*sizeof(uint16_t));
-		empty_blind = false;
-	} else {
-		empty_blind = true;
-		if (filled_coords) {
-			delete[] filled_coords;
-			filled_coords = nullptr;
-		}
-	}
+	// If there are much more Cells than Particles, emptying the grid blindly is less efficient than emptying the cell we know are filled
+	// This is basically trading memory for speed.
+	set_emptying_mode(!(2*max_n < gridSize[0]*gridSize[1]), max_n);
 
 	chg_seg_store_sys(max_n);
 
@@ -123,6 +117,18 @@ bool World::will_use_nParticles(uint32_t max_n) {
 	return empty_blind;
 }
 
+void World::set_emptying_mode(bool blind, uint32_t max_n) {
+	if (filled_coords) {
+		delete[] filled_coords;
+		filled_coords = nullptr;
+	}
+	empty_blind = blind;
+	if (!empty_blind) {
+		filled_coords = new uint16_t[max_n*2];
+		memset(filled_coords, 0, max_n*2*sizeof(uint16_t));
+	}
+}
+
 
 void World::empty_grid_particle_blind(uint32_t start, uint32_t end) {
 	for (uint16_t y=start; y<end; y++) {
@@ -153,18 +159,20 @@ void World::empty_grid(T* grille) {
 void World::update_grid_particle_contenance(Particle* particle_array, uint32_t p_start, uint32_t p_end, float dt) {
 	// std::cout << "World::update_grid_particle_contenance(" << particle_array << ", " << p_start << ", " << p_end << ", " << dt << ")" << std::endl;
 	uint16_t next_pos[2];
+	uint64_t overflows = 0;
 	for (uint32_t i=p_start; i<p_end; i++) {
 			next_pos[0] = (particle_array[i].position[0] + particle_array[i].speed[0]*dt) / params.cellSize[0];
 			next_pos[1] = (particle_array[i].position[1] + particle_array[i].speed[1]*dt) / params.cellSize[1];
 
 			if (next_pos[0] < gridSize[0] && next_pos[1] < gridSize[1]) {
-				giveCellPart(next_pos[0], next_pos[1], i);
+				overflows += !giveCellPart(next_pos[0], next_pos[1], i);
 				if (!empty_blind) {
 					filled_coords[2*i   ] = next_pos[0];
 					filled_coords[2*i +1] = next_pos[1];
 				}
 			}
 	}
+	StepCounters::local().cell_overflows += overflows;
 }
 
 
@@ -383,39 +391,42 @@ void World::rem_segment(uint16_t index) {
 }
 
 void World::chg_seg_store_sys(uint32_t nb_parts) {
-	uint8_t i=0;
 	if ((segments_in_grid && (n_cell_seg.load() < nb_parts)) ||
 		 (!segments_in_grid && (1.2f* nb_parts < n_cell_seg.load())))
-		{
-		
-			std::cout << "Change in Segment storing system : number of Particles = " << nb_parts << ",  while number of Cells with a segment = " << n_cell_seg.load() << std::endl;
-			
-			grid_seg_mutex.lock();
-			segments_in_grid = !segments_in_grid;
-			if (segments_in_grid) { // segment storage -> grid storage
-		
-				grid_seg = new Cell_seg[gridSize[0]*gridSize[1]];
-				empty_grid(grid_seg);
-		
-				for (uint16_t s=0; s<seg_array.size(); s++) {
-					for (auto& coord : seg_array[s].cells) {
-						giveCellSeg(coord[0], coord[1], s);
-					}
-					n_cell_seg.fetch_sub(seg_array[s].cells.size()); // because giveCellSeg increments n_cell_seg
-					seg_array[s].cells.resize(0);
-					seg_array[s].cells.shrink_to_fit(); // If change happens often this line is inefficient.
-				}
-			}
-			else { // grid storage -> segment storage
-				if (grid_seg) delete[] grid_seg;
-				grid_seg = nullptr;
-				for (uint16_t s=0; s<seg_array.size(); s++) {
-					go_through_segment(s, &World::giveCellSeg);
-					n_cell_seg.fetch_sub(seg_array[s].cells.size()); // because giveCellSeg increments n_cell_seg
-				}
+	{
+		std::cout << "Change in Segment storing system : number of Particles = " << nb_parts << ",  while number of Cells with a segment = " << n_cell_seg.load() << std::endl;
+		set_seg_store_sys(!segments_in_grid);
+	}
+}
+
+void World::set_seg_store_sys(bool in_grid) {
+	if (in_grid == segments_in_grid) return;
+	grid_seg_mutex.lock();
+	segments_in_grid = !segments_in_grid;
+	if (segments_in_grid) { // segment storage -> grid storage
+
+		grid_seg = new Cell_seg[gridSize[0]*gridSize[1]];
+		empty_grid(grid_seg);
+		seg_overflows = 0;
+
+		for (uint16_t s=0; s<seg_array.size(); s++) {
+			for (auto& coord : seg_array[s].cells) {
+				giveCellSeg(coord[0], coord[1], s);
 			}
-			grid_seg_mutex.unlock();
+			n_cell_seg.fetch_sub(seg_array[s].cells.size()); // because giveCellSeg increments n_cell_seg
+			seg_array[s].cells.resize(0);
+			seg_array[s].cells.shrink_to_fit(); // If change happens often this line is inefficient.
+		}
 	}
+	else { // grid storage -> segment storage
+		if (grid_seg) delete[] grid_seg;
+		grid_seg = nullptr;
+		for (uint16_t s=0; s<seg_array.size(); s++) {
+			go_through_segment(s, &World::giveCellSeg);
+			n_cell_seg.fetch_sub(seg_array[s].cells.size()); // because giveCellSeg increments n_cell_seg
+		}
+	}
+	grid_seg_mutex.unlock();
 }
 
 void World::add_zone(int8_t function, float posX, float posY, float sizeX, float sizeY) {
@@ -448,6 +459,53 @@ void World::add_zone(int8_t function, float posX, float posY, float sizeX, float
 }
 
 
+void World::set_cell_size(const float cellSize[2]) {
+	grid_seg_mutex.lock();
+	params.cellSize[0] = cellSize[0];
+	params.cellSize[1] = cellSize[1];
+	gridSize[0] = ceil(params.size[0] / params.cellSize[0]);
+	gridSize[1] = ceil(params.size[1] / params.cellSize[1]);
+	if (grid) delete[] grid;
+	grid = new Cell[gridSize[0]*gridSize[1]];
+	empty_grid(grid);
+
+	// Giving the Segments their new Cells
+	n_cell_seg = 0;
+	if (segments_in_grid) {
+		if (grid_seg) delete[] grid_seg;
+		grid_seg = new Cell_seg[gridSize[0]*gridSize[1]];
+		empty_grid(grid_seg);
+		seg_overflows = 0;
+	}
+	for (uint16_t s=0; s<seg_array.size(); s++) {
+		seg_array[s].cells.clear();
+		go_through_segment(s, &World::giveCellSeg);
+	}
+
+	// The Zones are already on Cell borders, so adding them again only finds their new Cells
+	std::vector<Zone> old_zones;
+	old_zones.swap(zones);
+	zone_covered_cells = 0;
+	for (Zone& zone : old_zones) add_zone(zone.fun, zone.pos(0), zone.pos(1), zone.size(0), zone.size(1));
+	grid_seg_mutex.unlock();
+	std::cout << "World::set_cell_size : cellSize [" << params.cellSize[0] << ", " << params.cellSize[1] << "]   gridSize [" << gridSize[0] << ", " << gridSize[1] << "]" << std::endl;
+}
+
+bool World::fits_cell_size(const float cellSize[2]) {
+	auto on_border = [this, cellSize](float pos, bool c) {
+		if (pos <= 0 || params.size[c] <= pos) return true;
+		float cells = pos / cellSize[c];
+		return std::abs(cells - std::round(cells)) < 1e-3f;
+	};
+	for (Zone& zone : zones) {
+		for (uint8_t c=0; c<2; c++) {
+			if (!on_border(zone.pos(c), c) || !on_border(zone.endPos(c), c)) return false;
+		}
+	}
+	return true;
+}
+
+
 void World::change_cell_part(uint32_t part, float init_pos_x, float init_pos_y, float end_pos_x, float end_pos_y) {
 	// std::cout << "change cell part" << std::endl;
 	Cell* cell_init = getCell_fromPos(init_pos_x, init_pos_y);
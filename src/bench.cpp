@@ -0,0 +1,400 @@
+#include "Consometer.hpp"
+#include "Particle_simulator.hpp"
+#include "PerfCounters.hpp"
+#include "SaveLoader.hpp"
+#include "World.hpp"
+#include "utilities.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define BENCH_POS_FILE "bench_tmp" // Name of the position file written by the savePos benchmarks. It is deleted afterwards.
+
+/**
+* What to benchmark, read from the command line.
+*/
+struct Options {
+	std::vector<std::pair<std::string, std::string>> scenes; //< Pairs of map and psp file names.
+	std::vector<uint32_t> parts; //< Numbers of Particles. Empty keeps the number of the psp file.
+	std::vector<float> cell_sizes; //< Empty keeps the cell size of the map file.
+	std::vector<int> cs; //< Empty keeps the cs of the psp file.
+	uint32_t reps = 20; //< Number of measures of each kernel.
+	uint32_t warmup = 50; //< Number of simulation steps run before measuring, so the Particles aren't randomly placed anymore.
+	uint32_t seed = 1; //< Seed of rand(), so the Particles start at the same place at each run.
+	std::string only; //< Only the kernels which name contains this are measured.
+	std::string csv; //< File where the results are written in CSV. Empty for none.
+	std::string json; //< File where the results are written in JSON. Empty for none.
+	bool hw = false; //< Whether the hardware counters are read around each measure.
+};
+
+/**
+* Measures of a kernel in a scene.
+*/
+struct Result {
+	std::string map, psp;
+	uint32_t n_part;
+	float cell_size;
+	int cs;
+	std::string kernel;
+	uint64_t work; //< Number of items (Particles, Cells, ...) the kernel goes through.
+	std::vector<long> times; //< Duration of each repetition (ns).
+	std::vector<PerfCounters::Sample> hw; //< What the hardware counters counted at each repetition. Empty if they weren't read.
+
+	long min() const {return *std::min_element(times.begin(), times.end());};
+	long median() const {
+		std::vector<long> sorted = times;
+		std::sort(sorted.begin(), sorted.end());
+		return sorted[sorted.size()/2];
+	};
+	double mean() const {
+		double sum = 0;
+		for (long t : times) sum += t;
+		return sum / times.size();
+	};
+	/**
+	* @return The mean of event over the repetitions.
+	*/
+	double hw_mean(PerfCounters::event_t event) const {
+		double sum = 0;
+		for (const PerfCounters::Sample& sample : hw) sum += sample[event];
+		return hw.size() ? sum / hw.size() : 0;
+	};
+};
+
+
+void print_usage(const char* program) {
+	std::cout << "Usage : " << program << " [options]" << std::endl;
+	std::cout << "\t--scene map:psp   Scene to benchmark, files in saves/Map and saves/PSparameters. Can be repeated or be a comma separated list. Default:Default if none." << std::endl;
+	std::cout << "\t--all-scenes      Benchmarks every shipped map with the psp of the same name (or Default), and every other psp with the Default map." << std::endl;
+	std::cout << "\t--parts n,...     Numbers of particles. Default : max_part of the psp." << std::endl;
+	std::cout << "\t--cell size,...   Cell sizes of the grid. Default : cellSize of the map." << std::endl;
+	std::cout << "\t--cs n,...        Collision check sizes. Default : cs of the psp." << std::endl;
+	std::cout << "\t--reps n          Measures per kernel (default 20)." << std::endl;
+	std::cout << "\t--warmup n        Simulation steps before measuring (default 50)." << std::endl;
+	std::cout << "\t--seed n          Seed of the initial particle positions (default 1)." << std::endl;
+	std::cout << "\t--only name       Only measures the kernels which name contains name." << std::endl;
+	std::cout << "\t--csv file        Writes the results in CSV." << std::endl;
+	std::cout << "\t--json file       Writes the results in JSON." << std::endl;
+	std::cout << "\t--hw              Reads the hardware counters (cycles, instructions, cache and branch misses) around each measure, on Linux." << std::endl;
+}
+
+std::vector<std::string> split(const std::string& list, char separator = ',') {
+	std::vector<std::string> res;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, separator)) {
+		if (!item.empty()) res.push_back(item);
+	}
+	return res;
+}
+
+/**
+* @brief Lists the text files (not the "-bin" ones) of a save folder, without their extension.
+*/
+std::vector<std::string> list_presets(const std::string& folder) {
+	std::vector<std::string> res;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(folder, error)) {
+		std::string name = entry.path().stem().string();
+		if (name.size() < 4 || name.compare(name.size()-4, 4, "-bin")) res.push_back(name);
+	}
+	std::sort(res.begin(), res.end());
+	return res;
+}
+
+void add_all_scenes(Options& opt) {
+	std::vector<std::string> maps = list_presets("saves/Map");
+	std::vector<std::string> psps = list_presets("saves/PSparameters");
+	for (const std::string& map : maps) {
+		bool same_name = std::find(psps.begin(), psps.end(), map) != psps.end();
+		opt.scenes.push_back({map, same_name ? map : "Default"});
+	}
+	for (const std::string& psp : psps) {
+		if (std::find(maps.begin(), maps.end(), psp) == maps.end()) opt.scenes.push_back({"Default", psp});
+	}
+}
+
+/**
+* @return false if the command line couldn't be read.
+*/
+bool parse_options(int argc, char** argv, Options& opt) {
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--all-scenes") {
+			add_all_scenes(opt);
+			continue;
+		}
+		if (arg == "--hw") {
+			opt.hw = true;
+			continue;
+		}
+		if (i+1 >= argc) return false;
+		std::string value = argv[++i];
+		try {
+			if (arg == "--scene") {
+				for (const std::string& scene : split(value)) {
+					size_t colon = scene.find(':');
+					if (colon == std::string::npos) return false;
+					opt.scenes.push_back({scene.substr(0, colon), scene.substr(colon+1)});
+				}
+			}
+			else if (arg == "--parts") for (const std::string& n : split(value)) opt.parts.push_back(std::stoul(n));
+			else if (arg == "--cell")  for (const std::string& n : split(value)) opt.cell_sizes.push_back(std::stof(n));
+			else if (arg == "--cs")    for (const std::string& n : split(value)) opt.cs.push_back(std::stoi(n));
+			else if (arg == "--reps") opt.reps = std::max(std::stoul(value), 1ul);
+			else if (arg == "--warmup") opt.warmup = std::stoul(value);
+			else if (arg == "--seed") opt.seed = std::stoul(value);
+			else if (arg == "--only") opt.only = value;
+			else if (arg == "--csv") opt.csv = value;
+			else if (arg == "--json") opt.json = value;
+			else return false;
+		} catch (const std::exception&) {
+			return false;
+		}
+	}
+	if (opt.scenes.empty()) opt.scenes.push_back({"Default", "Default"});
+	return true;
+}
+
+
+/**
+* @brief Measures every kernel in a scene and adds the results to results.
+* @param n_part 0 keeps the number of Particles of the psp file.
+* @param cell_size 0 keeps the cell size of the map file.
+* @param cs Negative keeps the cs of the psp file.
+*/
+void bench_scene(const Options& opt, const std::string& map, const std::string& psp, uint32_t n_part, float cell_size, int cs, PerfCounters& hw, std::vector<Result>& results) {
+	SaveLoader loader;
+	WorldParam world_param;
+	PSparam sim_param;
+	if (loader.loadParam(world_param, map) < 0 || loader.loadParam(sim_param, psp) < 0) {
+		std::cout << "Skipping scene " << map << ":" << psp << std::endl;
+		return;
+	}
+	if (cell_size > 0) world_param.cellSize[0] = world_param.cellSize[1] = cell_size;
+	World world(world_param);
+	loader.loadWorldSegNZones(world, map);
+
+	// The measures are done on a single thread, with a constant number of Particles
+	if (n_part) sim_param.max_part = n_part;
+	sim_param.n_part_start = sim_param.max_part;
+	sim_param.pps = 0;
+	if (cs >= 0) sim_param.cs = cs;
+	sim_param.n_threads = 1;
+	sim_param.elastic_threads = false;
+	sim_param.pinning = (uint8_t)Topology::pinning_t::NONE;
+	sim_param.decomposition = (uint8_t)Particle_simulator::decomposition_t::INDEX;
+	bool blind = world.will_use_nParticles(sim_param.max_part);
+
+	std::srand(opt.seed);
+	Particle_simulator sim(world, sim_param);
+	if (opt.warmup) {
+		sim.stop_after(opt.warmup);
+		sim.start_simulation_threads();
+		while (sim.simulate) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		sim.stop_simulation_threads(); // The grid is left empty
+	}
+
+	uint32_t n = sim.get_active_part();
+	uint16_t rows = world.getGridSize(1);
+	std::vector<Particle> snapshot(sim.get_particle_data(), sim.get_particle_data() + n);
+	auto restore = [&]() {std::memcpy((void*)&sim[0], snapshot.data(), n*sizeof(Particle));};
+	auto clear_grid = [&]() {world.empty_grid_particle_blind(0, rows);};
+	auto fill_grid = [&]() {world.update_grid_particle_contenance(&sim[0], 0, n, sim.params.dt);};
+	auto refill_grid = [&]() {restore(); clear_grid(); fill_grid();};
+
+	std::cout << std::endl << "Scene " << map << ":" << psp << ", " << i2s(n) << " particles, cellSize " << world.getCellSize(0) << ", cs " << (int)sim.params.cs << std::endl;
+	Consometre conso;
+	auto measure = [&](const std::string& kernel, uint64_t work, std::function<void()> setup, std::function<void()> run) {
+		if (!opt.only.empty() && kernel.find(opt.only) == std::string::npos) return;
+		Result res{map, psp, n, world.getCellSize(0), sim.params.cs, kernel, work, {}, {}};
+		PerfCounters::Sample before, after;
+		for (uint32_t r=0; r<opt.reps; r++) {
+			setup();
+			bool counted = hw.read(before);
+			conso.Start();
+			run();
+			conso.Stop();
+			if (counted && hw.read(after)) res.hw.push_back(after - before);
+			res.times.push_back(conso.count());
+		}
+		std::cout << "\t" << std::left << std::setw(40) << kernel << std::right << std::setw(12) << res.median()/1000000.f << " ms" << std::setw(12) << (float)res.median()/std::max(work, (uint64_t)1) << " ns/item";
+		if (res.hw.size()) {
+			double items = std::max(work, (uint64_t)1);
+			std::cout << std::setw(8) << std::setprecision(3) << res.hw_mean(PerfCounters::event_t::INSTRUCTIONS) / std::max(res.hw_mean(PerfCounters::event_t::CYCLES), 1.) << " IPC"
+				<< std::setw(10) << res.hw_mean(PerfCounters::event_t::L1D_MISSES) / items << " L1d/item"
+				<< std::setw(10) << res.hw_mean(PerfCounters::event_t::LLC_MISSES) / items << " LLC/item" << std::setprecision(6);
+		}
+		std::cout << std::endl;
+		results.push_back(res);
+	};
+
+	// Particle to Particle collisions
+	const char* pp_names[] = {"BASE", "TLEV", "PHYACC", "COHERENT"};
+	PSparam chosen = sim.params;
+	for (uint8_t fun=0; fun<4; fun++) {
+		PSparam changed = chosen;
+		changed.pp_collision_fun = fun;
+		sim.setParameters(changed);
+		measure(std::string("collision_pp_grid<") + pp_names[fun] + ">", n, refill_grid, [&]() {sim.collision_pp_chosen(0, n);});
+	}
+	sim.setParameters(chosen);
+
+	// Grid
+	clear_grid();
+	measure("update_grid_particle_contenance", n, clear_grid, fill_grid);
+	measure("empty_grid_particle_blind", (uint64_t)rows*world.getGridSize(0), refill_grid, clear_grid);
+	clear_grid();
+	world.set_emptying_mode(false, sim_param.max_part);
+	measure("empty_grid_particle_pbased", n, refill_grid, [&]() {world.empty_grid_particle_pbased(0, n);});
+	clear_grid();
+	world.set_emptying_mode(blind, sim_param.max_part);
+
+	// Particle to Segment collisions
+	if (world.seg_array.size()) {
+		world.set_seg_store_sys(true);
+		measure("comparison_ps_grid", n, refill_grid, [&]() {sim.comparison_ps_grid(0, n);});
+		world.set_seg_store_sys(false);
+		uint64_t seg_cells = 0;
+		for (Segment& seg : world.seg_array) seg_cells += seg.cells.size();
+		measure("comparison_sp_grid", seg_cells, refill_grid, [&]() {
+			for (uint16_t s=0; s<world.seg_array.size(); s++) sim.comparison_sp_grid(0, world.seg_array[s].cells.size(), s);
+		});
+	}
+
+	// Particle to Zone interactions
+	if (world.getNbOfZones()) {
+		measure("comparison_pz", n, refill_grid, [&]() {sim.comparison_pz(0, n);});
+		measure("comparison_zp", world.getNZoneCoveredCells(), refill_grid, [&]() {
+			for (uint16_t z=0; z<world.getNbOfZones(); z++) sim.comparison_zp(0, world.getZone(z).getLength(), z);
+		});
+	}
+	clear_grid();
+	restore();
+
+	// Saving positions
+	const char* compression_names[] = {"Normal", "Discreet", "PosOnly", "Both", "Delta", "DeltaPosOnly"};
+	std::error_code error;
+	std::filesystem::create_directories("saves/Positions", error);
+	auto drift = [&]() { // So consecutive saves differ as in a simulation, which matters to the Delta modes
+		for (uint32_t p=0; p<n; p++) {
+			sim[p].position[0] += sim[p].speed[0] * sim.params.dt;
+			sim[p].position[1] += sim[p].speed[1] * sim.params.dt;
+		}
+	};
+	for (uint8_t mode=0; mode<6; mode++) {
+		std::string kernel = std::string("savePos<") + compression_names[mode] + ">";
+		if (!opt.only.empty() && kernel.find(opt.only) == std::string::npos) continue;
+		SLinfoPos info = SLinfoPos::Lazy();
+		info.save_pos = true;
+		info.comp_delta = mode >= SLinfoPos::compression_mode::Delta;
+		info.comp_discreet = mode & 1 || info.comp_delta;
+		info.comp_out_speed = info.comp_delta ? mode == SLinfoPos::compression_mode::DeltaPosOnly : mode & 2;
+		std::strcpy(info.posFileName, BENCH_POS_FILE);
+		{
+			SaveLoader saver;
+			saver.prepareSavePos(30, FileHandler::GB, info, n, world, 0);
+			if (!std::filesystem::exists("saves/Positions/" BENCH_POS_FILE ".pos")) continue;
+			double time = 0;
+			measure(kernel, n, drift, [&]() {saver.savePos(&sim[0], n, time++);});
+		}
+		std::cout << "\t" << kernel << " : " << std::filesystem::file_size("saves/Positions/" BENCH_POS_FILE ".pos", error) / std::max(opt.reps, (uint32_t)1) << " bytes per frame" << std::endl;
+		std::filesystem::remove("saves/Positions/" BENCH_POS_FILE ".pos");
+		restore();
+	}
+}
+
+
+void write_csv(const std::string& file_name, const std::vector<Result>& results, const PerfCounters& hw) {
+	std::ofstream file(file_name);
+	file << "map,psp,particles,cell_size,cs,kernel,work,reps,min_ns,median_ns,mean_ns,ns_per_item";
+	// The mean of each hardware counter per repetition, empty if it wasn't read
+	for (const char* event : {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"}) file << "," << event;
+	file << "\n";
+	for (const Result& res : results) {
+		file << res.map << "," << res.psp << "," << res.n_part << "," << res.cell_size << "," << res.cs << "," << res.kernel << "," << res.work << "," << res.times.size() << ","
+			<< res.min() << "," << res.median() << "," << res.mean() << "," << (double)res.median()/std::max(res.work, (uint64_t)1);
+		for (uint8_t e=0; e<PerfCounters::NB_EVENTS; e++) {
+			file << ",";
+			if (res.hw.size() && hw.counts((PerfCounters::event_t)e)) file << res.hw_mean((PerfCounters::event_t)e);
+		}
+		file << "\n";
+	}
+	std::cout << "Results written in " << file_name << std::endl;
+}
+
+void write_json(const std::string& file_name, const std::vector<Result>& results, const Options& opt, const PerfCounters& hw) {
+	std::ofstream file(file_name);
+	char date[32];
+	std::time_t now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+	file << "{\n\t\"date\": \"" << date << "\",\n\t\"reps\": " << opt.reps << ",\n\t\"warmup\": " << opt.warmup << ",\n\t\"seed\": " << opt.seed << ",\n\t\"results\": [\n";
+	for (size_t i=0; i<results.size(); i++) {
+		const Result& res = results[i];
+		file << "\t\t{\"map\": \"" << res.map << "\", \"psp\": \"" << res.psp << "\", \"particles\": " << res.n_part << ", \"cell_size\": " << res.cell_size << ", \"cs\": " << res.cs
+			<< ", \"kernel\": \"" << res.kernel << "\", \"work\": " << res.work << ", \"min_ns\": " << res.min() << ", \"median_ns\": " << res.median() << ", \"mean_ns\": " << res.mean()
+			<< ", \"times_ns\": [";
+		for (size_t t=0; t<res.times.size(); t++) file << (t ? ", " : "") << res.times[t];
+		file << "]";
+		if (res.hw.size()) { // null for the counters that weren't read
+			const char* names[PerfCounters::NB_EVENTS] = {"cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+			file << ", \"hw\": {";
+			for (uint8_t e=0; e<PerfCounters::NB_EVENTS; e++) {
+				file << (e ? ", " : "") << "\"" << names[e] << "\": ";
+				if (hw.counts((PerfCounters::event_t)e)) file << res.hw_mean((PerfCounters::event_t)e);
+				else file << "null";
+			}
+			file << "}";
+		}
+		file << "}" << (i+1 < results.size() ? "," : "") << "\n";
+	}
+	file << "\t]\n}\n";
+	std::cout << "Results written in " << file_name << std::endl;
+}
+
+
+/**
+* Measures the main kernels of the simulation on a single thread, for every combination of the scenes, numbers of Particles, cell sizes and cs given.
+* The Particles start from the same positions at each run (for a given seed), and each repetition starts from the same state.
+*/
+int main(int argc, char** argv) {
+	Options opt;
+	if (!parse_options(argc, argv, opt)) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	// A value per parameter at least, 0 or negative meaning the one from the files
+	if (opt.parts.empty()) opt.parts.push_back(0);
+	if (opt.cell_sizes.empty()) opt.cell_sizes.push_back(0);
+	if (opt.cs.empty()) opt.cs.push_back(-1);
+
+	PerfCounters hw; // The measures are all done by this thread
+	if (opt.hw) hw.open(true);
+
+	std::vector<Result> results;
+	for (auto& scene : opt.scenes) {
+		for (uint32_t n_part : opt.parts) {
+			for (float cell_size : opt.cell_sizes) {
+				for (int cs : opt.cs) {
+					bench_scene(opt, scene.first, scene.second, n_part, cell_size, cs, hw, results);
+				}
+			}
+		}
+	}
+
+	if (!opt.csv.empty()) write_csv(opt.csv, results, hw);
+	if (!opt.json.empty()) write_json(opt.json, results, opt, hw);
+	return EXIT_SUCCESS;
+}
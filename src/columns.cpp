@@ -0,0 +1,146 @@
+#include "ColumnExporter.hpp"
+#include "SaveLoader.hpp"
+#include "World.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NULLPART (uint32_t)-1
+
+/**
+* What to convert, read from the command line.
+*/
+struct Options {
+	std::string pos_name; //< Positions file in saves/Positions.
+	std::string name; //< Name of the chunks written in saves/Exports. The name of the positions file by default.
+	uint32_t chunk_frames = 64;
+	uint32_t max_particles = 0; //< Most Particles in a frame. The IDs bound of the file if 0, or DEFAULT_MAX_PARTICLES if it has no IDs.
+	uint32_t n_threads = 0; //< One per hardware thread if 0.
+	ColumnLayout layout;
+};
+static constexpr uint32_t DEFAULT_MAX_PARTICLES = 1 << 20;
+
+void print_usage(const char* program) {
+	std::cout << "Usage : " << program << " <positions> [--name <name>] [--chunk <frames>] [--speed] [--cells <map>] [--max <particles>] [--threads <n>]" << std::endl;
+	std::cout << "\tpositions Positions file in saves/Positions, with or without its folder and extension (e.g. run1)" << std::endl;
+	std::cout << "\t--name    Name of the chunks written in saves/Exports, the positions file's by default (e.g. run1_cols)" << std::endl;
+	std::cout << "\t--chunk   Frames per chunk (default 64)" << std::endl;
+	std::cout << "\t--speed   Adds the norm of the speed of each particle, if the file has speeds" << std::endl;
+	std::cout << "\t--cells   Adds the grid cell of each particle, in the grid of the given map (e.g. Default)" << std::endl;
+	std::cout << "\t--max     Most particles in a frame, for files saved without IDs (default " << DEFAULT_MAX_PARTICLES << ")" << std::endl;
+	std::cout << "\t--threads Number of chunks converted at the same time (default : one per hardware thread)" << std::endl;
+}
+
+/**
+* @brief Loop of a converting thread : takes the next chunk to convert until there is none left.
+* @details Each thread has its own SaveLoader, so it can jump to the first frame of its chunk (@see SaveLoader::seekPos) then read on.
+*/
+void convert_chunks(const Options& options, SLinfoPos info, uint32_t n_frames, std::atomic<uint32_t>& next_chunk, std::atomic<uint32_t>& failed) {
+	SaveLoader loader;
+	loader.prepareLoadPos(options.max_particles, info);
+	std::vector<Particle> particles(options.max_particles);
+	std::vector<uint32_t> ids(options.max_particles);
+	ColumnChunk chunk;
+	uint32_t n_chunks = (n_frames + options.chunk_frames-1) / options.chunk_frames;
+	for (uint32_t c = next_chunk++; c < n_chunks; c = next_chunk++) {
+		uint32_t first = c * options.chunk_frames;
+		uint32_t end = std::min(first + options.chunk_frames, n_frames);
+		chunk.clear(first);
+		bool res = true;
+		for (uint32_t f=first; res && f<end; f++) {
+			double time;
+			uint32_t n_parts = f == first ? loader.seekPos(f, particles.data(), particles.size(), &time, ids.data())
+			                               : loader.loadPos(particles.data(), particles.size(), &time, ids.data());
+			res = n_parts != NULLPART;
+			if (res) chunk.append(particles.data(), n_parts, time, ids.data(), options.layout);
+		}
+		if (res) {
+			SaveLoader saver;
+			res = saver.saveColumns(chunk, SaveLoader::columnsName(options.name, first));
+		}
+		if (!res) {
+			failed++;
+			std::cout << "Frames " << first << " to " << end-1 << " : Failed" << std::endl;
+		}
+	}
+}
+
+/**
+* Converts a positions file into chunks of columns (@see SaveLoader::saveColumns), several chunks at a time.
+* Usage : particle_sim2_columns <positions> [--name <name>] [--chunk <frames>] [--speed] [--cells <map>] [--max <particles>] [--threads <n>]
+* The columns are time, start, id, x and y, then vx and vy if the file has speeds. --speed adds the norm of the speed, --cells the grid cell of each Particle in the map's grid.
+*/
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	Options options;
+	options.pos_name = std::filesystem::path(argv[1]).stem().string();
+	options.name = options.pos_name;
+	std::string map_name;
+	for (int a=2; a<argc; a++) {
+		std::string option = argv[a];
+		if (option == "--speed") options.layout.speed_norm = true;
+		else if (option == "--name" && a+1 < argc) options.name = argv[++a];
+		else if (option == "--chunk" && a+1 < argc) options.chunk_frames = std::max(std::atoi(argv[++a]), 1);
+		else if (option == "--cells" && a+1 < argc) map_name = std::filesystem::path(argv[++a]).stem().string();
+		else if (option == "--max" && a+1 < argc) options.max_particles = std::strtoul(argv[++a], nullptr, 10);
+		else if (option == "--threads" && a+1 < argc) options.n_threads = std::atoi(argv[++a]);
+		else {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!map_name.empty()) {
+		SaveLoader saveLoader;
+		WorldParam world_param;
+		if (saveLoader.loadParam(world_param, map_name) < 0) return EXIT_FAILURE;
+		World world(world_param);
+		for (uint8_t d=0; d<2; d++) {
+			options.layout.cell_size[d] = world.getCellSize(d);
+			options.layout.grid_size[d] = world.getGridSize(d);
+		}
+	}
+
+	SLinfoPos info = SLinfoPos::Lazy();
+	info.load_pos = true;
+	std::strncpy(info.posFileName, options.pos_name.c_str(), SLinfoPos::fileNameSize-1);
+	uint32_t n_frames;
+	{ // Indexes the file once, before the threads read the index
+		SaveLoader loader;
+		loader.prepareLoadPos(options.max_particles ? options.max_particles : DEFAULT_MAX_PARTICLES, info);
+		n_frames = loader.getPosFrameCount();
+		if (!options.max_particles) options.max_particles = loader.getPosIdBound() ? loader.getPosIdBound() : DEFAULT_MAX_PARTICLES;
+		options.layout.speeds = !loader.getCompression().isCompOutSpeed();
+		options.layout.speed_norm = options.layout.speed_norm && options.layout.speeds;
+	}
+	if (!n_frames) {
+		std::cout << "No frame to convert in " << options.pos_name << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	uint32_t n_chunks = (n_frames + options.chunk_frames-1) / options.chunk_frames;
+	uint32_t n_threads = options.n_threads ? options.n_threads : std::max(std::thread::hardware_concurrency(), 1u);
+	n_threads = std::min(n_threads, n_chunks);
+	std::cout << "Converting " << n_frames << " frames into " << n_chunks << " chunks on " << n_threads << " thread" << (n_threads > 1 ? "s" : "") << std::endl;
+
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<uint32_t> next_chunk{0}, failed{0};
+	std::vector<std::thread> threads;
+	for (uint32_t t=0; t<n_threads; t++) threads.emplace_back(convert_chunks, std::cref(options), info, n_frames, std::ref(next_chunk), std::ref(failed));
+	for (std::thread& thread : threads) thread.join();
+
+	std::cout << "Wrote " << n_chunks - failed << " chunks as saves/Exports/" << options.name << "-<first frame>.col in "
+		<< std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
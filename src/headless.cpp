@@ -0,0 +1,214 @@
+#include "FrameWriter.hpp"
+#include "Particle_simulator.hpp"
+#include "Rasterizer.hpp"
+#include "World.hpp"
+#include "SaveLoader.hpp"
+#include "utilities.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+
+void print_usage(const char* program) {
+	std::cout << "Usage : " << program << " <map> <psp> <steps | duration>s [--trace <file>] [--counters <file>] [--hw] [--autotune] [--record <name>] [--save-every <steps>] [--drop-frames] [--export <name>] [--video <name> [--video-width <px>] [--video-fps <fps>] [--video-raw] [--video-threads <n>]] [--checkpoint <name> <period> [--restore [step]]]" << std::endl;
+	std::cout << "\tmap       World file in saves/Map (e.g. Default or saves/Map/TeslaValve.map)" << std::endl;
+	std::cout << "\tpsp       Simulation parameters file in saves/PSparameters (e.g. water)" << std::endl;
+	std::cout << "\tsteps     Number of simulation steps to run (e.g. 10000)" << std::endl;
+	std::cout << "\tduration  Simulated time to run, in seconds (e.g. 2.5s)" << std::endl;
+	std::cout << "\t--trace   Where to write a Chrome trace of the simulation threads (e.g. trace.json)" << std::endl;
+	std::cout << "\t--counters Where to write the counters of each step as CSV (e.g. counters.csv)" << std::endl;
+	std::cout << "\t--hw      Reads the hardware counters (cycles, cache misses, ...) of each phase, on Linux" << std::endl;
+	std::cout << "\t--autotune Tries the simulation strategies, cellSize and cs while running, then writes the fastest in the map and psp files" << std::endl;
+	std::cout << "\t--record  Saves the Particle positions of each step in saves/Positions (e.g. run1)" << std::endl;
+	std::cout << "\t--save-every While recording, number of steps between 2 saved frames, to replay them interpolated (e.g. 20)" << std::endl;
+	std::cout << "\t--export  Exports the Particles as chunks of columns in saves/Exports, for analyses (e.g. run1)" << std::endl;
+	std::cout << "\t--drop-frames While recording, skips frames rather than waiting when the disk can't keep up" << std::endl;
+	std::cout << "\t--video   Draws the world on the CPU and writes the images in saves/Frames, to make a video (e.g. run1)" << std::endl;
+	std::cout << "\t--video-width Width of the images in pixels, the height following the world's (default 1280)" << std::endl;
+	std::cout << "\t--video-fps Images per simulated second (default 60)" << std::endl;
+	std::cout << "\t--video-raw Writes the images as a single raw RGBA stream rather than PPM files" << std::endl;
+	std::cout << "\t--video-threads Number of threads drawing the images (default : one per 2 hardware threads)" << std::endl;
+	std::cout << "\t--checkpoint Writes a checkpoint every period simulated seconds in saves/Checkpoints, 0 for none (e.g. run1 10)" << std::endl;
+	std::cout << "\t--restore Restarts from the checkpoint of --checkpoint of the given step, or the latest one, instead of the map and psp" << std::endl;
+}
+
+/**
+* Runs the simulation without any window, as fast as possible, for a given number of steps or simulated duration.
+* Usage : particle_sim2_headless <map> <psp> <steps | duration>s [--trace <file>] [--counters <file>] [--hw] [--autotune] [--record <name>] [--save-every <steps>] [--drop-frames] [--export <name>] [--video <name> [--video-width <px>] [--video-fps <fps>] [--video-raw] [--video-threads <n>]] [--checkpoint <name> <period> [--restore [step]]]
+* The map and psp are file names in saves/Map and saves/PSparameters, with or without their folder and extension.
+* A duration is a number of simulated seconds followed by 's', e.g. "2.5s". Otherwise it is a number of steps.
+* With --trace, the work of each simulation thread is recorded and written as a Chrome trace at the end. Only the last steps are kept.
+* With --counters, the StepCounters of each step are written as CSV.
+* With --hw, the hardware counters of each phase are printed with the phase timings, if the system allows reading them.
+* With --record, the Particle positions are saved as with save_pos in loading_orders.sli, and the recorder's statistics are printed at the end.
+* With --export, the Particles are exported as with export_columns in loading_orders.sli. The positions file and the columns have the same name, the last one given.
+* With --video, this thread draws the latest step copied by the simulation threads (@see Particle_simulator::get_display_frame) each 1/fps simulated second, with a Rasterizer,
+* and a FrameWriter writes the images in the background. The simulation never waits for them : if drawing falls behind, images are skipped and counted.
+* With --checkpoint, checkpoints are written as with checkpoint_period in loading_orders.sli. With --restore, the world, parameters and Particles come from a checkpoint, and the steps or duration are run from it.
+* The checksum of the Particles is printed at the end, so a run restarted from a checkpoint can be compared with one that wasn't stopped.
+* With --autotune, the strategies of the simulation and its grid are tuned during the run (@see Particle_simulator::autotune). If the tuning finished, the fastest ones are written back in the map and psp files.
+*/
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	std::string trace_file, counters_file;
+	bool hw_counters = false;
+	bool autotune = false;
+	SLinfoPos record = SLinfoPos::Lazy();
+	std::string video_name;
+	uint32_t video_width = 1280, video_threads = 0;
+	double video_fps = 60;
+	FrameWriter::format_t video_format = FrameWriter::format_t::PPM;
+	for (int a=4; a<argc; a++) {
+		std::string option = argv[a];
+		if (option == "--hw") hw_counters = true;
+		else if (option == "--video-raw") video_format = FrameWriter::format_t::RAW;
+		else if (option == "--video" && a+1 < argc) video_name = argv[++a];
+		else if (option == "--video-width" && a+1 < argc) video_width = std::atoi(argv[++a]);
+		else if (option == "--video-fps" && a+1 < argc) video_fps = std::atof(argv[++a]);
+		else if (option == "--video-threads" && a+1 < argc) video_threads = std::atoi(argv[++a]);
+		else if (option == "--autotune") autotune = true;
+		else if (option == "--drop-frames") record.drop_frames = true;
+		else if (option == "--record" && a+1 < argc) {
+			record.save_pos = true;
+			std::strncpy(record.posFileName, argv[++a], SLinfoPos::fileNameSize-1);
+		}
+		else if (option == "--export" && a+1 < argc) {
+			record.export_columns = true;
+			std::strncpy(record.posFileName, argv[++a], SLinfoPos::fileNameSize-1);
+		}
+		else if (option == "--save-every" && a+1 < argc) record.save_every = std::atoi(argv[++a]);
+		else if (option == "--checkpoint" && a+2 < argc) {
+			std::strncpy(record.checkpointFileName, argv[++a], SLinfoPos::fileNameSize-1);
+			record.checkpoint_period = std::atof(argv[++a]);
+		}
+		else if (option == "--restore") {
+			record.load_checkpoint = true;
+			if (a+1 < argc && argv[a+1][0] != '-') record.checkpoint_step = std::strtoull(argv[++a], nullptr, 10);
+		}
+		else if (option == "--trace" && a+1 < argc) trace_file = argv[++a];
+		else if (option == "--counters" && a+1 < argc) counters_file = argv[++a];
+		else {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	// SaveLoader adds the folders and extensions itself
+	std::string map_name = std::filesystem::path(argv[1]).stem().string();
+	std::string psp_name = std::filesystem::path(argv[2]).stem().string();
+	std::string length = argv[3];
+	bool is_duration = !length.empty() && length.back() == 's';
+	if (is_duration) length.pop_back();
+	char* end;
+	double amount = std::strtod(length.c_str(), &end);
+	if (length.empty() || *end != '\0' || !(amount > 0)) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	SaveLoader* saveLoader = new SaveLoader;
+	PSparam* sim_param = new PSparam;
+	WorldParam* world_param = new WorldParam;
+	std::string checkpoint;
+	if (record.load_checkpoint) {
+		record.checkpoint_step = saveLoader->findCheckpoint(record.checkpointName(), record.checkpoint_step);
+		if (!record.checkpoint_step) {
+			std::cout << "No checkpoint " << record.checkpointName() << " found" << std::endl;
+			return EXIT_FAILURE;
+		}
+		checkpoint = SaveLoader::checkpointName(record.checkpointName(), record.checkpoint_step);
+		if (saveLoader->loadCheckpointParam(*world_param, *sim_param, checkpoint) < 0) return EXIT_FAILURE;
+	}
+	else {
+		if (saveLoader->loadParam(*world_param, map_name) < 0) return EXIT_FAILURE;
+		if (saveLoader->loadParam(*sim_param, psp_name) < 0) return EXIT_FAILURE;
+	}
+
+	World world(*world_param);
+	if (record.load_checkpoint) saveLoader->loadCheckpointSegNZones(world, checkpoint);
+	else saveLoader->loadWorldSegNZones(world, map_name);
+	world.will_use_nParticles(sim_param->max_part);
+
+	Particle_simulator sim(world, *sim_param, record);
+	uint64_t steps = is_duration ? (uint64_t)std::ceil(amount / sim.params.dt) : (uint64_t)amount;
+	sim.stop_after(steps);
+	if (!trace_file.empty()) sim.profiler.start_recording();
+	sim.use_hw_counters(hw_counters);
+	if (!counters_file.empty() && !sim.stream_counters(counters_file)) return EXIT_FAILURE;
+	if (autotune) sim.autotune(true);
+	float cellSize[2] = {world.getCellSize(0), world.getCellSize(1)};
+
+	delete saveLoader;
+	delete sim_param;
+	delete world_param;
+
+	Rasterizer* rasterizer = nullptr;
+	FrameWriter* frame_writer = nullptr;
+	if (!video_name.empty()) {
+		rasterizer = new Rasterizer(world, video_width, sim.params.radii, Rasterizer::DEFAULT_MAX_SPEED, video_threads);
+		frame_writer = new FrameWriter(video_name, rasterizer->getWidth(), rasterizer->getHeight(), video_format);
+		std::cout << "Drawing " << rasterizer->getWidth() << "x" << rasterizer->getHeight() << " images on " << rasterizer->getThreads() << " threads, " << video_fps << " per simulated second" << std::endl;
+		sim.want_snapshots(true);
+	}
+	double video_start = sim.get_time();
+	uint64_t video_frame = 0, skipped_frames = 0;
+
+	std::cout << "Running " << i2s(steps) << " steps (" << steps*sim.params.dt << " simulated seconds)" << std::endl;
+	auto start = std::chrono::steady_clock::now();
+	sim.start_simulation_threads();
+	while (sim.simulate) { // The simulation threads stop by themselves after the last step
+		if (!rasterizer) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		Particle_simulator::DisplayFrame frame = sim.get_display_frame();
+		if (std::isnan(frame.time) || frame.time < video_start + video_frame/video_fps) {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			continue;
+		}
+		frame_writer->submit(rasterizer->draw(frame.particles, frame.n_parts));
+		video_frame++;
+		while (frame.time >= video_start + video_frame/video_fps) { // The simulation went past the next images while this one was drawn
+			video_frame++;
+			skipped_frames++;
+		}
+	}
+	sim.stop_simulation_threads();
+	double wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << std::endl << "Simulated " << sim.get_time() << " s in " << sim.get_step_count() << " steps, in " << wall_time << " s" << std::endl;
+	std::cout << "\t" << sim.get_step_count() / wall_time << " steps/s" << std::endl;
+	std::cout << "\t" << sim.get_particle_steps() / wall_time / 1000000 << " million particle-steps/s" << std::endl;
+	std::cout << "\t" << sim.get_active_part() << " particles at the end, on " << sim.get_active_threads() << "/" << sim.get_max_threads() << " threads" << std::endl;
+	std::cout << "\tChecksum of the Particles : " << std::hex << sim.checksum() << std::dec << " (step " << i2s(sim.get_total_steps()) << ")" << std::endl;
+	sim.print_phase_timings();
+	if (sim.get_recorder()) sim.get_recorder()->print_stats();
+	if (frame_writer) {
+		frame_writer->print_stats();
+		if (skipped_frames) std::cout << "\t" << skipped_frames << " images skipped as drawing couldn't keep up with the simulation" << std::endl;
+		delete frame_writer; // Writes the last image
+		delete rasterizer;
+	}
+	if (!trace_file.empty() && !sim.profiler.export_chrome_trace(trace_file)) return EXIT_FAILURE;
+
+	if (autotune) {
+		const Autotuner& tuner = sim.get_autotuner();
+		if (tuner.is_finished()) {
+			std::cout << "Autotuning results (* is kept) :" << std::endl;
+			tuner.print_results();
+			bool grid_changed = world.getCellSize(0) != cellSize[0] || world.getCellSize(1) != cellSize[1];
+			SaveLoader saver;
+			saver.saveTuning(world, sim.params, grid_changed ? map_name : "", psp_name);
+		}
+		else std::cout << "Autotuning didn't finish in " << i2s(steps) << " steps, nothing is written. Try with more steps." << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
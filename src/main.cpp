@@ -5,6 +5,7 @@
 #include "SaveLoader.hpp"
 
 #include <cstdlib>
+#include <string>
 
 int main() {
 	SaveLoader* saveLoader = new SaveLoader;
@@ -14,7 +15,8 @@ int main() {
 	*load_sim = saveLoader->setParameters(*world_param, *sim_param);
 
 	World world(*world_param);
-	if (load_sim->isLoadWorld()) saveLoader->loadWorldSegNZones(world, load_sim->worldName());
+	if (load_sim->isLoadCheckpoint()) saveLoader->loadCheckpointSegNZones(world, SaveLoader::checkpointName(load_sim->checkpointName(), load_sim->checkpoint_step));
+	else if (load_sim->isLoadWorld()) saveLoader->loadWorldSegNZones(world, load_sim->worldName());
 	if (load_sim->isSaveWorld()) saveLoader->saveWorld(world, 10, FileHandler::KB, load_sim->worldName() + "-bin", 1);
 	if (!load_sim->isLoadPos()) world.will_use_nParticles(sim_param->max_part);
 
@@ -32,6 +34,7 @@ int main() {
 	delete sim_param;
 	delete world_param;
 	bool is_loading_pos = load_sim->isLoadPos();
+	std::string psp_name = load_sim->isLoadSimP() ? load_sim->simPName() : ""; // Where the autotuned strategies are written
 	delete load_sim;
 
 	Consometre conso_this_thread;
@@ -49,5 +52,9 @@ int main() {
 	}
 
 	sim.stop_simulation_threads();
+	if (sim.get_autotuner().is_finished()) {
+		SaveLoader saver;
+		saver.saveTuning(world, sim.params, "", psp_name);
+	}
 	return EXIT_SUCCESS;
 }
\ No newline at end of file
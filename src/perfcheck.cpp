@@ -0,0 +1,373 @@
+#include "Particle_simulator.hpp"
+#include "SaveLoader.hpp"
+#include "World.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NB_PHASES (uint8_t)Particle_simulator::phase_t::NB_PHASES
+
+/**
+* What to check, read from the command line.
+*/
+struct Options {
+	std::string baseline = "perfcheck/baseline.json"; //< File of the reference results.
+	bool update = false; //< Whether the baseline is written from this run instead of being compared to.
+	uint64_t steps = 500; //< Steps timed per scene and run.
+	uint64_t checksum_steps = 200; //< Steps simulated on a single thread before computing the checksum.
+	uint32_t runs = 3; //< Timed runs per scene. The best steps/s and the best time of each phase are kept.
+	float tolerance = 0.15f; //< Fraction of steps/s that can be lost before failing.
+	float phase_tolerance = 0.30f; //< Fraction of time a phase can gain before failing.
+	float phase_floor = 0.1f; //< Phase time differences below this (ms/step) are ignored as noise.
+	std::vector<std::pair<std::string, std::string>> scenes = {
+		{"Default", "Default"}, {"Default", "water"}, {"Default", "big_sand"}, {"TeslaValve", "Default"}, {"shower", "shower"}
+	};
+};
+
+/**
+* Measures of a scene.
+*/
+struct SceneResult {
+	std::string map, psp;
+	double steps_per_s = 0;
+	double phase_ms[NB_PHASES] = {}; //< Time of each phase per step on the thread 0.
+	uint64_t checksum = 0;
+};
+
+
+/**
+* The few JSON values needed to read a baseline back : numbers, strings, arrays and objects.
+*/
+struct Json {
+	enum class type_t : uint8_t {NUL = 0, NUMBER, STRING, ARRAY, OBJECT};
+	type_t type = type_t::NUL;
+	double number = 0;
+	std::string string;
+	std::vector<Json> array;
+	std::map<std::string, Json> object;
+
+	/**
+	* @return The member key of an object, or a null value if there is none.
+	*/
+	const Json& operator[](const std::string& key) const {
+		static const Json null;
+		auto it = object.find(key);
+		return it == object.end() ? null : it->second;
+	};
+};
+
+/**
+* @brief Reads the JSON value starting at text[pos] and moves pos after it. true, false and null are read as null.
+* @return false if the text isn't valid JSON.
+*/
+bool parse_json(const std::string& text, size_t& pos, Json& value) {
+	auto skip_spaces = [&]() {while (pos < text.size() && std::isspace((unsigned char)text[pos])) pos++;};
+	auto parse_string = [&](std::string& str) {
+		if (text[pos] != '"') return false;
+		for (pos++; pos < text.size() && text[pos] != '"'; pos++) {
+			if (text[pos] == '\\' && pos+1 < text.size()) pos++; // Escaped characters are kept as they are
+			str += text[pos];
+		}
+		return pos++ < text.size();
+	};
+
+	skip_spaces();
+	if (pos >= text.size()) return false;
+	char c = text[pos];
+	if (c == '{') {
+		value.type = Json::type_t::OBJECT;
+		pos++;
+		skip_spaces();
+		if (pos < text.size() && text[pos] == '}') {
+			pos++;
+			return true;
+		}
+		while (pos < text.size()) {
+			std::string key;
+			skip_spaces();
+			if (!parse_string(key)) return false;
+			skip_spaces();
+			if (pos >= text.size() || text[pos++] != ':') return false;
+			if (!parse_json(text, pos, value.object[key])) return false;
+			skip_spaces();
+			if (pos < text.size() && text[pos] == ',') pos++;
+			else return pos < text.size() && text[pos++] == '}';
+		}
+		return false;
+	}
+	if (c == '[') {
+		value.type = Json::type_t::ARRAY;
+		pos++;
+		skip_spaces();
+		if (pos < text.size() && text[pos] == ']') {
+			pos++;
+			return true;
+		}
+		while (pos < text.size()) {
+			value.array.emplace_back();
+			if (!parse_json(text, pos, value.array.back())) return false;
+			skip_spaces();
+			if (pos < text.size() && text[pos] == ',') pos++;
+			else return pos < text.size() && text[pos++] == ']';
+		}
+		return false;
+	}
+	if (c == '"') {
+		value.type = Json::type_t::STRING;
+		return parse_string(value.string);
+	}
+	for (const char* word : {"true", "false", "null"}) {
+		if (text.compare(pos, std::strlen(word), word) == 0) {
+			pos += std::strlen(word);
+			return true;
+		}
+	}
+	char* end;
+	value.type = Json::type_t::NUMBER;
+	value.number = std::strtod(text.c_str() + pos, &end);
+	if (end == text.c_str() + pos) return false;
+	pos = end - text.c_str();
+	return true;
+}
+
+
+void print_usage(const char* program) {
+	std::cout << "Usage : " << program << " [options]" << std::endl;
+	std::cout << "\t--baseline file          Reference results (default perfcheck/baseline.json)." << std::endl;
+	std::cout << "\t--update                 Writes the baseline from this run instead of comparing to it." << std::endl;
+	std::cout << "\t--steps n                Steps timed per scene (default 500)." << std::endl;
+	std::cout << "\t--checksum-steps n       Steps simulated on 1 thread before the checksum (default 200)." << std::endl;
+	std::cout << "\t--runs n                 Timed runs per scene, the best times are kept (default 3)." << std::endl;
+	std::cout << "\t--tolerance f            Fraction of steps/s that can be lost (default 0.15)." << std::endl;
+	std::cout << "\t--phase-tolerance f      Fraction of time a phase can gain (default 0.30)." << std::endl;
+	std::cout << "\t--phase-floor ms         Phase differences below this many ms/step are ignored (default 0.1)." << std::endl;
+	std::cout << "\t--scene map:psp,...      Scenes to check instead of Default:Default, Default:water, Default:big_sand, TeslaValve:Default and shower:shower." << std::endl;
+}
+
+/**
+* @return false if the command line couldn't be read.
+*/
+bool parse_options(int argc, char** argv, Options& opt) {
+	bool scenes_given = false;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--update") {
+			opt.update = true;
+			continue;
+		}
+		if (i+1 >= argc) return false;
+		std::string value = argv[++i];
+		try {
+			if (arg == "--baseline") opt.baseline = value;
+			else if (arg == "--steps") opt.steps = std::max(std::stoull(value), 1ull);
+			else if (arg == "--checksum-steps") opt.checksum_steps = std::stoull(value);
+			else if (arg == "--runs") opt.runs = std::max(std::stoul(value), 1ul);
+			else if (arg == "--tolerance") opt.tolerance = std::stof(value);
+			else if (arg == "--phase-tolerance") opt.phase_tolerance = std::stof(value);
+			else if (arg == "--phase-floor") opt.phase_floor = std::stof(value);
+			else if (arg == "--scene") {
+				if (!scenes_given) opt.scenes.clear();
+				scenes_given = true;
+				std::stringstream list(value);
+				std::string scene;
+				while (std::getline(list, scene, ',')) {
+					size_t colon = scene.find(':');
+					if (colon == std::string::npos) return false;
+					opt.scenes.push_back({scene.substr(0, colon), scene.substr(colon+1)});
+				}
+			}
+			else return false;
+		} catch (const std::exception&) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/**
+* @brief Builds a simulation of the scene map:psp, then runs steps steps of it.
+* @param single_thread Whether to run on a single thread, so the result only depends on the seed of rand().
+* @param result Gets the steps/s and phase times, or the checksum if single_thread.
+* @return false if the scene couldn't be loaded.
+*/
+bool run_scene(const std::string& map, const std::string& psp, uint64_t steps, bool single_thread, SceneResult& result) {
+	SaveLoader loader;
+	WorldParam world_param;
+	PSparam sim_param;
+	if (loader.loadParam(world_param, map) < 0 || loader.loadParam(sim_param, psp) < 0) return false;
+	if (single_thread) {
+		sim_param.n_threads = 1;
+		sim_param.elastic_threads = false;
+		sim_param.decomposition = (uint8_t)Particle_simulator::decomposition_t::INDEX;
+		sim_param.pinning = (uint8_t)Topology::pinning_t::NONE;
+		std::srand(1);
+	}
+	World world(world_param);
+	loader.loadWorldSegNZones(world, map);
+	world.will_use_nParticles(sim_param.max_part);
+	Particle_simulator sim(world, sim_param);
+
+	sim.stop_after(steps);
+	sim.start_simulation_threads();
+	while (sim.simulate) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	sim.stop_simulation_threads();
+
+	if (single_thread) result.checksum = sim.checksum();
+	else {
+		// Timed from the phases rather than from here, so starting the threads and waiting for them doesn't count
+		double total_ms = 0;
+		for (uint8_t i=0; i<NB_PHASES; i++) {
+			result.phase_ms[i] = (double)sim.get_phase_time((Particle_simulator::phase_t)i) / sim.get_step_count() / 1000000;
+			total_ms += result.phase_ms[i];
+		}
+		result.steps_per_s = 1000 / std::max(total_ms, 1e-9);
+	}
+	return true;
+}
+
+std::string hex(uint64_t value) {
+	std::stringstream oss;
+	oss << std::hex << std::setw(16) << std::setfill('0') << value;
+	return oss.str();
+}
+
+void write_baseline(const std::string& file_name, const std::vector<SceneResult>& results, const Options& opt) {
+	std::error_code error;
+	if (std::filesystem::path(file_name).has_parent_path()) std::filesystem::create_directories(std::filesystem::path(file_name).parent_path(), error);
+	std::ofstream file(file_name);
+	char date[32];
+	std::time_t now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+	file << "{\n\t\"date\": \"" << date << "\",\n\t\"steps\": " << opt.steps << ",\n\t\"checksum_steps\": " << opt.checksum_steps << ",\n\t\"scenes\": [\n";
+	for (size_t i=0; i<results.size(); i++) {
+		const SceneResult& res = results[i];
+		file << "\t\t{\"map\": \"" << res.map << "\", \"psp\": \"" << res.psp << "\", \"steps_per_s\": " << res.steps_per_s << ", \"checksum\": \"" << hex(res.checksum) << "\", \"phases_ms\": {";
+		for (uint8_t p=0; p<NB_PHASES; p++) file << (p ? ", " : "") << "\"" << Particle_simulator::phase_names[p] << "\": " << res.phase_ms[p];
+		file << "}}" << (i+1 < results.size() ? "," : "") << "\n";
+	}
+	file << "\t]\n}\n";
+	std::cout << "Baseline written in " << file_name << std::endl;
+}
+
+/**
+* @brief Compares a scene to its baseline and prints the differences.
+* @return The number of failed checks.
+*/
+uint32_t compare(const SceneResult& res, const Json& base, const Options& opt) {
+	uint32_t failures = 0;
+	std::cout << res.map << ":" << res.psp << std::endl;
+
+	double base_sps = base["steps_per_s"].number;
+	bool slower = res.steps_per_s < base_sps * (1 - opt.tolerance);
+	failures += slower;
+	std::cout << "\t" << (slower ? "FAIL " : "ok   ") << std::left << std::setw(20) << "steps/s" << std::right << std::setw(12) << res.steps_per_s
+		<< "  baseline " << std::setw(10) << base_sps << "  (" << std::showpos << 100*(res.steps_per_s/base_sps - 1) << std::noshowpos << "%)" << std::endl;
+
+	for (uint8_t p=0; p<NB_PHASES; p++) {
+		const Json& base_phase = base["phases_ms"][Particle_simulator::phase_names[p]];
+		if (base_phase.type != Json::type_t::NUMBER) continue;
+		double diff = res.phase_ms[p] - base_phase.number;
+		bool slower_phase = diff > opt.phase_floor && res.phase_ms[p] > base_phase.number * (1 + opt.phase_tolerance);
+		failures += slower_phase;
+		if (slower_phase || std::abs(diff) > opt.phase_floor) {
+			std::cout << "\t" << (slower_phase ? "FAIL " : "ok   ") << std::left << std::setw(20) << Particle_simulator::phase_names[p] << std::right << std::setw(12) << res.phase_ms[p]
+				<< "  baseline " << std::setw(10) << base_phase.number << "  ms/step" << std::endl;
+		}
+	}
+
+	bool changed = base["checksum"].string != hex(res.checksum);
+	failures += changed;
+	std::cout << "\t" << (changed ? "FAIL " : "ok   ") << std::left << std::setw(20) << "checksum" << std::right << std::setw(12) << hex(res.checksum)
+		<< "  baseline " << base["checksum"].string << (changed ? "  (the physics changed)" : "") << std::endl;
+	return failures;
+}
+
+
+/**
+* Checks the simulation didn't get slower nor change its physics, by running a fixed set of scenes and comparing them to a baseline.
+* Each scene is timed for a number of steps (the best of a few runs is kept), then run again on a single thread from a fixed seed for its checksum.
+* With --update the baseline is written instead. It should be written on the machine it is compared on.
+* Returns EXIT_FAILURE if a check failed.
+*/
+int main(int argc, char** argv) {
+	Options opt;
+	if (!parse_options(argc, argv, opt)) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	Json baseline;
+	if (!opt.update) {
+		std::ifstream file(opt.baseline);
+		std::stringstream text;
+		text << file.rdbuf();
+		size_t pos = 0;
+		if (!file.is_open() || !parse_json(text.str(), pos, baseline) || baseline.type != Json::type_t::OBJECT) {
+			std::cout << "Couldn't read the baseline " << opt.baseline << ". Write it with --update first." << std::endl;
+			return EXIT_FAILURE;
+		}
+		if ((uint64_t)baseline["steps"].number != opt.steps || (uint64_t)baseline["checksum_steps"].number != opt.checksum_steps) {
+			std::cout << "The baseline was written with other numbers of steps" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<SceneResult> results;
+	uint32_t failures = 0;
+	for (auto& scene : opt.scenes) {
+		SceneResult res;
+		res.map = scene.first;
+		res.psp = scene.second;
+		std::cout << "Running " << res.map << ":" << res.psp << "..." << std::endl;
+
+		// The simulation is verbose, so it is silenced while running
+		std::streambuf* out = std::cout.rdbuf(nullptr);
+		bool loaded = true;
+		for (uint32_t r=0; r<opt.runs && loaded; r++) {
+			SceneResult run = res;
+			loaded = run_scene(res.map, res.psp, opt.steps, false, run);
+			res.steps_per_s = std::max(res.steps_per_s, run.steps_per_s);
+			for (uint8_t p=0; p<NB_PHASES; p++) res.phase_ms[p] = r ? std::min(res.phase_ms[p], run.phase_ms[p]) : run.phase_ms[p];
+		}
+		if (loaded) loaded = run_scene(res.map, res.psp, opt.checksum_steps, true, res);
+		std::cout.rdbuf(out);
+		if (!loaded) {
+			std::cout << "Couldn't load " << res.map << ":" << res.psp << std::endl;
+			failures++;
+			continue;
+		}
+		results.push_back(res);
+
+		if (!opt.update) {
+			const Json* base = nullptr;
+			for (const Json& base_scene : baseline["scenes"].array) {
+				if (base_scene["map"].string == res.map && base_scene["psp"].string == res.psp) base = &base_scene;
+			}
+			if (base) failures += compare(res, *base, opt);
+			else std::cout << "\tNot in the baseline" << std::endl;
+		}
+	}
+
+	if (opt.update) {
+		write_baseline(opt.baseline, results, opt);
+		return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+	std::cout << std::endl << (failures ? "perfcheck failed : " + std::to_string(failures) + " check(s)" : "perfcheck passed") << std::endl;
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
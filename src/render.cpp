@@ -0,0 +1,106 @@
+#include "FrameWriter.hpp"
+#include "Particle_simulator.hpp"
+#include "PosReader.hpp"
+#include "Rasterizer.hpp"
+#include "SaveLoader.hpp"
+#include "World.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#define NULLPART (uint32_t)-1
+
+void print_usage(const char* program) {
+	std::cout << "Usage : " << program << " <map> <psp> <positions> [--name <name>] [--width <px>] [--every <frames>] [--raw] [--threads <n>]" << std::endl;
+	std::cout << "\tmap       Map file in saves/Maps, the one the positions were recorded in (e.g. Default)" << std::endl;
+	std::cout << "\tpsp       Simulation parameters file in saves/Parameters, for the radius of the particles (e.g. Default)" << std::endl;
+	std::cout << "\tpositions Positions file in saves/Positions, with or without its folder and extension (e.g. run1)" << std::endl;
+	std::cout << "\t--name    Name of the images written in saves/Frames, the positions file's by default" << std::endl;
+	std::cout << "\t--width   Width of the images in pixels, the height following the world's (default 1280)" << std::endl;
+	std::cout << "\t--every   Draws one frame out of this many (default 1)" << std::endl;
+	std::cout << "\t--raw     Writes the images as a single raw RGBA stream rather than PPM files" << std::endl;
+	std::cout << "\t--threads Number of threads drawing the images (default : one per 2 hardware threads)" << std::endl;
+}
+
+/**
+* Draws the frames of a positions file into images, without a window, e.g. to make a video of a run recorded on a server.
+* Usage : particle_sim2_render <map> <psp> <positions> [--name <name>] [--width <px>] [--every <frames>] [--raw] [--threads <n>]
+* A PosReader decodes the frames ahead while a Rasterizer draws them and a FrameWriter writes the images in saves/Frames.
+*/
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	std::string map_name = std::filesystem::path(argv[1]).stem().string();
+	std::string psp_name = std::filesystem::path(argv[2]).stem().string();
+	std::string pos_name = std::filesystem::path(argv[3]).stem().string();
+	std::string name = pos_name;
+	uint32_t width = 1280, n_threads = 0;
+	int32_t every = 1;
+	FrameWriter::format_t format = FrameWriter::format_t::PPM;
+	for (int a=4; a<argc; a++) {
+		std::string option = argv[a];
+		if (option == "--raw") format = FrameWriter::format_t::RAW;
+		else if (option == "--name" && a+1 < argc) name = argv[++a];
+		else if (option == "--width" && a+1 < argc) width = std::max(std::atoi(argv[++a]), 2);
+		else if (option == "--every" && a+1 < argc) every = std::max(std::atoi(argv[++a]), 1);
+		else if (option == "--threads" && a+1 < argc) n_threads = std::atoi(argv[++a]);
+		else {
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	SaveLoader saveLoader;
+	WorldParam world_param;
+	PSparam sim_param;
+	if (saveLoader.loadParam(world_param, map_name) < 0) return EXIT_FAILURE;
+	if (saveLoader.loadParam(sim_param, psp_name) < 0) return EXIT_FAILURE;
+	World world(world_param);
+	saveLoader.loadWorldSegNZones(world, map_name);
+
+	SLinfoPos info = SLinfoPos::Lazy();
+	info.load_pos = true;
+	std::strncpy(info.posFileName, pos_name.c_str(), SLinfoPos::fileNameSize-1);
+	uint32_t max_particles = sim_param.max_part;
+	{ // A file saved with IDs knows how many Particles its frames can have
+		SaveLoader loader;
+		loader.prepareLoadPos(max_particles, info);
+		max_particles = std::max(max_particles, loader.getPosIdBound());
+	}
+	SaveLoader loader;
+	loader.prepareLoadPos(max_particles, info);
+	uint32_t n_frames = loader.getPosFrameCount();
+	if (!n_frames) {
+		std::cout << "No frame to draw in " << pos_name << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	Rasterizer rasterizer(world, width, sim_param.radii, Rasterizer::DEFAULT_MAX_SPEED, n_threads);
+	FrameWriter frame_writer(name, rasterizer.getWidth(), rasterizer.getHeight(), format);
+	std::cout << "Drawing " << (n_frames + every-1) / every << " of " << n_frames << " frames in " << rasterizer.getWidth() << "x" << rasterizer.getHeight()
+		<< " on " << rasterizer.getThreads() << " thread" << (rasterizer.getThreads() > 1 ? "s" : "") << std::endl;
+
+	auto start = std::chrono::steady_clock::now();
+	PosReader reader(loader, max_particles);
+	reader.restart(0, every);
+	bool end = false, failed = false;
+	while (true) {
+		PosReader::Frame* frame = reader.pop(true, end);
+		if (!frame || frame->n_parts == NULLPART) {
+			failed |= !end;
+			break;
+		}
+		failed |= !frame_writer.submit(rasterizer.draw(frame->particles.data(), frame->n_parts));
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Drew " << frame_writer.getFrameCount() << " frames in " << seconds << " s (" << frame_writer.getFrameCount() / seconds << " fps)" << std::endl;
+	frame_writer.print_stats();
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}